@@ -0,0 +1,13 @@
+#version 330
+
+in vec2 UV;
+
+out vec4 outputColor;
+
+// Premultiplied alpha, composited with glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA).
+uniform sampler2D layerSampler;
+
+void main()
+{
+	outputColor = texture(layerSampler, UV);
+}
@@ -0,0 +1,11 @@
+#version 330
+
+out vec2 UV;
+
+// One triangle that covers the whole screen, built from gl_VertexID.
+void main(void)
+{
+	vec2 corner = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2));
+	UV = corner;
+	gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
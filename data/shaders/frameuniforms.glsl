@@ -0,0 +1,8 @@
+// Per frame values shared by every program, see FrameUniformData in frameuniforms.hpp.
+layout(std140) uniform FrameUniforms
+{
+	mat4 ortho;
+	vec4 viewport; // x, y, width, height
+	float time;
+	float deltaTime;
+};
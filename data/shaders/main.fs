@@ -1,13 +1,40 @@
 #version 330
 
+#ifdef TEXTURED
 in vec2 UV;
+uniform sampler2D textureSampler;
+#endif
+
+#ifdef VIRTUAL_TEXTURE
+#include "virtualtexture.glsl"
+#endif
+
+#ifdef VERTEX_COLOR
 in vec4 fragColor;
+#endif
 
 out vec4 outputColor;
 
-uniform sampler2D textureSampler;
-
 void main()
 {
-	outputColor = fragColor * texture(textureSampler, UV);
-}
\ No newline at end of file
+	vec4 color = vec4(1.0);
+#ifdef VERTEX_COLOR
+	color = fragColor;
+#endif
+#ifdef VIRTUAL_FEEDBACK
+	outputColor = virtual_feedback(UV);
+	return;
+#endif
+#if defined(VIRTUAL_TEXTURE)
+	color *= virtual_texture(textureSampler, UV);
+#elif defined(TEXTURED)
+	color *= texture(textureSampler, UV);
+#endif
+#ifdef ALPHA_TEST
+	// Opaque objects can't blend so cut out the transparent parts instead.
+	if (color.a < 0.5) {
+		discard;
+	}
+#endif
+	outputColor = color;
+}
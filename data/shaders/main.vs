@@ -1,27 +1,39 @@
 #version 330
 
+// Feature defines, set by the renderer per variant:
+// TEXTURED, VERTEX_COLOR, MODEL_TRANSFORM
+
 in vec3 position;
-in vec2 vertexUV;
-in vec4 color;
 
+#ifdef TEXTURED
+in vec2 vertexUV;
 out vec2 UV;
-out vec4 fragColor;
+#endif
 
-uniform mat4 ortho;
+#ifdef VERTEX_COLOR
+in vec4 color;
+out vec4 fragColor;
+#endif
 
-uniform samplerBuffer matrixBuffer;
-uniform usamplerBuffer matrixIndices;
+#include "frameuniforms.glsl"
 
-mat4 read_matrix(int offset)
-{
-    return mat4(texelFetch(matrixBuffer, offset), texelFetch(matrixBuffer, offset + 1), texelFetch(matrixBuffer, offset + 2), texelFetch(matrixBuffer, offset + 3));
-}
+#ifdef MODEL_TRANSFORM
+#include "matrixbuffer.glsl"
+#endif
 
 void main(void)
 {
-	int faceID = int(gl_VertexID/3);
-	int matrixOffset = int(texelFetch(matrixIndices, faceID).r) * 4;
-	gl_Position = ortho * read_matrix(matrixOffset) * vec4(position, 1.0);
+#ifdef MODEL_TRANSFORM
+	gl_Position = ortho * model_matrix() * vec4(position, 1.0);
+#else
+	gl_Position = ortho * vec4(position, 1.0);
+#endif
+
+#ifdef TEXTURED
 	UV = vertexUV;
+#endif
+
+#ifdef VERTEX_COLOR
 	fragColor = color;
-}
\ No newline at end of file
+#endif
+}
@@ -0,0 +1,15 @@
+// Per object model matrices, looked up through an index per triangle.
+uniform samplerBuffer matrixBuffer;
+uniform usamplerBuffer matrixIndices;
+
+mat4 read_matrix(int offset)
+{
+    return mat4(texelFetch(matrixBuffer, offset), texelFetch(matrixBuffer, offset + 1), texelFetch(matrixBuffer, offset + 2), texelFetch(matrixBuffer, offset + 3));
+}
+
+mat4 model_matrix()
+{
+	int faceID = int(gl_VertexID/3);
+	int matrixOffset = int(texelFetch(matrixIndices, faceID).r) * 4;
+	return read_matrix(matrixOffset);
+}
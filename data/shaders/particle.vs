@@ -0,0 +1,25 @@
+#version 330
+
+in vec2 position;
+in float age;
+
+out vec4 fragColor;
+
+#include "frameuniforms.glsl"
+
+// Row 0 is colour and alpha over the particle's life, row 1 has the point size scale in red.
+uniform sampler2D gradientSampler;
+uniform vec4 particleParams; // point size, depth
+
+void main(void)
+{
+	gl_Position = ortho * vec4(position, particleParams.y, 1.0);
+	if (age >= 1.0) {
+		// Dead, gpu simulated particles stay in their buffer until the slot is reused.
+		gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+	}
+
+	fragColor = textureLod(gradientSampler, vec2(age, 0.25), 0.0);
+	float sizeScale = textureLod(gradientSampler, vec2(age, 0.75), 0.0).r;
+	gl_PointSize = max(1.0, particleParams.x * sizeScale);
+}
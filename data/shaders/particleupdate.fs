@@ -0,0 +1,9 @@
+#version 330
+
+// Never runs, the update is drawn with GL_RASTERIZER_DISCARD. Programs need a fragment shader here.
+out vec4 outputColor;
+
+void main()
+{
+	outputColor = vec4(0.0);
+}
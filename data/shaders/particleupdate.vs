@@ -0,0 +1,64 @@
+#version 330
+
+// Moves every particle on by one step, written out through transform feedback.
+// See GpuParticleBatch, the layout matches GpuParticle.
+in vec2 position;
+in vec2 velocity;
+in float age;
+in float ageRate;
+
+out vec2 outPosition;
+out vec2 outVelocity;
+out float outAge;
+out float outAgeRate;
+
+uniform vec4 emitter; // position, velocity
+uniform vec4 simParams; // dt, gravity, 1 / lifetime, dispersion
+uniform uvec4 spawnParams; // first slot, slot count, capacity, step
+
+uint hash(uint x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+// Uniform in [-1, 1).
+float random(uint x)
+{
+	return float(hash(x) >> 8) / 8388608.0 - 1.0;
+}
+
+void main(void)
+{
+	vec2 p = position;
+	vec2 v = velocity;
+	float a = age;
+	float rate = ageRate;
+
+	// Spawn slots run round the buffer as a ring starting at spawnParams.x.
+	uint slot = uint(gl_VertexID);
+	uint offset = (slot + spawnParams.z - spawnParams.x) % spawnParams.z;
+	if (offset < spawnParams.y) {
+		uint seed = hash(slot ^ hash(spawnParams.w));
+		p = emitter.xy;
+		v = emitter.zw + vec2(random(seed), random(seed + 1u)) * simParams.w;
+		a = 0.0;
+		rate = simParams.z;
+	}
+
+	if (a < 1.0) {
+		float dt = simParams.x;
+		a += dt * rate;
+		v.y += simParams.y * dt;
+		p += v * dt;
+	}
+
+	outPosition = p;
+	outVelocity = v;
+	outAge = a;
+	outAgeRate = rate;
+}
@@ -0,0 +1,37 @@
+#version 330
+
+// Sprite records come in as per instance attributes, see Sprite in spritebatch.hpp.
+in vec2 spritePosition;
+in vec2 spriteSize;
+in float spriteRotation;
+in float spriteDepth;
+in uint spriteUVRect;
+in vec4 spriteColor;
+
+out vec2 UV;
+out vec4 fragColor;
+
+#include "frameuniforms.glsl"
+
+uniform samplerBuffer uvRects; // min uv in xy, max uv in zw
+
+// Same corner order as create_rect_mesh.
+const vec2 corners[6] = vec2[6](
+	vec2(0.0, 0.0), vec2(0.0, 1.0), vec2(1.0, 0.0),
+	vec2(0.0, 1.0), vec2(1.0, 1.0), vec2(1.0, 0.0));
+
+void main(void)
+{
+	vec2 corner = corners[gl_VertexID];
+	vec2 local = (corner - 0.5) * spriteSize;
+
+	float s = sin(spriteRotation);
+	float c = cos(spriteRotation);
+	vec2 position = spritePosition + vec2(local.x * c - local.y * s, local.x * s + local.y * c);
+
+	gl_Position = ortho * vec4(position, spriteDepth, 1.0);
+
+	vec4 rect = texelFetch(uvRects, int(spriteUVRect));
+	UV = mix(rect.xy, rect.zw, corner);
+	fragColor = spriteColor;
+}
@@ -0,0 +1,51 @@
+// Virtual texture lookups, see VirtualTexture. The cache is bound as the texture sampler
+// and indirectionSampler has a texel per tile at each level: the cache slot in xy and the
+// level of the tile in that slot in z, which is coarser than asked for when it's missing.
+uniform sampler2D indirectionSampler;
+uniform vec4 virtualSize; // width, height, tile size, border
+uniform vec4 virtualCache; // cache width, cache height, last level, lod bias
+uniform float virtualID; // Written to the feedback target so requests find their texture.
+
+float virtual_level(vec2 uv)
+{
+	vec2 dx = dFdx(uv * virtualSize.xy);
+	vec2 dy = dFdy(uv * virtualSize.xy);
+	float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + virtualCache.w;
+	return clamp(floor(lod), 0.0, virtualCache.z);
+}
+
+// Matches the sizes the mips were built with.
+vec2 virtual_level_size(float level)
+{
+	return max(floor(virtualSize.xy / exp2(level)), vec2(1.0));
+}
+
+ivec2 virtual_tile(vec2 uv, float level)
+{
+	vec2 size = virtual_level_size(level);
+	vec2 tiles = ceil(size / virtualSize.z);
+	return ivec2(clamp(floor(uv * size / virtualSize.z), vec2(0.0), tiles - 1.0));
+}
+
+vec4 virtual_texture(sampler2D cache, vec2 uv)
+{
+	uv = clamp(uv, 0.0, 1.0);
+	float level = virtual_level(uv);
+	vec4 entry = texelFetch(indirectionSampler, virtual_tile(uv, level), int(level)) * 255.0;
+
+	// Position in tiles at the level that's in the cache, scaled from the level asked for
+	// so it lines up with how tiles were split even when the sizes don't halve evenly.
+	vec2 position = uv * virtual_level_size(level) / exp2(entry.z - level) / virtualSize.z;
+	vec2 inTile = min(position - floor(position), vec2(1.0));
+	float stride = virtualSize.z + virtualSize.w * 2.0;
+	vec2 texel = entry.xy * stride + virtualSize.w + inTile * virtualSize.z;
+	return textureLod(cache, texel / virtualCache.xy, 0.0);
+}
+
+// What the feedback pass writes, the tile wanted at this pixel.
+vec4 virtual_feedback(vec2 uv)
+{
+	uv = clamp(uv, 0.0, 1.0);
+	float level = virtual_level(uv);
+	return vec4(vec2(virtual_tile(uv, level)), level, virtualID) / 255.0;
+}
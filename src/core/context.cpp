@@ -8,6 +8,8 @@ namespace ORCore
         m_profile = SDL_GL_CONTEXT_PROFILE_CORE;
 
         SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
+        // The opaque pass depth tests, ask for 24 bits rather than SDL's default of 16.
+        SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
 
         SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, m_major);
         SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, m_minor);
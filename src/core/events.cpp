@@ -1,4 +1,5 @@
 #include "events.hpp"
+#include "profiler.hpp"
 
 #include <algorithm>
 #include <thread>
@@ -47,6 +48,7 @@ namespace ORCore
 
     void EventPumpSDL2::process()
     {
+        PROFILE_ZONE("EventPumpSDL2::process");
         SDL_Event sdlEvent;
 
         while (SDL_PollEvent(&sdlEvent)) {
@@ -0,0 +1,190 @@
+#include "config.hpp"
+#include "offscreen.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#if defined(HAVE_EGL)
+#   include <EGL/eglext.h>
+#endif
+
+namespace ORCore
+{
+#if defined(HAVE_EGL)
+    OffscreenContext::OffscreenContext(int major, int minor)
+    : m_major(major), m_minor(minor)
+    {
+        // Prefer the mesa surfaceless platform as it needs neither X11 nor a gpu device node.
+        // Fall back to whatever the default display is for other drivers.
+        auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+            eglGetProcAddress("eglGetPlatformDisplayEXT"));
+
+        if (getPlatformDisplay != nullptr) {
+            m_display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        }
+        if (m_display == EGL_NO_DISPLAY) {
+            m_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        }
+        if (m_display == EGL_NO_DISPLAY || eglInitialize(m_display, nullptr, nullptr) != EGL_TRUE) {
+            throw std::runtime_error("Error: Failed to initialize EGL display.");
+        }
+
+        const char *extensions = eglQueryString(m_display, EGL_EXTENSIONS);
+        if (extensions == nullptr || std::strstr(extensions, "EGL_KHR_surfaceless_context") == nullptr) {
+            throw std::runtime_error("Error: EGL_KHR_surfaceless_context is not supported.");
+        }
+
+        if (eglBindAPI(EGL_OPENGL_API) != EGL_TRUE) {
+            throw std::runtime_error("Error: EGL does not support desktop OpenGL.");
+        }
+
+        const EGLint configAttribs[] = {
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_RED_SIZE, 8,
+            EGL_GREEN_SIZE, 8,
+            EGL_BLUE_SIZE, 8,
+            EGL_NONE
+        };
+
+        EGLConfig config = nullptr;
+        EGLint configCount = 0;
+        eglChooseConfig(m_display, configAttribs, &config, 1, &configCount);
+
+        const EGLint contextAttribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, m_major,
+            EGL_CONTEXT_MINOR_VERSION, m_minor,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+
+        // We never render to an egl surface so any config will do, EGL_KHR_no_config_context
+        // lets us skip it entirely when the display has no configs at all.
+        m_context = eglCreateContext(m_display, configCount > 0 ? config : EGL_NO_CONFIG_KHR,
+                                     EGL_NO_CONTEXT, contextAttribs);
+        if (m_context == EGL_NO_CONTEXT) {
+            eglTerminate(m_display);
+            throw std::runtime_error("Error: Failed to create EGL context.");
+        }
+    }
+
+    OffscreenContext::~OffscreenContext()
+    {
+        release();
+        eglDestroyContext(m_display, m_context);
+        eglTerminate(m_display);
+    }
+
+    void OffscreenContext::make_current()
+    {
+        if (eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_context) != EGL_TRUE) {
+            throw std::runtime_error("Error: Failed to make EGL context current.");
+        }
+    }
+
+    void OffscreenContext::release()
+    {
+        eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    }
+
+    void* OffscreenContext::get_proc_address(const char* name)
+    {
+        return reinterpret_cast<void*>(eglGetProcAddress(name));
+    }
+
+#else
+    OffscreenContext::OffscreenContext(int major, int minor)
+    : m_major(major), m_minor(minor)
+    {
+        throw std::runtime_error("Error: Built without EGL, headless mode is unavailable.");
+    }
+
+    OffscreenContext::~OffscreenContext()
+    {
+    }
+
+    void OffscreenContext::make_current()
+    {
+    }
+
+    void OffscreenContext::release()
+    {
+    }
+
+    void* OffscreenContext::get_proc_address(const char* name)
+    {
+        return nullptr;
+    }
+#endif
+
+
+    OffscreenTarget::OffscreenTarget(int width, int height)
+    : m_width(width), m_height(height), m_fbo(0), m_colorRbo(0), m_depthRbo(0)
+    {
+    }
+
+    OffscreenTarget::~OffscreenTarget()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteRenderbuffers(1, &m_depthRbo);
+        glDeleteRenderbuffers(1, &m_colorRbo);
+        glDeleteFramebuffers(1, &m_fbo);
+    }
+
+    void OffscreenTarget::init_gl()
+    {
+        glGenFramebuffers(1, &m_fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+
+        glGenRenderbuffers(1, &m_colorRbo);
+        glBindRenderbuffer(GL_RENDERBUFFER, m_colorRbo);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_width, m_height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_colorRbo);
+
+        glGenRenderbuffers(1, &m_depthRbo);
+        glBindRenderbuffer(GL_RENDERBUFFER, m_depthRbo);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, m_width, m_height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_depthRbo);
+
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            throw std::runtime_error("Error: Offscreen framebuffer is incomplete.");
+        }
+    }
+
+    void OffscreenTarget::bind()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+    }
+
+    void OffscreenTarget::read_pixels(std::vector<unsigned char>& pixels)
+    {
+        int rowSize = m_width * 3;
+        m_readBuffer.resize(rowSize * m_height);
+        pixels.resize(rowSize * m_height);
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, m_width, m_height, GL_RGB, GL_UNSIGNED_BYTE, &m_readBuffer[0]);
+
+        // OpenGL gives us the bottom row first, flip it so images are the right way up.
+        for (int y = 0; y < m_height; y++) {
+            std::memcpy(&pixels[y * rowSize], &m_readBuffer[(m_height - 1 - y) * rowSize], rowSize);
+        }
+    }
+
+    bool OffscreenTarget::save_ppm(std::string filename)
+    {
+        std::vector<unsigned char> pixels;
+        read_pixels(pixels);
+
+        std::ofstream out(filename, std::ios_base::out | std::ios_base::binary);
+        if (!out) {
+            return false;
+        }
+        out << "P6\n" << m_width << " " << m_height << "\n255\n";
+        out.write(reinterpret_cast<const char*>(&pixels[0]), pixels.size());
+        return static_cast<bool>(out);
+    }
+} // namespace ORCore
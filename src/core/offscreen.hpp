@@ -0,0 +1,66 @@
+#pragma once
+#include "config.hpp"
+
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+
+#if defined(HAVE_EGL)
+#   include <EGL/egl.h>
+#endif
+
+namespace ORCore
+{
+    // Surfaceless EGL context used when running without a display or window system.
+    // On machines without a GPU mesa will hand us llvmpipe, which is what we want for
+    // benchmarking on servers.
+    class OffscreenContext
+    {
+    public:
+        OffscreenContext(int major, int minor);
+        ~OffscreenContext();
+
+        void make_current();
+        void release();
+
+        // Used to load gl function pointers through glad.
+        static void* get_proc_address(const char* name);
+
+    private:
+        int m_major;
+        int m_minor;
+#if defined(HAVE_EGL)
+        EGLDisplay m_display = EGL_NO_DISPLAY;
+        EGLContext m_context = EGL_NO_CONTEXT;
+#endif
+    };
+
+    // Framebuffer object that stands in for the default framebuffer when there
+    // isn't a window to render to.
+    class OffscreenTarget
+    {
+    public:
+        OffscreenTarget(int width, int height);
+        ~OffscreenTarget();
+
+        void init_gl();
+        void bind();
+
+        // Reads back the color buffer as tightly packed RGB rows, top row first.
+        void read_pixels(std::vector<unsigned char>& pixels);
+
+        // Writes the current color buffer out as a binary ppm image.
+        bool save_ppm(std::string filename);
+
+        int get_width() { return m_width; }
+        int get_height() { return m_height; }
+
+    private:
+        int m_width;
+        int m_height;
+        GLuint m_fbo;
+        GLuint m_colorRbo;
+        GLuint m_depthRbo;
+        std::vector<unsigned char> m_readBuffer;
+    };
+} // namespace ORCore
@@ -0,0 +1,37 @@
+#include "config.hpp"
+
+// Built with AVX2 code generation, nothing in here may run before
+// particle_kernel_supported(ParticleKernel::AVX2) has said the cpu can.
+#if defined(ENABLE_AVX2)
+#include <cstddef>
+#include <immintrin.h>
+
+namespace ORCore
+{
+    void integrate_particles_avx2(float *x, float *y, float *velocityX, float *velocityY, float *lifetime,
+                                  size_t count, float dt, float fall)
+    {
+        const __m256 step = _mm256_set1_ps(dt);
+        const __m256 fallStep = _mm256_set1_ps(fall);
+        for (size_t i = 0; i < count; i += 16)
+        {
+            __m256 life0 = _mm256_load_ps(lifetime + i);
+            __m256 life1 = _mm256_load_ps(lifetime + i + 8);
+            __m256 vy0 = _mm256_add_ps(_mm256_load_ps(velocityY + i), fallStep);
+            __m256 vy1 = _mm256_add_ps(_mm256_load_ps(velocityY + i + 8), fallStep);
+            __m256 x0 = _mm256_add_ps(_mm256_load_ps(x + i), _mm256_mul_ps(_mm256_load_ps(velocityX + i), step));
+            __m256 x1 = _mm256_add_ps(_mm256_load_ps(x + i + 8), _mm256_mul_ps(_mm256_load_ps(velocityX + i + 8), step));
+            __m256 y0 = _mm256_add_ps(_mm256_load_ps(y + i), _mm256_mul_ps(vy0, step));
+            __m256 y1 = _mm256_add_ps(_mm256_load_ps(y + i + 8), _mm256_mul_ps(vy1, step));
+            _mm256_store_ps(lifetime + i, _mm256_sub_ps(life0, step));
+            _mm256_store_ps(lifetime + i + 8, _mm256_sub_ps(life1, step));
+            _mm256_store_ps(velocityY + i, vy0);
+            _mm256_store_ps(velocityY + i + 8, vy1);
+            _mm256_store_ps(x + i, x0);
+            _mm256_store_ps(x + i + 8, x1);
+            _mm256_store_ps(y + i, y0);
+            _mm256_store_ps(y + i + 8, y1);
+        }
+    }
+} // namespace ORCore
+#endif
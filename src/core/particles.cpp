@@ -1,6 +1,8 @@
 #include <algorithm>
+#include <cmath>
 #include <iostream>
 #include "particles.hpp"
+#include "profiler.hpp"
 
 namespace ORCore
 {
@@ -11,8 +13,10 @@ namespace ORCore
     m_dispersion(-5.0f, 5.0f),
     m_posX(0),
     m_posY(0),
-    m_creationRate(6000)
+    m_creationRate(6000),
+    m_lifetime(7.0f)
     {
+        set_overflow(ParticleOverflow::DropOldest);
     }
 
     void PointEmitter::update(double dt)
@@ -20,7 +24,7 @@ namespace ORCore
         create_particles(dt);
     }
 
-    std::vector<Particle>& PointEmitter::get_particles()
+    ParticleStore& PointEmitter::get_particles()
     {
         return m_particles;
     }
@@ -36,34 +40,33 @@ namespace ORCore
         m_velocity = vel;
     }
 
-    void PointEmitter::create_particles(double dt)
+    void PointEmitter::set_seed(unsigned int seed)
     {
-        int count = m_creationRate*dt;
-        for (int i = 0; i < count; i++)
-        {
-            m_particles.push_back({1.0f, 7.0, glm::vec2{m_dispersion(m_rng), m_dispersion(m_rng)} + m_velocity, m_currPos});
-        }
+        m_rng.seed(seed);
     }
 
-    void PointEmitter::collect_particles()
+    void PointEmitter::set_overflow(ParticleOverflow overflow)
     {
+        // A frame's spawns go in before that frame's dead particles are removed.
+        size_t capacity = std::ceil(m_creationRate * (m_lifetime + spawnHeadroom));
+        m_particles.set_capacity(capacity, overflow);
+    }
 
-        auto test = [](auto& x)
+    void PointEmitter::create_particles(double dt)
+    {
+        size_t count = m_particles.make_room(static_cast<size_t>(m_creationRate*dt));
+        for (size_t i = 0; i < count; i++)
         {
-            return x.lifetime <= 0.0;
-        };
-
-        auto remove = std::remove_if(m_particles.begin(), m_particles.end(), test);
-
-
-        m_particles.erase(remove, m_particles.end());
+            m_particles.add({m_lifetime, m_lifetime, glm::vec2{m_dispersion(m_rng), m_dispersion(m_rng)} + m_velocity, m_currPos});
+        }
     }
 
 
     // Particle Manager
 
     ParticleManager::ParticleManager(Renderer* renderer)
-    :m_renderer(renderer)
+    :m_renderer(renderer), m_layer(0), m_pointSize(18.0f), m_batchID(-1),
+    m_kernel(best_particle_kernel()), m_gravity(9.81f), m_pool(std::make_unique<WorkerPool>())
     {
     }
 
@@ -72,16 +75,60 @@ namespace ORCore
         m_program = program;
     }
 
-    void ParticleManager::init_gl()
+    void ParticleManager::set_layer(int layer)
     {
-        ORCore::RenderObject obj;
-        obj.set_program(m_program);
-        obj.set_scale(glm::vec3{1.0f, 1.0f, 0.0f});
-        obj.set_translation(glm::vec3{0.0f, 0.0f, 0.0f});
-        obj.set_primitive_type(ORCore::Primitive::point);
-        obj.set_point_size(18);
+        m_layer = layer;
+    }
+
+    void ParticleManager::set_point_size(float size)
+    {
+        m_pointSize = size;
+    }
 
-        m_objID = m_renderer->add_object_dedibatch(obj);
+    void ParticleManager::set_kernel(ParticleKernel kernel)
+    {
+        m_kernel = particle_kernel_supported(kernel) ? kernel : ParticleKernel::Scalar;
+    }
+
+    void ParticleManager::set_threads(int threads)
+    {
+        m_pool = std::make_unique<WorkerPool>(threads);
+    }
+
+    // Colour and alpha go in the first row, the point size scale in the second.
+    static Image make_particle_gradient()
+    {
+        const int width = 64;
+        Image img;
+        img.path = "particle gradient";
+        img.width = width;
+        img.height = 2;
+        img.length = width * img.height * 4;
+        img.pixelData = allocate_pixels(img.length);
+
+        for (int x = 0; x < width; x++)
+        {
+            float age = x / static_cast<float>(width - 1);
+            glm::vec4 color = glm::mix(glm::vec4{1.0f, 0.6f, 0.1f, 1.0f}, glm::vec4{0.6f, 0.0f, 0.0f, 0.0f}, age);
+            float size = glm::mix(1.0f, 0.4f, age);
+
+            unsigned char *colorTexel = &img.pixelData[x * 4];
+            unsigned char *sizeTexel = &img.pixelData[(width + x) * 4];
+            for (int c = 0; c < 4; c++)
+            {
+                colorTexel[c] = static_cast<unsigned char>(color[c] * 255.0f + 0.5f);
+            }
+            sizeTexel[0] = sizeTexel[1] = sizeTexel[2] = static_cast<unsigned char>(size * 255.0f + 0.5f);
+            sizeTexel[3] = 255;
+        }
+        return img;
+    }
+
+    void ParticleManager::init_gl()
+    {
+        int gradient = m_renderer->add_texture(make_particle_gradient());
+        m_batchID = m_renderer->add_particle_batch(m_program, gradient, m_layer, 8192);
+        m_renderer->get_particle_batch(m_batchID)->set_point_size(m_pointSize);
     }
 
 
@@ -91,43 +138,189 @@ namespace ORCore
     }
 
 
-    void ParticleManager::simulate_particles(double dt)
+    template <typename Start, typename Move>
+    size_t ParticleManager::close_gaps(const Chunk *chunks, size_t count, Start start, Move move)
     {
-        for (auto *emitter : m_emitters)
+        size_t total = 0;
+        for (size_t c = 0; c < count; c++)
         {
-            emitter->update(dt);
+            total += chunks[c].alive;
+        }
 
-            for(auto &particle : emitter->get_particles())
+        // Gaps are filled from the front and live particles taken from the back, there
+        // are as many gaps below the total as live particles past it.
+        size_t front = 0;
+        size_t back = count;
+        size_t to = 0;
+        size_t toEnd = 0;
+        size_t from = 0; // One past the next particle to move.
+        size_t fromFirst = 0;
+        while (true)
+        {
+            while (to == toEnd && front < count)
             {
-                particle.lifetime -= dt;
-                particle.velocity += (glm::vec2(0.0, particle.mass * 9.81f) / particle.mass) * (float)dt;
-                particle.position += particle.velocity * (float)dt; // TODO - fix c-style casts < ^
+                const Chunk &chunk = chunks[front++];
+                to = start(chunk) + chunk.alive;
+                toEnd = start(chunk) + chunk.last - chunk.first;
             }
-
-            emitter->collect_particles();
+            if (to == toEnd || to >= total) {
+                break;
+            }
+            while (from == fromFirst && back > 0)
+            {
+                const Chunk &chunk = chunks[--back];
+                fromFirst = start(chunk);
+                from = fromFirst + chunk.alive;
+            }
+            if (from <= total) {
+                break;
+            }
+            move(--from, to++);
         }
+        return total;
     }
 
-    void ParticleManager::render_update()
+    void ParticleManager::simulate_particles(double dt)
     {
-        std::vector<Vertex> points;
+        PROFILE_ZONE("ParticleManager::simulate_particles");
+        float step = static_cast<float>(dt);
 
-        for (auto *emitter : m_emitters)
+        // Spawning stays on this thread so random numbers come out in the same order.
+        // Chunks only depend on particle counts, never on the thread count, and every
+        // particle is handled the same whichever chunk it lands in.
+        m_chunks.clear();
+        size_t vertexCount = 0;
+        for (size_t e = 0; e < m_emitters.size(); e++)
         {
-            points.clear();
+            m_emitters[e]->update(dt);
+            size_t count = m_emitters[e]->get_particles().get_count();
+            for (size_t first = 0; first < count; first += chunkSize)
+            {
+                m_chunks.push_back({e, first, std::min(first + chunkSize, count), 0, vertexCount});
+            }
+            vertexCount += count;
+        }
+
+        // Only position and age go to the gpu, everything else is derived from age in the shader.
+        auto &points = m_renderer->get_particle_batch(m_batchID)->edit_particles();
+        points.resize(vertexCount);
+
+        // Dead particles are swapped with the chunk's last live one as they're found, so
+        // each chunk ends up with its survivors at the front and vertices written for them.
+        m_pool->run(m_chunks.size(), [&](int index) {
+            auto &chunk = m_chunks[index];
+            auto &particles = m_emitters[chunk.emitter]->get_particles();
+            integrate_particles(m_kernel, particles, step, m_gravity, chunk.first, chunk.last);
 
-            std::vector<Particle> &particles = emitter->get_particles();
-            points.reserve(particles.size());
+            const float *x = particles.get_x();
+            const float *y = particles.get_y();
+            const float *lifetime = particles.get_lifetime();
+            const float *maxLifetime = particles.get_max_lifetime();
+            ParticleVertex *vertex = points.data() + chunk.vertexOffset;
 
-            for(auto &particle : particles)
+            size_t last = chunk.last;
+            for (size_t i = chunk.first; i < last;)
             {
-                points.push_back(Vertex{{particle.position.x, particle.position.y, 0.5f}, {0.0f, 0.0f}, glm::vec4{1.0f,0.0f,0.0f,0.0f}});
+                if (lifetime[i] <= 0.0f) {
+                    particles.copy_particle(--last, i);
+                    continue;
+                }
+                float age = 1.0f - lifetime[i] / maxLifetime[i];
+                vertex[i] = ParticleVertex{glm::vec2{x[i], y[i]}, glm::clamp(age, 0.0f, 1.0f)};
+                i++;
             }
+            chunk.alive = last - chunk.first;
+        });
+
+        // Chunks of the same emitter are next to each other, the stores are closed up one
+        // emitter at a time and the vertices all at once.
+        for (size_t first = 0, last = 0; first < m_chunks.size(); first = last)
+        {
+            size_t emitter = m_chunks[first].emitter;
+            while (last < m_chunks.size() && m_chunks[last].emitter == emitter)
+            {
+                last++;
+            }
+            auto &particles = m_emitters[emitter]->get_particles();
+            size_t alive = close_gaps(&m_chunks[first], last - first,
+                [](const Chunk &chunk) { return chunk.first; },
+                [&](size_t from, size_t to) { particles.copy_particle(from, to); });
+            particles.resize(alive);
         }
-        RenderObject *robj = m_renderer->get_object(m_objID);
-        m_renderer->clear_object_batch(robj->id);
-        robj->set_geometry(std::move(points));
+        size_t alive = close_gaps(m_chunks.data(), m_chunks.size(),
+            [](const Chunk &chunk) { return chunk.vertexOffset + chunk.first; },
+            [&](size_t from, size_t to) { points[to] = points[from]; });
+        points.resize(alive);
+    }
+
+    // Gpu Particle Manager
+
+    GpuParticleManager::GpuParticleManager(Renderer* renderer)
+    :m_renderer(renderer), m_program(-1), m_layer(0), m_pointSize(18.0f), m_rate(6000.0f), m_lifetime(7.0f), m_batchID(-1)
+    {
+    }
+
+    void GpuParticleManager::set_program(int program)
+    {
+        m_program = program;
+    }
+
+    void GpuParticleManager::set_layer(int layer)
+    {
+        m_layer = layer;
+    }
+
+    void GpuParticleManager::set_point_size(float size)
+    {
+        m_pointSize = size;
+    }
 
-        m_renderer->readd_object(robj->id);
+    void GpuParticleManager::set_spawn(float rate, float lifetime)
+    {
+        m_rate = rate;
+        m_lifetime = lifetime;
+    }
+
+    void GpuParticleManager::init_gl()
+    {
+        ShaderInfo updateVertInfo {GL_VERTEX_SHADER, "./data/shaders/particleupdate.vs"};
+        ShaderInfo updateFragInfo {GL_FRAGMENT_SHADER, "./data/shaders/particleupdate.fs"};
+        int updateProgram = m_renderer->add_feedback_program(updateVertInfo, updateFragInfo,
+            {"outPosition", "outVelocity", "outAge", "outAgeRate"});
+
+        // Headroom so a slot only comes round again after its particle has died, whatever the frame times.
+        int capacity = static_cast<int>(std::ceil(m_rate * (m_lifetime + PointEmitter::spawnHeadroom)));
+        int gradient = m_renderer->add_texture(make_particle_gradient());
+        m_batchID = m_renderer->add_gpu_particle_batch(updateProgram, m_program, gradient, m_layer, capacity);
+
+        // The same spawning as PointEmitter.
+        auto batch = m_renderer->get_gpu_particle_batch(m_batchID);
+        batch->set_point_size(m_pointSize);
+        batch->set_spawn(m_rate, m_lifetime, 5.0f);
+    }
+
+    void GpuParticleManager::set_emitter(glm::vec2 position, glm::vec2 velocity)
+    {
+        m_renderer->get_gpu_particle_batch(m_batchID)->set_emitter(position, velocity);
+    }
+
+    void GpuParticleManager::simulate_particles(double dt)
+    {
+        m_renderer->get_gpu_particle_batch(m_batchID)->advance(static_cast<float>(dt));
+    }
+
+    int GpuParticleManager::get_capacity()
+    {
+        return m_renderer->get_gpu_particle_batch(m_batchID)->get_capacity();
+    }
+
+    void GpuParticleManager::request_alive_count()
+    {
+        m_renderer->get_gpu_particle_batch(m_batchID)->request_alive_count();
+    }
+
+    int GpuParticleManager::count_alive(bool wait)
+    {
+        return m_renderer->get_gpu_particle_batch(m_batchID)->count_alive(wait);
     }
 }
\ No newline at end of file
@@ -6,29 +6,21 @@
 #include <iostream>
 
 #include "renderer/renderer.hpp"
+#include "particlestore.hpp"
+#include "workerpool.hpp"
 
 namespace ORCore
 {
-    struct Particle
-    {
-        float mass;
-        double lifetime;
-        glm::vec2 velocity;
-        glm::vec2 position;
-    };
-
     // Emitter interface
     class Emitter
     {
     public:
 
-        // Runs internal particle update logic such as spawning and deleting of particles.
+        // Runs internal particle update logic such as spawning. Moving particles and
+        // removing dead ones is left to the ParticleManager.
         virtual void update(double dt) = 0;
 
-        // Returns the pointer to the first particle
-        virtual std::vector<Particle>& get_particles() = 0;
-
-        virtual void collect_particles() = 0;
+        virtual ParticleStore& get_particles() = 0;
     };
 
 
@@ -38,28 +30,33 @@ namespace ORCore
         PointEmitter();
 
         virtual void update(double dt);
-        virtual std::vector<Particle>& get_particles();
-
-        virtual void collect_particles();
+        virtual ParticleStore& get_particles();
 
         void set_location(int x, int y);
         void set_velocity(glm::vec2 vel);
+        void set_seed(unsigned int seed);
+        // The store holds rate x lifetime particles, this picks what happens past that.
+        // Defaults to dropping the oldest.
+        void set_overflow(ParticleOverflow overflow);
         void create_particles(double dt);
 
-    private:
+        // Seconds of extra spawns the capacity allows for, covers frames up to this long.
+        static constexpr float spawnHeadroom = 0.1f;
 
+    private:
         std::mt19937 m_rng;
         std::uniform_real_distribution<float> m_dispersion;
 
         int m_posX;
         int m_posY;
         int m_creationRate;
+        float m_lifetime;
 
         glm::vec2 m_currPos;
         glm::vec2 m_lastPos;
 
         glm::vec2 m_velocity;
-        std::vector<Particle> m_particles;
+        ParticleStore m_particles;
     };
 
     class ParticleManager
@@ -68,13 +65,78 @@ namespace ORCore
         ParticleManager(Renderer* renderer);
         void init_gl();
         void set_program(int program);
+        void set_layer(int layer);
+        void set_point_size(float size);
+        // Defaults to best_particle_kernel().
+        void set_kernel(ParticleKernel kernel);
+        ParticleKernel get_kernel() { return m_kernel; }
+        // Threads particles are simulated on, including the calling one. 0 picks a count
+        // from the number of cores. The results are the same for any count.
+        void set_threads(int threads);
+        int get_threads() { return m_pool->get_thread_count(); }
         void register_emitter(Emitter* emitter);
+
+        // Spawns, moves and removes dead particles, then fills the particle batch with
+        // what's left. Emitters are split into chunks that run across the worker pool,
+        // nothing is allocated once the stores and the batch are big enough.
         void simulate_particles(double dt);
-        void render_update();
     private:
+        // A run of one emitter's particles, handled by one thread at a time.
+        struct Chunk
+        {
+            size_t emitter;
+            size_t first;
+            size_t last;
+            size_t alive; // Live particles left at the start of the chunk after integrating.
+            size_t vertexOffset; // Where the emitter's vertices start in the batch.
+        };
+
+        // Moves live particles from past the total alive into the dead slots chunks
+        // left before it, start gives where a chunk sits. Returns the total alive.
+        template <typename Start, typename Move>
+        static size_t close_gaps(const Chunk *chunks, size_t count, Start start, Move move);
+
+        static const size_t chunkSize = 8192;
+
         Renderer *m_renderer;
         int m_program;
-        int m_objID;
+        int m_layer;
+        float m_pointSize;
+        int m_batchID;
+        ParticleKernel m_kernel;
+        float m_gravity;
         std::vector<Emitter*> m_emitters;
+        std::unique_ptr<WorkerPool> m_pool;
+        std::vector<Chunk> m_chunks;
+    };
+
+    // The gpu alternative to ParticleManager with a single point emitter, particles never
+    // leave the gpu and only the emitter's parameters are sent each frame. See GpuParticleBatch.
+    class GpuParticleManager
+    {
+    public:
+        GpuParticleManager(Renderer* renderer);
+        void set_program(int program); // Draws the particles, the same program ParticleManager takes.
+        void set_layer(int layer);
+        void set_point_size(float size);
+        // Capacity comes from rate x lifetime, so this has to be set before init_gl().
+        void set_spawn(float rate, float lifetime);
+        void init_gl();
+
+        void set_emitter(glm::vec2 position, glm::vec2 velocity);
+        void simulate_particles(double dt);
+
+        int get_capacity();
+        // See GpuParticleBatch::request_alive_count().
+        void request_alive_count();
+        int count_alive(bool wait = false);
+    private:
+        Renderer *m_renderer;
+        int m_program;
+        int m_layer;
+        float m_pointSize;
+        float m_rate;
+        float m_lifetime;
+        int m_batchID;
     };
 }
\ No newline at end of file
@@ -0,0 +1,343 @@
+#include "config.hpp"
+#include "particlestore.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   define PARTICLES_SSE
+#   include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#   define PARTICLES_NEON
+#   include <arm_neon.h>
+#endif
+
+#if defined(ENABLE_AVX2) && defined(_MSC_VER)
+#   include <intrin.h>
+#endif
+
+#include "profiler.hpp"
+
+namespace ORCore
+{
+#if defined(ENABLE_AVX2)
+    // In particleavx2.cpp, the only file built with AVX2 code generation.
+    void integrate_particles_avx2(float *x, float *y, float *velocityX, float *velocityY, float *lifetime,
+                                  size_t count, float dt, float fall);
+
+    static bool cpu_has_avx2()
+    {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) {
+            return false;
+        }
+        // The os has to save the ymm registers as well.
+        __cpuid(info, 1);
+        if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6) {
+            return false;
+        }
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+#endif
+
+    bool particle_kernel_supported(ParticleKernel kernel)
+    {
+        switch (kernel)
+        {
+        case ParticleKernel::Scalar:
+            return true;
+#if defined(PARTICLES_SSE)
+        case ParticleKernel::SSE:
+            return true;
+#endif
+#if defined(PARTICLES_NEON)
+        case ParticleKernel::NEON:
+            return true;
+#endif
+#if defined(ENABLE_AVX2)
+        case ParticleKernel::AVX2:
+        {
+            static const bool supported = cpu_has_avx2();
+            return supported;
+        }
+#endif
+        default:
+            return false;
+        }
+    }
+
+    ParticleKernel best_particle_kernel()
+    {
+        for (auto kernel : {ParticleKernel::AVX2, ParticleKernel::SSE, ParticleKernel::NEON})
+        {
+            if (particle_kernel_supported(kernel)) {
+                return kernel;
+            }
+        }
+        return ParticleKernel::Scalar;
+    }
+
+    const char* particle_kernel_name(ParticleKernel kernel)
+    {
+        switch (kernel)
+        {
+        case ParticleKernel::SSE: return "sse";
+        case ParticleKernel::AVX2: return "avx2";
+        case ParticleKernel::NEON: return "neon";
+        default: return "scalar";
+        }
+    }
+
+    // ParticleStore
+
+    ParticleStore::ParticleStore()
+    : m_count(0), m_capacity(0), m_overflow(ParticleOverflow::Grow), m_x(nullptr), m_y(nullptr), m_velocityX(nullptr), m_velocityY(nullptr),
+      m_lifetime(nullptr), m_maxLifetime(nullptr)
+    {
+    }
+
+    void ParticleStore::reserve(size_t count)
+    {
+        if (count <= m_capacity) {
+            return;
+        }
+        size_t capacity = (count + particleStoreBlock - 1) / particleStoreBlock * particleStoreBlock;
+
+        // Zeroed so the padding the kernels run over never holds garbage.
+        const size_t alignFloats = 64 / sizeof(float);
+        std::unique_ptr<float[]> block(new float[capacity * arrayCount + alignFloats]());
+        uintptr_t address = reinterpret_cast<uintptr_t>(block.get());
+        float *base = block.get() + ((64 - address % 64) % 64) / sizeof(float);
+
+        float **arrays[arrayCount] = {&m_x, &m_y, &m_velocityX, &m_velocityY, &m_lifetime, &m_maxLifetime};
+        for (size_t i = 0; i < arrayCount; i++)
+        {
+            float *array = base + i * capacity;
+            if (m_count > 0) {
+                std::copy(*arrays[i], *arrays[i] + m_count, array);
+            }
+            *arrays[i] = array;
+        }
+        m_block = std::move(block);
+        m_capacity = capacity;
+    }
+
+    void ParticleStore::set_capacity(size_t capacity, ParticleOverflow overflow)
+    {
+        reserve(capacity);
+        m_overflow = overflow;
+        if (m_overflow == ParticleOverflow::DropOldest) {
+            m_order.reserve(m_capacity);
+        }
+    }
+
+    void ParticleStore::resize(size_t count)
+    {
+        reserve(count);
+        m_count = count;
+    }
+
+    size_t ParticleStore::make_room(size_t count)
+    {
+        size_t space = m_capacity - m_count;
+        if (count <= space) {
+            return count;
+        }
+        switch (m_overflow)
+        {
+        case ParticleOverflow::DropNewest:
+            return space;
+        case ParticleOverflow::DropOldest:
+            count = std::min(count, m_capacity);
+            remove_oldest(count - space);
+            return count;
+        default:
+            reserve(std::max(m_capacity * 2, m_count + count));
+            return count;
+        }
+    }
+
+    void ParticleStore::remove_oldest(size_t count)
+    {
+        PROFILE_ZONE("ParticleStore::remove_oldest");
+        // Only when the capacity is too small, so a partial sort over the store is fine here.
+        m_order.resize(m_count);
+        for (size_t i = 0; i < m_count; i++)
+        {
+            m_order[i] = i;
+        }
+        auto closer = [this](uint32_t a, uint32_t b) {
+            return m_lifetime[a] < m_lifetime[b] || (m_lifetime[a] == m_lifetime[b] && a < b);
+        };
+        if (count < m_count) {
+            std::nth_element(m_order.begin(), m_order.begin() + count, m_order.end(), closer);
+        }
+
+        // Highest index first, so the particle moved into each hole is never one still to be removed.
+        std::sort(m_order.begin(), m_order.begin() + count, std::greater<uint32_t>());
+        for (size_t i = 0; i < count; i++)
+        {
+            remove(m_order[i]);
+        }
+    }
+
+    void ParticleStore::add(const Particle& particle)
+    {
+        if (m_count == m_capacity) {
+            reserve(std::max<size_t>(m_capacity * 2, 1024));
+        }
+        m_x[m_count] = particle.position.x;
+        m_y[m_count] = particle.position.y;
+        m_velocityX[m_count] = particle.velocity.x;
+        m_velocityY[m_count] = particle.velocity.y;
+        m_lifetime[m_count] = particle.lifetime;
+        m_maxLifetime[m_count] = particle.maxLifetime;
+        m_count++;
+    }
+
+    void ParticleStore::remove(size_t index)
+    {
+        m_count--;
+        if (index != m_count) {
+            copy_particle(m_count, index);
+        }
+    }
+
+    void ParticleStore::copy_particle(size_t from, size_t to)
+    {
+        m_x[to] = m_x[from];
+        m_y[to] = m_y[from];
+        m_velocityX[to] = m_velocityX[from];
+        m_velocityY[to] = m_velocityY[from];
+        m_lifetime[to] = m_lifetime[from];
+        m_maxLifetime[to] = m_maxLifetime[from];
+    }
+
+    // Kernels
+    // All of them do the same operations in the same order and never fuse the multiply
+    // and add, so every kernel gives the same results to the bit. The kernel files are
+    // built with contraction off so the compiler can't fuse them either.
+
+    static void integrate_scalar(float *x, float *y, float *velocityX, float *velocityY, float *lifetime,
+                                 size_t count, float dt, float fall)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            lifetime[i] -= dt;
+            velocityY[i] += fall;
+            x[i] += velocityX[i] * dt;
+            y[i] += velocityY[i] * dt;
+        }
+    }
+
+#if defined(PARTICLES_SSE)
+    static void integrate_sse(float *x, float *y, float *velocityX, float *velocityY, float *lifetime,
+                              size_t count, float dt, float fall)
+    {
+        const __m128 step = _mm_set1_ps(dt);
+        const __m128 fallStep = _mm_set1_ps(fall);
+        for (size_t i = 0; i < count; i += 8)
+        {
+            // Two independent halves so the adds don't wait on each other.
+            __m128 life0 = _mm_load_ps(lifetime + i);
+            __m128 life1 = _mm_load_ps(lifetime + i + 4);
+            __m128 vy0 = _mm_add_ps(_mm_load_ps(velocityY + i), fallStep);
+            __m128 vy1 = _mm_add_ps(_mm_load_ps(velocityY + i + 4), fallStep);
+            __m128 x0 = _mm_add_ps(_mm_load_ps(x + i), _mm_mul_ps(_mm_load_ps(velocityX + i), step));
+            __m128 x1 = _mm_add_ps(_mm_load_ps(x + i + 4), _mm_mul_ps(_mm_load_ps(velocityX + i + 4), step));
+            __m128 y0 = _mm_add_ps(_mm_load_ps(y + i), _mm_mul_ps(vy0, step));
+            __m128 y1 = _mm_add_ps(_mm_load_ps(y + i + 4), _mm_mul_ps(vy1, step));
+            _mm_store_ps(lifetime + i, _mm_sub_ps(life0, step));
+            _mm_store_ps(lifetime + i + 4, _mm_sub_ps(life1, step));
+            _mm_store_ps(velocityY + i, vy0);
+            _mm_store_ps(velocityY + i + 4, vy1);
+            _mm_store_ps(x + i, x0);
+            _mm_store_ps(x + i + 4, x1);
+            _mm_store_ps(y + i, y0);
+            _mm_store_ps(y + i + 4, y1);
+        }
+    }
+#endif
+
+#if defined(PARTICLES_NEON)
+    static void integrate_neon(float *x, float *y, float *velocityX, float *velocityY, float *lifetime,
+                               size_t count, float dt, float fall)
+    {
+        const float32x4_t step = vdupq_n_f32(dt);
+        const float32x4_t fallStep = vdupq_n_f32(fall);
+        for (size_t i = 0; i < count; i += 8)
+        {
+            float32x4_t vy0 = vaddq_f32(vld1q_f32(velocityY + i), fallStep);
+            float32x4_t vy1 = vaddq_f32(vld1q_f32(velocityY + i + 4), fallStep);
+            // vmlaq would fuse on some cores, keep the multiply separate to match the other kernels.
+            float32x4_t x0 = vaddq_f32(vld1q_f32(x + i), vmulq_f32(vld1q_f32(velocityX + i), step));
+            float32x4_t x1 = vaddq_f32(vld1q_f32(x + i + 4), vmulq_f32(vld1q_f32(velocityX + i + 4), step));
+            float32x4_t y0 = vaddq_f32(vld1q_f32(y + i), vmulq_f32(vy0, step));
+            float32x4_t y1 = vaddq_f32(vld1q_f32(y + i + 4), vmulq_f32(vy1, step));
+            vst1q_f32(lifetime + i, vsubq_f32(vld1q_f32(lifetime + i), step));
+            vst1q_f32(lifetime + i + 4, vsubq_f32(vld1q_f32(lifetime + i + 4), step));
+            vst1q_f32(velocityY + i, vy0);
+            vst1q_f32(velocityY + i + 4, vy1);
+            vst1q_f32(x + i, x0);
+            vst1q_f32(x + i + 4, x1);
+            vst1q_f32(y + i, y0);
+            vst1q_f32(y + i + 4, y1);
+        }
+    }
+#endif
+
+    void integrate_particles(ParticleKernel kernel, ParticleStore& store, float dt, float gravity)
+    {
+        integrate_particles(kernel, store, dt, gravity, 0, store.get_padded_count());
+    }
+
+    void integrate_particles(ParticleKernel kernel, ParticleStore& store, float dt, float gravity,
+                             size_t first, size_t last)
+    {
+        PROFILE_ZONE("integrate_particles");
+        const size_t block = ParticleStore::particleStoreBlock;
+        last = std::min((last + block - 1) / block * block, store.get_padded_count());
+        if (first >= last) {
+            return;
+        }
+        size_t count = last - first;
+        float fall = gravity * dt;
+        float *x = store.get_x() + first;
+        float *y = store.get_y() + first;
+        float *velocityX = store.get_velocity_x() + first;
+        float *velocityY = store.get_velocity_y() + first;
+        float *lifetime = store.get_lifetime() + first;
+
+        if (!particle_kernel_supported(kernel)) {
+            kernel = ParticleKernel::Scalar;
+        }
+        switch (kernel)
+        {
+#if defined(ENABLE_AVX2)
+        case ParticleKernel::AVX2:
+            integrate_particles_avx2(x, y, velocityX, velocityY, lifetime, count, dt, fall);
+            break;
+#endif
+#if defined(PARTICLES_SSE)
+        case ParticleKernel::SSE:
+            integrate_sse(x, y, velocityX, velocityY, lifetime, count, dt, fall);
+            break;
+#endif
+#if defined(PARTICLES_NEON)
+        case ParticleKernel::NEON:
+            integrate_neon(x, y, velocityX, velocityY, lifetime, count, dt, fall);
+            break;
+#endif
+        default:
+            integrate_scalar(x, y, velocityX, velocityY, lifetime, count, dt, fall);
+            break;
+        }
+    }
+} // namespace ORCore
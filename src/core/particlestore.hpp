@@ -0,0 +1,102 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace ORCore
+{
+    struct Particle
+    {
+        float lifetime;
+        float maxLifetime; // Lifetime at spawn, used to work out the particle's age.
+        glm::vec2 velocity;
+        glm::vec2 position;
+    };
+
+    // Integration kernels, the widest one the cpu supports is picked at runtime.
+    enum class ParticleKernel
+    {
+        Scalar,
+        SSE, // 8 particles per iteration.
+        AVX2, // 16 particles per iteration, only built with ENABLE_AVX2.
+        NEON, // 8 particles per iteration.
+    };
+
+    // What a full ParticleStore does with new particles, see ParticleStore::make_room().
+    enum class ParticleOverflow
+    {
+        DropNewest, // They aren't spawned.
+        DropOldest, // The particles closest to dying are removed for them.
+        Grow, // The store doubles, the only case that allocates once the capacity is set.
+    };
+
+    bool particle_kernel_supported(ParticleKernel kernel);
+    ParticleKernel best_particle_kernel();
+    const char* particle_kernel_name(ParticleKernel kernel);
+
+    // Particles as a structure of arrays so the integration runs over whole vectors.
+    // Every array starts on a cache line and is padded out to a multiple of
+    // particleStoreBlock, kernels run over the padding rather than handling a tail.
+    // Particles are removed by moving the last one into their place, so order isn't kept.
+    class ParticleStore
+    {
+    public:
+        static const size_t particleStoreBlock = 16;
+
+        ParticleStore();
+
+        void reserve(size_t count);
+        // Allocates room for capacity particles up front and sets what happens past that.
+        void set_capacity(size_t capacity, ParticleOverflow overflow);
+        ParticleOverflow get_overflow() const { return m_overflow; }
+
+        // Grows or shrinks the count, new particles are left for the caller to fill in.
+        void resize(size_t count);
+        // Makes room for count new particles following the overflow policy, returns how
+        // many of them can be added.
+        size_t make_room(size_t count);
+        // Grows when full, make_room() first to keep to the capacity.
+        void add(const Particle& particle);
+        void remove(size_t index);
+        void copy_particle(size_t from, size_t to);
+        void clear() { m_count = 0; }
+
+        size_t get_count() const { return m_count; }
+        size_t get_capacity() const { return m_capacity; }
+        // Count rounded up to a whole block, what the kernels process.
+        size_t get_padded_count() const { return (m_count + particleStoreBlock - 1) / particleStoreBlock * particleStoreBlock; }
+
+        float* get_x() { return m_x; }
+        float* get_y() { return m_y; }
+        float* get_velocity_x() { return m_velocityX; }
+        float* get_velocity_y() { return m_velocityY; }
+        float* get_lifetime() { return m_lifetime; }
+        float* get_max_lifetime() { return m_maxLifetime; }
+
+    private:
+        static const size_t arrayCount = 6;
+
+        void remove_oldest(size_t count);
+
+        size_t m_count;
+        size_t m_capacity;
+        ParticleOverflow m_overflow;
+        std::vector<uint32_t> m_order; // For finding the oldest particles, sized with the capacity.
+        std::unique_ptr<float[]> m_block; // All the arrays, plus room to align them.
+        float *m_x;
+        float *m_y;
+        float *m_velocityX;
+        float *m_velocityY;
+        float *m_lifetime;
+        float *m_maxLifetime;
+    };
+
+    // Counts down lifetimes and moves particles under gravity along y.
+    void integrate_particles(ParticleKernel kernel, ParticleStore& store, float dt, float gravity);
+    // Only particles first to last - 1, first has to be a multiple of particleStoreBlock.
+    // last is rounded up to one, so the padding is processed with the last range.
+    void integrate_particles(ParticleKernel kernel, ParticleStore& store, float dt, float gravity,
+                             size_t first, size_t last);
+} // namespace ORCore
@@ -0,0 +1,225 @@
+#include "config.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <utility>
+
+#include <spdlog/spdlog.h>
+
+#include "renderer/gputimer.hpp"
+
+namespace ORCore
+{
+    ProfileThreadBuffer::ProfileThreadBuffer(int id, size_t capacity)
+    : threadID(id), head(0), events(capacity)
+    {
+    }
+
+    const size_t Profiler::sm_bufferCapacity;
+    std::mutex Profiler::sm_registryMutex;
+    std::vector<std::unique_ptr<ProfileThreadBuffer>> Profiler::sm_buffers;
+    thread_local ProfileThreadBuffer *Profiler::st_buffer = nullptr;
+    ProfileThreadBuffer Profiler::sm_gpuBuffer(-1, Profiler::sm_bufferCapacity);
+    double Profiler::sm_hitchThreshold = 0.0;
+    std::string Profiler::sm_hitchPrefix;
+    int Profiler::sm_lastHitchFrame = -1;
+
+    uint64_t Profiler::now()
+    {
+        using namespace std::chrono;
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    ProfileThreadBuffer& Profiler::thread_buffer()
+    {
+        if (st_buffer == nullptr) {
+            // Only taken once per thread. Buffers are never freed so a trace can
+            // still be exported after the thread that wrote it has exited.
+            std::lock_guard<std::mutex> lock(sm_registryMutex);
+            sm_buffers.push_back(std::make_unique<ProfileThreadBuffer>(sm_buffers.size(), sm_bufferCapacity));
+            st_buffer = sm_buffers.back().get();
+        }
+        return *st_buffer;
+    }
+
+    void Profiler::push(ProfileThreadBuffer& buffer, const ProfileEvent& event)
+    {
+        uint64_t head = buffer.head.load(std::memory_order_relaxed);
+        ProfileSlot &slot = buffer.events[head % buffer.events.size()];
+        slot.sequence.store(head * 2 + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.name.store(event.name, std::memory_order_relaxed);
+        slot.start.store(event.start, std::memory_order_relaxed);
+        slot.end.store(event.end, std::memory_order_relaxed);
+        slot.id.store(event.id, std::memory_order_relaxed);
+        slot.sequence.store(head * 2 + 2, std::memory_order_release);
+        buffer.head.store(head + 1, std::memory_order_release);
+    }
+
+    bool Profiler::read(ProfileThreadBuffer& buffer, uint64_t index, ProfileEvent& event)
+    {
+        ProfileSlot &slot = buffer.events[index % buffer.events.size()];
+        uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence != index * 2 + 2) {
+            return false;
+        }
+        event.name = slot.name.load(std::memory_order_relaxed);
+        event.start = slot.start.load(std::memory_order_relaxed);
+        event.end = slot.end.load(std::memory_order_relaxed);
+        event.id = slot.id.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.sequence.load(std::memory_order_relaxed) == sequence;
+    }
+
+    void Profiler::record(const char *name, uint64_t start, uint64_t end, int id)
+    {
+        push(thread_buffer(), ProfileEvent{name, start, end, id});
+    }
+
+    void Profiler::record_gpu(const GpuTimings& timings)
+    {
+        const double msToNs = 1000000.0;
+        uint64_t frameEnd = timings.cpuStart + static_cast<uint64_t>(timings.frameTime * msToNs);
+        push(sm_gpuBuffer, ProfileEvent{"gpu frame", timings.cpuStart, frameEnd, timings.frame});
+
+        uint64_t cursor = timings.cpuStart;
+        if (timings.commitTime > 0.0) {
+            uint64_t end = cursor + static_cast<uint64_t>(timings.commitTime * msToNs);
+            push(sm_gpuBuffer, ProfileEvent{"gpu commit", cursor, end, -1});
+            cursor = end;
+        }
+        if (timings.feedbackTime > 0.0) {
+            uint64_t end = cursor + static_cast<uint64_t>(timings.feedbackTime * msToNs);
+            push(sm_gpuBuffer, ProfileEvent{"gpu feedback", cursor, end, -1});
+            cursor = end;
+        }
+        for (size_t i = 0; i < timings.batchTimes.size(); i++)
+        {
+            uint64_t end = cursor + static_cast<uint64_t>(timings.batchTimes[i] * msToNs);
+            push(sm_gpuBuffer, ProfileEvent{"gpu batch", cursor, end, timings.batchIDs[i]});
+            cursor = end;
+        }
+        // Particles and composites are interleaved with the blended batches, they're laid out after them.
+        const std::pair<const char*, double> passes[] = {
+            {"gpu particles", timings.particleTime},
+            {"gpu composite", timings.compositeTime},
+            {"gpu sprites", timings.spriteTime},
+        };
+        for (auto &pass : passes)
+        {
+            if (pass.second > 0.0) {
+                uint64_t end = cursor + static_cast<uint64_t>(pass.second * msToNs);
+                push(sm_gpuBuffer, ProfileEvent{pass.first, cursor, end, -1});
+                cursor = end;
+            }
+        }
+    }
+
+    void Profiler::write_events(std::ofstream& out, ProfileThreadBuffer& buffer, int tid, uint64_t base, bool& first)
+    {
+        uint64_t head = buffer.head.load(std::memory_order_acquire);
+        uint64_t count = std::min<uint64_t>(head, buffer.events.size());
+
+        // The owning thread may still be writing and wrap round onto the oldest events,
+        // those are skipped rather than locking on the hot path.
+        for (uint64_t i = head - count; i < head; i++)
+        {
+            ProfileEvent event;
+            if (!read(buffer, i, event) || event.start < base) {
+                continue;
+            }
+            out << (first ? "" : ",\n");
+            first = false;
+            out << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << tid
+                << ",\"ts\":" << (event.start - base) / 1000.0
+                << ",\"dur\":" << (event.end - event.start) / 1000.0;
+            if (event.id != -1) {
+                out << ",\"args\":{\"id\":" << event.id << "}";
+            }
+            out << "}";
+        }
+    }
+
+    bool Profiler::export_chrome_trace(std::string filename)
+    {
+        std::ofstream out(filename);
+        if (!out) {
+            return false;
+        }
+
+        std::vector<ProfileThreadBuffer*> buffers;
+        {
+            std::lock_guard<std::mutex> lock(sm_registryMutex);
+            for (auto &buffer : sm_buffers)
+            {
+                buffers.push_back(buffer.get());
+            }
+        }
+
+        // Timestamps are written relative to the oldest event so the numbers stay readable.
+        uint64_t base = UINT64_MAX;
+        buffers.push_back(&sm_gpuBuffer);
+        for (auto *buffer : buffers)
+        {
+            uint64_t head = buffer->head.load(std::memory_order_acquire);
+            uint64_t count = std::min<uint64_t>(head, buffer->events.size());
+            ProfileEvent event;
+            for (uint64_t i = head - count; i < head; i++)
+            {
+                if (read(*buffer, i, event)) {
+                    base = std::min(base, event.start);
+                    break;
+                }
+            }
+        }
+        if (base == UINT64_MAX) {
+            base = 0;
+        }
+
+        bool first = true;
+        out << "{\"traceEvents\":[\n";
+        for (auto *buffer : buffers)
+        {
+            int tid = buffer == &sm_gpuBuffer ? 1000 : buffer->threadID;
+
+            out << (first ? "" : ",\n");
+            first = false;
+            out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << tid
+                << ",\"args\":{\"name\":\"" << (buffer == &sm_gpuBuffer ? std::string("GPU") : "Thread " + std::to_string(tid)) << "\"}}";
+
+            write_events(out, *buffer, tid, base, first);
+        }
+        out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+        return static_cast<bool>(out);
+    }
+
+    void Profiler::set_hitch_trigger(double thresholdMs, std::string prefix)
+    {
+        sm_hitchThreshold = thresholdMs;
+        sm_hitchPrefix = prefix;
+    }
+
+    void Profiler::end_frame(int frame, double frameTime)
+    {
+        // Don't dump a trace for every frame of a long stall, the ring already covers the previous ones.
+        const int hitchCooldown = 120;
+
+        if (sm_hitchThreshold <= 0.0 || frameTime < sm_hitchThreshold) {
+            return;
+        }
+        if (sm_lastHitchFrame != -1 && frame - sm_lastHitchFrame < hitchCooldown) {
+            return;
+        }
+        sm_lastHitchFrame = frame;
+
+        std::string filename = sm_hitchPrefix + std::to_string(frame) + ".json";
+        auto logger = spdlog::get("default");
+        if (export_chrome_trace(filename)) {
+            logger->info("Frame {} took {:.2f} ms, wrote trace to {}", frame, frameTime, filename);
+        } else {
+            logger->error("Failed to write hitch trace {}", filename);
+        }
+    }
+} // namespace ORCore
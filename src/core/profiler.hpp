@@ -0,0 +1,104 @@
+#pragma once
+#include "config.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ORCore
+{
+    struct GpuTimings;
+
+    struct ProfileEvent
+    {
+        const char *name; // Must be a string literal, only the pointer is stored.
+        uint64_t start; // Nanoseconds
+        uint64_t end;
+        int id; // Shown as an argument in the trace when not -1, used for batch ids.
+    };
+
+    // A ring slot guarded by a seqlock. sequence is odd while the owning thread writes it and
+    // 2 * (index + 1) once event index is complete, so readers can skip torn or reused slots.
+    struct ProfileSlot
+    {
+        std::atomic<uint64_t> sequence;
+        std::atomic<const char*> name;
+        std::atomic<uint64_t> start;
+        std::atomic<uint64_t> end;
+        std::atomic<int> id;
+    };
+
+    // Each thread writes zones into its own ring so recording never takes a lock.
+    // Only the owning thread writes, the exporter reads up to head.
+    struct ProfileThreadBuffer
+    {
+        int threadID;
+        std::atomic<uint64_t> head;
+        std::vector<ProfileSlot> events;
+        ProfileThreadBuffer(int id, size_t capacity);
+    };
+
+    class Profiler
+    {
+    public:
+        static uint64_t now();
+        static void record(const char *name, uint64_t start, uint64_t end, int id = -1);
+
+        // Gpu timings are placed on their own track, lined up with the cpu time the frame started at.
+        // Only the durations are measured so sections are laid out back to back from there.
+        static void record_gpu(const GpuTimings& timings);
+
+        // Writes everything currently in the ring buffers as a chrome://tracing / perfetto json file.
+        static bool export_chrome_trace(std::string filename);
+
+        // Dumps a trace to prefix<frame>.json whenever a frame takes longer than thresholdMs.
+        static void set_hitch_trigger(double thresholdMs, std::string prefix);
+        static void end_frame(int frame, double frameTime);
+
+    private:
+        static ProfileThreadBuffer& thread_buffer();
+        static void push(ProfileThreadBuffer& buffer, const ProfileEvent& event);
+        // False when the slot is being written or already holds a newer event.
+        static bool read(ProfileThreadBuffer& buffer, uint64_t index, ProfileEvent& event);
+        static void write_events(std::ofstream& out, ProfileThreadBuffer& buffer, int tid, uint64_t base, bool& first);
+
+        static const size_t sm_bufferCapacity = 1 << 16;
+        static std::mutex sm_registryMutex;
+        static std::vector<std::unique_ptr<ProfileThreadBuffer>> sm_buffers;
+        static thread_local ProfileThreadBuffer *st_buffer;
+        static ProfileThreadBuffer sm_gpuBuffer;
+        static double sm_hitchThreshold;
+        static std::string sm_hitchPrefix;
+        static int sm_lastHitchFrame;
+    };
+
+    class ProfileZone
+    {
+    public:
+        ProfileZone(const char *name)
+        : m_name(name), m_start(Profiler::now())
+        {
+        }
+
+        ~ProfileZone()
+        {
+            Profiler::record(m_name, m_start, Profiler::now());
+        }
+
+    private:
+        const char *m_name;
+        uint64_t m_start;
+    };
+} // namespace ORCore
+
+#if defined(ENABLE_PROFILER)
+#   define PROFILE_CONCAT_IMPL(a, b) a##b
+#   define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+#   define PROFILE_ZONE(name) ORCore::ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#else
+#   define PROFILE_ZONE(name) ((void)0)
+#endif
@@ -1,11 +1,14 @@
 #include "batch.hpp"
+#include "virtualtexture.hpp"
 #include <iostream>
 #include <algorithm>
 
 namespace ORCore
 {
-    Batch::Batch(ShaderProgram *program, Texture *texture, int batchSize, int id)
-    : m_program(program), m_texture(texture), m_batchSize(batchSize), m_id(id), m_matTexBuffer(GL_RGBA32F), m_matTexIndexBuffer(GL_R32UI)
+    Batch::Batch(ShaderProgram *program, Texture *texture, int batchSize, int id, RendererStats *stats)
+    : m_program(program), m_texture(texture), m_batchSize(batchSize), m_id(id), m_stats(stats), m_matTexBuffer(GL_RGBA32F), m_matTexIndexBuffer(GL_R32UI),
+      m_virtualTexture(nullptr), m_indirectionSampID(-1), m_feedbackProgram(nullptr), m_feedbackMatBufTexID(-1),
+      m_feedbackMatIndexBufTexID(-1)
     {
         m_vertices.reserve(batchSize*6); // 32 object each object has 3 verts of 2 values
         m_matrices.reserve(batchSize);
@@ -16,7 +19,6 @@ namespace ORCore
 
     void Batch::init_gl()
     {
-        glEnable(GL_BLEND);
         m_vertLoc = m_program->vertex_attribute("position");
         m_uvLoc = m_program->vertex_attribute("vertexUV");
         m_colorLoc = m_program->vertex_attribute("color");
@@ -32,14 +34,21 @@ namespace ORCore
         glGenBuffers(1, &m_vbo);
 
         glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-        glEnableVertexAttribArray(m_vertLoc);
-        glEnableVertexAttribArray(m_uvLoc);
-        glEnableVertexAttribArray(m_colorLoc);
 
         // Setup VAO attributes for this batch. Once these are set the vbo can be replaced or allocated and these will still be valid.
-        glVertexAttribPointer( m_vertLoc, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void *>(offsetof(Vertex, vertex)));
-        glVertexAttribPointer( m_uvLoc, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void *>(offsetof(Vertex, uv)));
-        glVertexAttribPointer( m_colorLoc, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void *>(offsetof(Vertex, color)));
+        // Shader variants drop attributes they don't need, so only set up the ones that exist.
+        if (m_vertLoc != -1) {
+            glEnableVertexAttribArray(m_vertLoc);
+            glVertexAttribPointer( m_vertLoc, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void *>(offsetof(Vertex, vertex)));
+        }
+        if (m_uvLoc != -1) {
+            glEnableVertexAttribArray(m_uvLoc);
+            glVertexAttribPointer( m_uvLoc, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void *>(offsetof(Vertex, uv)));
+        }
+        if (m_colorLoc != -1) {
+            glEnableVertexAttribArray(m_colorLoc);
+            glVertexAttribPointer( m_colorLoc, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), reinterpret_cast<void *>(offsetof(Vertex, color)));
+        }
 
         glBindBuffer(GL_ARRAY_BUFFER, 0);
 
@@ -117,13 +126,21 @@ namespace ORCore
             glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
             glBufferData(GL_ARRAY_BUFFER, m_vertices.size()*sizeof(Vertex), &m_vertices[0], GL_STATIC_DRAW);
 
-            glBindBuffer(GL_TEXTURE_BUFFER, m_matBufferObject);
-            glBufferData(GL_TEXTURE_BUFFER, m_matrices.size()*sizeof(glm::mat4), &m_matrices[0], GL_STATIC_DRAW);
-            m_matTexBuffer.assign_buffer(m_matBufferObject);
+            m_stats->vertexBytes += m_vertices.size()*sizeof(Vertex);
+
+            // Variants without a model transform never read the matrix buffers.
+            if (m_matBufTexID != -1) {
+                glBindBuffer(GL_TEXTURE_BUFFER, m_matBufferObject);
+                glBufferData(GL_TEXTURE_BUFFER, m_matrices.size()*sizeof(glm::mat4), &m_matrices[0], GL_STATIC_DRAW);
+                m_matTexBuffer.assign_buffer(m_matBufferObject);
+
+                glBindBuffer(GL_TEXTURE_BUFFER, m_matIndexBufferObject);
+                glBufferData(GL_TEXTURE_BUFFER, m_meshMatrixIndex.size()*sizeof(unsigned int), &m_meshMatrixIndex[0], GL_STATIC_DRAW);
+                m_matTexIndexBuffer.assign_buffer(m_matIndexBufferObject);
 
-            glBindBuffer(GL_TEXTURE_BUFFER, m_matIndexBufferObject);
-            glBufferData(GL_TEXTURE_BUFFER, m_meshMatrixIndex.size()*sizeof(unsigned int), &m_meshMatrixIndex[0], GL_STATIC_DRAW);
-            m_matTexIndexBuffer.assign_buffer(m_matIndexBufferObject);
+                m_stats->matrixBytes += m_matrices.size()*sizeof(glm::mat4);
+                m_stats->indexBytes += m_meshMatrixIndex.size()*sizeof(unsigned int);
+            }
 
             glBindBuffer(GL_TEXTURE_BUFFER, 0);
             glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -131,47 +148,96 @@ namespace ORCore
 
     }
 
-    void Batch::render()
+    GLenum Batch::primitive()
+    {
+        auto prim = m_state.find(RenderState::primitive);
+        if (prim == m_state.end() || prim->second == Primitive::point)
+        {
+            return GL_POINTS;
+        } else if (prim->second == Primitive::triangle)
+        {
+            return GL_TRIANGLES;
+        }
+        return GL_LINES;
+    }
+
+    void Batch::set_virtual_texture(VirtualTexture *virtualTexture)
+    {
+        m_virtualTexture = virtualTexture;
+        m_indirectionSampID = m_program->uniform_attribute("indirectionSampler");
+    }
+
+    bool Batch::set_feedback_program(ShaderProgram *program)
+    {
+        // The vao is set up for the batch's own program. The feedback variant's vertex shader
+        // is the same source so drivers give it the same locations, but check rather than assume.
+        if (program->vertex_attribute("position") != m_vertLoc || program->vertex_attribute("vertexUV") != m_uvLoc ||
+            program->vertex_attribute("color") != m_colorLoc) {
+            return false;
+        }
+        m_feedbackProgram = program;
+        m_feedbackMatBufTexID = program->uniform_attribute("matrixBuffer");
+        m_feedbackMatIndexBufTexID = program->uniform_attribute("matrixIndices");
+        return true;
+    }
+
+    void Batch::render_feedback(float lodBias)
+    {
+        if (m_vertices.empty() || m_feedbackProgram == nullptr) {
+            return;
+        }
+        m_feedbackProgram->use();
+        glBindVertexArray(m_vao);
+        if (m_feedbackMatBufTexID != -1) {
+            m_matTexBuffer.bind(m_feedbackMatBufTexID);
+            m_matTexIndexBuffer.bind(m_feedbackMatIndexBufTexID);
+        }
+        m_virtualTexture->set_uniforms(m_feedbackProgram, lodBias);
+        glDrawArrays(primitive(), 0, m_vertices.size());
+        m_stats->drawCalls++;
+    }
+
+    void Batch::render(float resolutionScale)
     {
         if (m_vertices.size() > 0) {
 
             glBindVertexArray(m_vao);
 
             // Bind textures
-            m_texture->bind(m_texSampID);
-            m_matTexBuffer.bind(m_matBufTexID);
-            m_matTexIndexBuffer.bind(m_matIndexBufTexID);
-
-            GLenum gPrim;
-            auto &prim = m_state.find(RenderState::primitive);
-            if (prim == m_state.end())
-            {
-                gPrim = GL_POINTS;
-            } else if (prim->second == Primitive::triangle)
-            {
-                gPrim = GL_TRIANGLES;
-            } else if (prim->second == Primitive::line)
-            {
-                gPrim = GL_LINES;
-            } if (prim->second == Primitive::point)
-            {
-                gPrim = GL_POINTS;
+            if (m_texSampID != -1 && m_texture->bind(m_texSampID)) {
+                m_stats->textureBinds++;
+            }
+            if (m_matBufTexID != -1) {
+                m_matTexBuffer.bind(m_matBufTexID);
+                m_matTexIndexBuffer.bind(m_matIndexBufTexID);
             }
+            if (m_virtualTexture != nullptr) {
+                if (m_virtualTexture->get_indirection_texture()->bind(m_indirectionSampID)) {
+                    m_stats->textureBinds++;
+                }
+                m_virtualTexture->set_uniforms(m_program, 0.0f);
+            }
+
+            GLenum gPrim = primitive();
 
-            auto &pointSize = m_state.find(RenderState::point_size);
+            auto pointSize = m_state.find(RenderState::point_size);
             if (pointSize != m_state.end())
             {
-                glPointSize(pointSize->second);
+                glPointSize(std::max(1.0f, pointSize->second * resolutionScale));
             }
 
             glDrawArrays(gPrim, 0, m_vertices.size());
 
+            m_stats->drawCalls++;
+            m_stats->batchesDrawn++;
+            m_stats->vertices += m_vertices.size();
+
             if (pointSize != m_state.end())
             {
                 glPointSize(1.0f);
             }
-
-
+        } else {
+            m_stats->batchesSkipped++;
         }
 
     }
@@ -179,9 +245,6 @@ namespace ORCore
     Batch::~Batch()
     {
         glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glDisableVertexAttribArray(m_colorLoc);
-        glDisableVertexAttribArray(m_uvLoc);
-        glDisableVertexAttribArray(m_vertLoc);
 
         glDeleteBuffers(1, &m_vbo);
         glDeleteBuffers(1, &m_matBufferObject);
@@ -9,20 +9,32 @@
 #include "shader.hpp"
 #include "texture.hpp"
 #include "mesh.hpp"
+#include "stats.hpp"
 
 namespace ORCore
 {
+    class VirtualTexture;
+
     class Batch
     {
     public:
-        Batch(ShaderProgram *program, Texture *texture, int batchSize, int id);
+        Batch(ShaderProgram *program, Texture *texture, int batchSize, int id, RendererStats *stats);
         void init_gl();
         void clear();
         bool add_mesh(Mesh& mesh, glm::mat4& transform);
         void update_mesh(Mesh& mesh, glm::mat4& transform);
         void set_state(const std::map<RenderState, int>& state);
         void commit();
-        void render();
+        // Point sizes are scaled by resolutionScale when drawing into a reduced resolution target.
+        void render(float resolutionScale = 1.0f);
+
+        // Batches drawing a virtual texture bind its indirection as well. The feedback program
+        // is the VIRTUAL_FEEDBACK variant of the batch's program, render_feedback() draws with it
+        // into the bound feedback target. Returns false when it can't share the batch's vertex layout.
+        void set_virtual_texture(VirtualTexture *virtualTexture);
+        bool set_feedback_program(ShaderProgram *program);
+        bool has_feedback() { return m_feedbackProgram != nullptr; }
+        void render_feedback(float lodBias);
         ~Batch();
 
         const std::map<RenderState, int>& get_state()
@@ -46,18 +58,28 @@ namespace ORCore
         }
 
     private:
+        GLenum primitive();
+
         ShaderProgram *m_program;
         Texture *m_texture;
         int m_batchSize;
         int m_id;
+        RendererStats *m_stats;
         BufferTexture m_matTexBuffer;
         BufferTexture m_matTexIndexBuffer;
-        GLuint m_vertLoc;
-        GLuint m_uvLoc;
-        GLuint m_colorLoc;
-        GLuint m_texSampID;
-        GLuint m_matBufTexID;
-        GLuint m_matIndexBufTexID;
+        // These are -1 when the shader variant doesn't use them.
+        GLint m_vertLoc;
+        GLint m_uvLoc;
+        GLint m_colorLoc;
+        GLint m_texSampID;
+        GLint m_matBufTexID;
+        GLint m_matIndexBufTexID;
+
+        VirtualTexture *m_virtualTexture;
+        GLint m_indirectionSampID;
+        ShaderProgram *m_feedbackProgram;
+        GLint m_feedbackMatBufTexID;
+        GLint m_feedbackMatIndexBufTexID;
 
         GLuint m_vao;
         GLuint m_vbo;
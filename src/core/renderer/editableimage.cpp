@@ -0,0 +1,197 @@
+#include "config.hpp"
+#include "editableimage.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+
+namespace ORCore
+{
+    EditableImage::EditableImage(Image&& img)
+    : m_components(img.components), m_dirty(false)
+    {
+        Level base {img.width, img.height, {}};
+        base.pixels.assign(img.pixelData.get(), img.pixelData.get() + img.length);
+        m_levels.push_back(std::move(base));
+
+        while (m_levels.back().width > 1 || m_levels.back().height > 1)
+        {
+            Level level;
+            level.width = std::max(1, m_levels.back().width / 2);
+            level.height = std::max(1, m_levels.back().height / 2);
+            level.pixels.resize(static_cast<size_t>(level.width) * level.height * m_components);
+            m_levels.push_back(std::move(level));
+        }
+
+        m_tilesX = (img.width + tileSize - 1) / tileSize;
+        m_tilesY = (img.height + tileSize - 1) / tileSize;
+        m_dirtyTiles.assign(static_cast<size_t>(m_tilesX) * m_tilesY, 0);
+    }
+
+    void EditableImage::mark_dirty(int x, int y, int width, int height)
+    {
+        int x0 = std::max(0, x);
+        int y0 = std::max(0, y);
+        int x1 = std::min(get_width(), x + width);
+        int y1 = std::min(get_height(), y + height);
+        if (x0 >= x1 || y0 >= y1) {
+            return;
+        }
+
+        for (int ty = y0 / tileSize; ty <= (y1 - 1) / tileSize; ty++)
+        {
+            for (int tx = x0 / tileSize; tx <= (x1 - 1) / tileSize; tx++)
+            {
+                m_dirtyTiles[ty * m_tilesX + tx] = 1;
+            }
+        }
+        m_dirty = true;
+    }
+
+    void EditableImage::stamp_circle(int centerX, int centerY, int radius, const unsigned char *value)
+    {
+        int x0 = std::max(0, centerX - radius);
+        int y0 = std::max(0, centerY - radius);
+        int x1 = std::min(get_width() - 1, centerX + radius);
+        int y1 = std::min(get_height() - 1, centerY + radius);
+
+        auto &base = m_levels[0];
+        for (int y = y0; y <= y1; y++)
+        {
+            int dy = y - centerY;
+            for (int x = x0; x <= x1; x++)
+            {
+                int dx = x - centerX;
+                if (dx * dx + dy * dy <= radius * radius) {
+                    std::memcpy(&base.pixels[(static_cast<size_t>(y) * base.width + x) * m_components], value, m_components);
+                }
+            }
+        }
+        mark_dirty(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+    }
+
+    // 2x2 box filter, each texel only depends on the four above it so regions can be
+    // rebuilt on their own.
+    void EditableImage::downsample(int level, const Rect& rect)
+    {
+        auto &src = m_levels[level - 1];
+        auto &dst = m_levels[level];
+        for (int y = rect.y; y < rect.y + rect.height; y++)
+        {
+            int sy0 = std::min(y * 2, src.height - 1);
+            int sy1 = std::min(y * 2 + 1, src.height - 1);
+            for (int x = rect.x; x < rect.x + rect.width; x++)
+            {
+                int sx0 = std::min(x * 2, src.width - 1);
+                int sx1 = std::min(x * 2 + 1, src.width - 1);
+                const unsigned char *a = &src.pixels[(static_cast<size_t>(sy0) * src.width + sx0) * m_components];
+                const unsigned char *b = &src.pixels[(static_cast<size_t>(sy0) * src.width + sx1) * m_components];
+                const unsigned char *c = &src.pixels[(static_cast<size_t>(sy1) * src.width + sx0) * m_components];
+                const unsigned char *d = &src.pixels[(static_cast<size_t>(sy1) * src.width + sx1) * m_components];
+                unsigned char *out = &dst.pixels[(static_cast<size_t>(y) * dst.width + x) * m_components];
+                for (int i = 0; i < m_components; i++)
+                {
+                    out[i] = static_cast<unsigned char>((a[i] + b[i] + c[i] + d[i] + 2) / 4);
+                }
+            }
+        }
+    }
+
+    size_t EditableImage::upload_rect(Texture& texture, int level, const Rect& rect)
+    {
+        auto &src = m_levels[level];
+        const unsigned char *pixels = &src.pixels[(static_cast<size_t>(rect.y) * src.width + rect.x) * m_components];
+        texture.upload_region(level, rect.x, rect.y, rect.width, rect.height, src.width, pixels);
+        return static_cast<size_t>(rect.width) * rect.height * m_components;
+    }
+
+    size_t EditableImage::upload_all(Texture& texture)
+    {
+        PROFILE_ZONE("EditableImage::upload_all");
+        texture.allocate(get_width(), get_height(), m_components);
+
+        size_t uploaded = 0;
+        for (size_t i = 0; i < m_levels.size(); i++)
+        {
+            auto &level = m_levels[i];
+            if (i > 0) {
+                downsample(i, Rect {0, 0, level.width, level.height});
+            }
+            texture.upload_level(i, level.width, level.height, level.pixels.data());
+            uploaded += level.pixels.size();
+        }
+        texture.finish_upload();
+
+        std::fill(m_dirtyTiles.begin(), m_dirtyTiles.end(), 0);
+        m_dirty = false;
+        return uploaded;
+    }
+
+    size_t EditableImage::upload_dirty(Texture& texture)
+    {
+        if (!m_dirty) {
+            return 0;
+        }
+        PROFILE_ZONE("EditableImage::upload_dirty");
+
+        // Runs of dirty tiles in each row of tiles become one rectangle each.
+        m_rects.clear();
+        for (int ty = 0; ty < m_tilesY; ty++)
+        {
+            int tx = 0;
+            while (tx < m_tilesX)
+            {
+                if (!m_dirtyTiles[ty * m_tilesX + tx]) {
+                    tx++;
+                    continue;
+                }
+                int start = tx;
+                while (tx < m_tilesX && m_dirtyTiles[ty * m_tilesX + tx])
+                {
+                    m_dirtyTiles[ty * m_tilesX + tx] = 0;
+                    tx++;
+                }
+                int x = start * tileSize;
+                int y = ty * tileSize;
+                m_rects.push_back(Rect {x, y, std::min(tx * tileSize, get_width()) - x,
+                                        std::min(y + tileSize, get_height()) - y});
+            }
+        }
+        m_dirty = false;
+
+        size_t uploaded = 0;
+        for (size_t level = 0; level < m_levels.size(); level++)
+        {
+            if (level > 0) {
+                // Every texel that reads from a rect on the level above. Neighbouring
+                // rects end up covering the same texels further down so drop repeats.
+                for (auto &rect : m_rects)
+                {
+                    int x0 = rect.x / 2;
+                    int y0 = rect.y / 2;
+                    int x1 = std::min((rect.x + rect.width + 1) / 2, m_levels[level].width);
+                    int y1 = std::min((rect.y + rect.height + 1) / 2, m_levels[level].height);
+                    rect = Rect {x0, y0, x1 - x0, y1 - y0};
+                }
+                auto order = [](const Rect& a, const Rect& b) {
+                    return std::tie(a.y, a.x, a.width, a.height) < std::tie(b.y, b.x, b.width, b.height);
+                };
+                auto same = [](const Rect& a, const Rect& b) {
+                    return a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height;
+                };
+                std::sort(m_rects.begin(), m_rects.end(), order);
+                m_rects.erase(std::unique(m_rects.begin(), m_rects.end(), same), m_rects.end());
+            }
+
+            for (auto &rect : m_rects)
+            {
+                if (level > 0) {
+                    downsample(level, rect);
+                }
+                uploaded += upload_rect(texture, level, rect);
+            }
+        }
+        return uploaded;
+    }
+} // namespace ORCore
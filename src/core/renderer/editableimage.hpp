@@ -0,0 +1,64 @@
+#pragma once
+#include <vector>
+
+#include "texture.hpp"
+
+namespace ORCore
+{
+    // An image kept on the cpu with its mip chain so it can be changed a few texels at a
+    // time. Changes are tracked in tiles and upload_dirty() only re-sends the dirty tiles
+    // and the parts of each mip level under them.
+    class EditableImage
+    {
+    public:
+        // Tiles are the unit of dirty tracking, a change anywhere in one uploads all of it.
+        static const int tileSize = 64;
+
+        EditableImage(Image&& img);
+
+        int get_width() { return m_levels[0].width; }
+        int get_height() { return m_levels[0].height; }
+        int get_components() { return m_components; }
+
+        // Tightly packed base level, call mark_dirty for anything written through this.
+        unsigned char* get_pixels() { return m_levels[0].pixels.data(); }
+        void mark_dirty(int x, int y, int width, int height);
+        bool is_dirty() { return m_dirty; }
+
+        // Sets every texel within radius of the center to value, which has one byte per component.
+        void stamp_circle(int centerX, int centerY, int radius, const unsigned char *value);
+
+        // Generates the full mip chain and uploads all of it. Returns the bytes uploaded.
+        size_t upload_all(Texture& texture);
+
+        // Rebuilds the mips under dirty tiles and uploads only those regions.
+        size_t upload_dirty(Texture& texture);
+
+    private:
+        struct Level
+        {
+            int width;
+            int height;
+            std::vector<unsigned char> pixels;
+        };
+
+        struct Rect
+        {
+            int x;
+            int y;
+            int width;
+            int height;
+        };
+
+        void downsample(int level, const Rect& rect);
+        size_t upload_rect(Texture& texture, int level, const Rect& rect);
+
+        std::vector<Level> m_levels;
+        int m_components;
+        int m_tilesX;
+        int m_tilesY;
+        std::vector<unsigned char> m_dirtyTiles;
+        bool m_dirty;
+        std::vector<Rect> m_rects; // Reused between uploads.
+    };
+} // namespace ORCore
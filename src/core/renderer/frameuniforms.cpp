@@ -0,0 +1,70 @@
+#include "config.hpp"
+#include "frameuniforms.hpp"
+
+namespace ORCore
+{
+    FrameUniforms::FrameUniforms()
+    : m_data(), m_ubo(0), m_dirty(true)
+    {
+        m_data.ortho = glm::mat4(1.0f);
+    }
+
+    FrameUniforms::~FrameUniforms()
+    {
+        if (m_ubo != 0) {
+            glDeleteBuffers(1, &m_ubo);
+        }
+    }
+
+    void FrameUniforms::init_gl()
+    {
+        glGenBuffers(1, &m_ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, m_ubo);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniformData), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        // Nothing else uses this binding point so it only needs to be bound once.
+        glBindBufferBase(GL_UNIFORM_BUFFER, frameUniformBinding, m_ubo);
+        m_dirty = true;
+    }
+
+    bool FrameUniforms::set_camera(const std::string& name, const glm::mat4& transform)
+    {
+        if (name != "ortho") {
+            return false;
+        }
+        if (m_data.ortho != transform) {
+            m_data.ortho = transform;
+            m_dirty = true;
+        }
+        return true;
+    }
+
+    void FrameUniforms::set_viewport(float x, float y, float width, float height)
+    {
+        glm::vec4 viewport{x, y, width, height};
+        if (m_data.viewport != viewport) {
+            m_data.viewport = viewport;
+            m_dirty = true;
+        }
+    }
+
+    void FrameUniforms::set_time(float time, float deltaTime)
+    {
+        m_data.time = time;
+        m_data.deltaTime = deltaTime;
+        m_dirty = true;
+    }
+
+    size_t FrameUniforms::upload()
+    {
+        if (!m_dirty || m_ubo == 0) {
+            return 0;
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, m_ubo);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniformData), &m_data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        m_dirty = false;
+        return sizeof(FrameUniformData);
+    }
+} // namespace ORCore
@@ -0,0 +1,49 @@
+#pragma once
+#include <string>
+#include <glm/glm.hpp>
+#include <glad/glad.h>
+
+namespace ORCore
+{
+    // Binding point the FrameUniforms block is attached to in every program.
+    const GLuint frameUniformBinding = 0;
+
+    // Per-frame values shared by every program. This has to match the std140
+    // layout of the block in data/shaders/frameuniforms.glsl.
+    struct FrameUniformData
+    {
+        glm::mat4 ortho;
+        glm::vec4 viewport; // x, y, width, height
+        float time;
+        float deltaTime;
+        float padding[2]; // std140 rounds the block up to a vec4.
+    };
+    static_assert(sizeof(FrameUniformData) == 96, "FrameUniformData doesn't match the std140 layout.");
+
+    // Uniform buffer holding FrameUniformData. Values are collected on the cpu and
+    // uploaded at most once per frame, the buffer stays bound at frameUniformBinding
+    // so programs never need their uniforms set per batch.
+    class FrameUniforms
+    {
+    public:
+        FrameUniforms();
+        ~FrameUniforms();
+
+        void init_gl();
+
+        // Returns false if the block has no camera with that name.
+        bool set_camera(const std::string& name, const glm::mat4& transform);
+        void set_viewport(float x, float y, float width, float height);
+        void set_time(float time, float deltaTime);
+
+        const FrameUniformData& get_data() { return m_data; }
+
+        // Uploads the block if anything changed, returns the number of bytes uploaded.
+        size_t upload();
+
+    private:
+        FrameUniformData m_data;
+        GLuint m_ubo;
+        bool m_dirty;
+    };
+} // namespace ORCore
@@ -0,0 +1,37 @@
+#include "config.hpp"
+#include "glinfo.hpp"
+
+#include <unordered_set>
+
+namespace ORCore
+{
+    bool has_gl_extension(const std::string& name)
+    {
+        static std::unordered_set<std::string> extensions;
+        static bool loaded = false;
+
+        if (!loaded) {
+            GLint count = 0;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+            for (GLint i = 0; i < count; i++)
+            {
+                const GLubyte *ext = glGetStringi(GL_EXTENSIONS, i);
+                if (ext != nullptr) {
+                    extensions.insert(reinterpret_cast<const char*>(ext));
+                }
+            }
+            loaded = true;
+        }
+        return extensions.count(name) > 0;
+    }
+
+    void load_gl_extensions(GLADloadproc load)
+    {
+        // The extension's functions have the same names as the core ones.
+        if (!GLAD_GL_VERSION_4_1 && has_gl_extension("GL_ARB_get_program_binary")) {
+            glad_glGetProgramBinary = reinterpret_cast<PFNGLGETPROGRAMBINARYPROC>(load("glGetProgramBinary"));
+            glad_glProgramBinary = reinterpret_cast<PFNGLPROGRAMBINARYPROC>(load("glProgramBinary"));
+            glad_glProgramParameteri = reinterpret_cast<PFNGLPROGRAMPARAMETERIPROC>(load("glProgramParameteri"));
+        }
+    }
+} // namespace ORCore
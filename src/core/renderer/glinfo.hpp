@@ -0,0 +1,19 @@
+#pragma once
+#include <string>
+#include <glad/glad.h>
+
+// Extension tokens our glad loader was generated without.
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+namespace ORCore
+{
+    // Checks the current context's extension list, the list is cached on first use.
+    bool has_gl_extension(const std::string& name);
+
+    // Loads entry points of extensions our glad loader only knows as part of a later core
+    // version, call it after glad with the same proc loader. So far that's
+    // GL_ARB_get_program_binary, which glad only loads with 4.1.
+    void load_gl_extensions(GLADloadproc load);
+} // namespace ORCore
@@ -0,0 +1,235 @@
+#include "config.hpp"
+#include "gpuparticlebatch.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace ORCore
+{
+    GpuParticleBatch::GpuParticleBatch(ShaderProgram *updateProgram, ShaderProgram *program, Texture *gradient,
+                                       int capacity, int id, RendererStats *stats)
+    : m_updateProgram(updateProgram), m_program(program), m_gradient(gradient), m_capacity(std::max(1, capacity)),
+      m_id(id), m_stats(stats), m_buffers{0, 0}, m_updateVaos{0, 0}, m_renderVaos{0, 0}, m_current(0),
+      m_readback(0), m_readbackFence(nullptr), m_readbackUsed(0), m_alive(-1),
+      m_emitterPosition(0.0f), m_emitterVelocity(0.0f), m_rate(0.0f), m_lifetime(1.0f), m_dispersion(0.0f),
+      m_gravity(9.81f), m_pointSize(1.0f), m_depth(0.0f), m_dt(0.0f), m_spawnCarry(0.0), m_spawnFirst(0),
+      m_spawnCount(0), m_spawned(0), m_step(0)
+    {
+        init_gl();
+    }
+
+    void GpuParticleBatch::init_gl()
+    {
+        m_emitterID = m_updateProgram->uniform_attribute("emitter");
+        m_simParamsID = m_updateProgram->uniform_attribute("simParams");
+        m_spawnParamsID = m_updateProgram->uniform_attribute("spawnParams");
+        m_gradientSampID = m_program->uniform_attribute("gradientSampler");
+        m_paramsID = m_program->uniform_attribute("particleParams");
+
+        // Everything starts out dead.
+        std::vector<GpuParticle> initial(m_capacity, GpuParticle{glm::vec2{0.0f}, glm::vec2{0.0f}, 1.0f, 0.0f});
+        glGenBuffers(bufferCount, m_buffers);
+        for (int i = 0; i < bufferCount; i++)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, m_buffers[i]);
+            glBufferData(GL_ARRAY_BUFFER, initial.size() * sizeof(GpuParticle), initial.data(), GL_DYNAMIC_COPY);
+        }
+
+        auto attribute = [](ShaderProgram *program, const char *name, int size, size_t offset) {
+            GLint location = program->vertex_attribute(name);
+            if (location != -1) {
+                glEnableVertexAttribArray(location);
+                glVertexAttribPointer(location, size, GL_FLOAT, GL_FALSE, sizeof(GpuParticle), reinterpret_cast<void *>(offset));
+            }
+        };
+
+        glGenVertexArrays(bufferCount, m_updateVaos);
+        glGenVertexArrays(bufferCount, m_renderVaos);
+        for (int i = 0; i < bufferCount; i++)
+        {
+            glBindVertexArray(m_updateVaos[i]);
+            glBindBuffer(GL_ARRAY_BUFFER, m_buffers[i]);
+            attribute(m_updateProgram, "position", 2, offsetof(GpuParticle, position));
+            attribute(m_updateProgram, "velocity", 2, offsetof(GpuParticle, velocity));
+            attribute(m_updateProgram, "age", 1, offsetof(GpuParticle, age));
+            attribute(m_updateProgram, "ageRate", 1, offsetof(GpuParticle, ageRate));
+
+            // The same layout ParticleBatch draws from, position then age.
+            glBindVertexArray(m_renderVaos[i]);
+            attribute(m_program, "position", 2, offsetof(GpuParticle, position));
+            attribute(m_program, "age", 1, offsetof(GpuParticle, age));
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+    }
+
+    GpuParticleBatch::~GpuParticleBatch()
+    {
+        if (m_readbackFence != nullptr) {
+            glDeleteSync(m_readbackFence);
+        }
+        if (m_readback != 0) {
+            glDeleteBuffers(1, &m_readback);
+        }
+        glDeleteVertexArrays(bufferCount, m_renderVaos);
+        glDeleteVertexArrays(bufferCount, m_updateVaos);
+        glDeleteBuffers(bufferCount, m_buffers);
+    }
+
+    void GpuParticleBatch::set_point_size(float size)
+    {
+        m_pointSize = size;
+    }
+
+    void GpuParticleBatch::set_depth(float depth)
+    {
+        m_depth = depth;
+    }
+
+    void GpuParticleBatch::set_emitter(glm::vec2 position, glm::vec2 velocity)
+    {
+        m_emitterPosition = position;
+        m_emitterVelocity = velocity;
+    }
+
+    void GpuParticleBatch::set_spawn(float rate, float lifetime, float dispersion)
+    {
+        m_rate = rate;
+        m_lifetime = std::max(lifetime, 0.001f);
+        m_dispersion = dispersion;
+    }
+
+    void GpuParticleBatch::set_gravity(float gravity)
+    {
+        m_gravity = gravity;
+    }
+
+    void GpuParticleBatch::advance(float dt)
+    {
+        m_dt += dt;
+        m_spawnCarry += static_cast<double>(m_rate) * dt;
+        int count = static_cast<int>(std::floor(m_spawnCarry));
+        m_spawnCarry -= count;
+
+        // Spawns from several advances go into one run of slots.
+        if (m_spawnCount == 0) {
+            m_spawnFirst = m_spawned % m_capacity;
+        }
+        count = std::min(count, m_capacity - m_spawnCount);
+        m_spawnCount += count;
+        m_spawned += count;
+    }
+
+    void GpuParticleBatch::simulate()
+    {
+        int used = get_used();
+        if (used == 0 || m_dt <= 0.0f) {
+            return;
+        }
+        PROFILE_ZONE("GpuParticleBatch::simulate");
+        int next = (m_current + 1) % bufferCount;
+
+        glEnable(GL_RASTERIZER_DISCARD);
+        m_updateProgram->use();
+        glUniform4f(m_emitterID, m_emitterPosition.x, m_emitterPosition.y, m_emitterVelocity.x, m_emitterVelocity.y);
+        glUniform4f(m_simParamsID, m_dt, m_gravity, 1.0f / m_lifetime, m_dispersion);
+        glUniform4ui(m_spawnParamsID, m_spawnFirst, m_spawnCount, m_capacity, m_step);
+
+        glBindVertexArray(m_updateVaos[m_current]);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, m_buffers[next]);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, used);
+        glEndTransformFeedback();
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+        glBindVertexArray(0);
+        glDisable(GL_RASTERIZER_DISCARD);
+
+        m_stats->programBinds++;
+        m_stats->drawCalls++;
+
+        m_current = next;
+        m_dt = 0.0f;
+        m_spawnCount = 0;
+        m_step++;
+    }
+
+    void GpuParticleBatch::render(float resolutionScale)
+    {
+        int used = get_used();
+        if (used == 0) {
+            m_stats->batchesSkipped++;
+            return;
+        }
+
+        glBindVertexArray(m_renderVaos[m_current]);
+
+        if (m_gradientSampID != -1 && m_gradient->bind(m_gradientSampID)) {
+            m_stats->textureBinds++;
+        }
+        if (m_paramsID != -1) {
+            m_program->set_uniform(m_paramsID, glm::vec4{m_pointSize * resolutionScale, m_depth, 0.0f, 0.0f});
+        }
+
+        // Dead particles are moved outside the clip volume by the vertex shader.
+        glEnable(GL_PROGRAM_POINT_SIZE);
+        glDrawArrays(GL_POINTS, 0, used);
+        glDisable(GL_PROGRAM_POINT_SIZE);
+
+        m_stats->drawCalls++;
+        m_stats->batchesDrawn++;
+        m_stats->vertices += used;
+    }
+
+    void GpuParticleBatch::request_alive_count()
+    {
+        if (m_readbackFence != nullptr) {
+            return;
+        }
+        if (m_readback == 0) {
+            glGenBuffers(1, &m_readback);
+        }
+        m_readbackUsed = get_used();
+        size_t size = m_readbackUsed * sizeof(GpuParticle);
+        glBindBuffer(GL_COPY_READ_BUFFER, m_buffers[m_current]);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_readback);
+        glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_READ);
+        if (size > 0) {
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        m_readbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    int GpuParticleBatch::count_alive(bool wait)
+    {
+        if (m_readbackFence == nullptr) {
+            return m_alive;
+        }
+        GLenum status = glClientWaitSync(m_readbackFence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? GL_TIMEOUT_IGNORED : 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            return m_alive;
+        }
+        glDeleteSync(m_readbackFence);
+        m_readbackFence = nullptr;
+
+        m_alive = 0;
+        if (m_readbackUsed > 0) {
+            glBindBuffer(GL_COPY_READ_BUFFER, m_readback);
+            auto *particles = static_cast<const GpuParticle*>(glMapBufferRange(GL_COPY_READ_BUFFER, 0,
+                m_readbackUsed * sizeof(GpuParticle), GL_MAP_READ_BIT));
+            if (particles != nullptr) {
+                m_alive = std::count_if(particles, particles + m_readbackUsed, [](const GpuParticle& particle) {
+                    return particle.age < 1.0f;
+                });
+                glUnmapBuffer(GL_COPY_READ_BUFFER);
+            }
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        }
+        return m_alive;
+    }
+} // namespace ORCore
@@ -0,0 +1,109 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader.hpp"
+#include "texture.hpp"
+#include "stats.hpp"
+
+namespace ORCore
+{
+    // A particle as the gpu keeps it, 24 bytes. Dead particles have an age of 1 or more.
+    struct GpuParticle
+    {
+        glm::vec2 position;
+        glm::vec2 velocity;
+        float age; // 0 when spawned, 1 when it dies.
+        float ageRate; // 1 / lifetime
+    };
+    static_assert(sizeof(GpuParticle) == 24, "GpuParticle must stay 24 bytes.");
+
+    // Particles simulated and drawn without ever leaving the gpu. Each frame a vertex shader
+    // reads every particle from one buffer and writes it moved on into the other through
+    // transform feedback, with rasterization off. Spawning goes round the buffer as a ring,
+    // the slots spawned into are passed as uniforms so the cpu only sends emitter parameters.
+    // Capacity needs a little headroom over rate x lifetime so the slot reused is always one
+    // whose particle has already died.
+    // Needs nothing past GL 3.3 core, see data/shaders/particleupdate.vs.
+    // Drawn with the same program and gradient as ParticleBatch.
+    class GpuParticleBatch
+    {
+    public:
+        GpuParticleBatch(ShaderProgram *updateProgram, ShaderProgram *program, Texture *gradient,
+                         int capacity, int id, RendererStats *stats);
+        ~GpuParticleBatch();
+
+        void set_point_size(float size);
+        void set_depth(float depth);
+
+        void set_emitter(glm::vec2 position, glm::vec2 velocity);
+        // Particles spawned per second, how long they live and the most their velocity
+        // is randomly offset by on each axis.
+        void set_spawn(float rate, float lifetime, float dispersion);
+        void set_gravity(float gravity);
+
+        // Moves the simulation on by dt, the work happens on the gpu in simulate().
+        void advance(float dt);
+        void simulate();
+        void render(float resolutionScale = 1.0f);
+
+        // Starts copying the particles aside on the gpu, count_alive() counts them once the
+        // copy is done. Ignored while an earlier request hasn't been counted yet.
+        void request_alive_count();
+        // Live particles as of the latest finished request, -1 before there is one. Nothing
+        // waits on the gpu unless wait is set, that's only meant for reports after a run.
+        int count_alive(bool wait = false);
+
+        int get_capacity() { return m_capacity; }
+        int get_id() { return m_id; }
+        ShaderProgram* get_program() { return m_program; }
+
+    private:
+        static const int bufferCount = 2;
+
+        // Only run by the constructor, a second call would leak the vaos and buffers.
+        void init_gl();
+
+        // Particles past the ring's high water mark have never been spawned, they are skipped.
+        int get_used() { return m_spawned < static_cast<uint64_t>(m_capacity) ? static_cast<int>(m_spawned) : m_capacity; }
+
+        ShaderProgram *m_updateProgram;
+        ShaderProgram *m_program;
+        Texture *m_gradient;
+        int m_capacity;
+        int m_id;
+        RendererStats *m_stats;
+
+        GLint m_emitterID;
+        GLint m_simParamsID;
+        GLint m_spawnParamsID;
+        GLint m_gradientSampID;
+        GLint m_paramsID;
+
+        GLuint m_buffers[bufferCount];
+        GLuint m_updateVaos[bufferCount]; // Reads buffer i for the update.
+        GLuint m_renderVaos[bufferCount]; // Reads buffer i for drawing.
+        int m_current; // Buffer holding the latest particles.
+
+        GLuint m_readback; // Copy of the particles for count_alive().
+        GLsync m_readbackFence; // Signalled when the copy is done.
+        int m_readbackUsed; // Particles copied.
+        int m_alive;
+
+        glm::vec2 m_emitterPosition;
+        glm::vec2 m_emitterVelocity;
+        float m_rate;
+        float m_lifetime;
+        float m_dispersion;
+        float m_gravity;
+        float m_pointSize;
+        float m_depth;
+
+        float m_dt; // Waiting for the next simulate().
+        double m_spawnCarry; // Fractions of a particle left over from earlier frames.
+        int m_spawnFirst;
+        int m_spawnCount;
+        uint64_t m_spawned; // In total, for the high water mark.
+        uint32_t m_step;
+    };
+} // namespace ORCore
@@ -0,0 +1,233 @@
+#include "config.hpp"
+#include "gputimer.hpp"
+#include "profiler.hpp"
+
+namespace ORCore
+{
+    GpuTimer::GpuTimer(int latency)
+    : m_ring(latency), m_current(nullptr), m_hasNewResult(false), m_sectionOpen(false),
+      m_supported(false), m_enabled(false), m_frame(0), m_stalls(0)
+    {
+    }
+
+    GpuTimer::~GpuTimer()
+    {
+        if (!m_supported) {
+            return;
+        }
+        for (auto &slot : m_ring)
+        {
+            glDeleteQueries(1, &slot.frameBegin);
+            glDeleteQueries(1, &slot.frameEnd);
+            if (!slot.queries.empty()) {
+                glDeleteQueries(slot.queries.size(), &slot.queries[0]);
+            }
+        }
+    }
+
+    void GpuTimer::init_gl()
+    {
+        // Timer queries are core in 3.3, we only ask for a 3.2 context but most drivers give us more.
+        m_supported = GLAD_GL_VERSION_3_3 && glQueryCounter != nullptr;
+        if (!m_supported) {
+            m_enabled = false;
+            return;
+        }
+
+        for (auto &slot : m_ring)
+        {
+            glGenQueries(1, &slot.frameBegin);
+            glGenQueries(1, &slot.frameEnd);
+        }
+    }
+
+    bool GpuTimer::is_supported()
+    {
+        return m_supported;
+    }
+
+    void GpuTimer::set_enabled(bool enabled)
+    {
+        m_enabled = enabled && m_supported;
+    }
+
+    bool GpuTimer::is_enabled()
+    {
+        return m_enabled;
+    }
+
+    void GpuTimer::begin_frame()
+    {
+        if (!m_enabled) {
+            return;
+        }
+
+        m_current = &m_ring[m_frame % m_ring.size()];
+
+        if (m_current->pending) {
+            GLint available = 0;
+            glGetQueryObjectiv(m_current->frameEnd, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                m_stalls++;
+            }
+            read_results(*m_current);
+        }
+
+        m_current->frame = m_frame;
+        m_current->cpuStart = Profiler::now();
+        m_current->used = 0;
+        m_current->sections.clear();
+        m_current->batchIDs.clear();
+        glQueryCounter(m_current->frameBegin, GL_TIMESTAMP);
+    }
+
+    void GpuTimer::end_frame()
+    {
+        if (!m_enabled || m_current == nullptr) {
+            return;
+        }
+
+        if (m_sectionOpen) {
+            end_section();
+        }
+
+        glQueryCounter(m_current->frameEnd, GL_TIMESTAMP);
+        m_current->pending = true;
+        m_current = nullptr;
+        m_frame++;
+
+        // Read back every slot that has finished, oldest first.
+        for (size_t i = m_ring.size(); i > 0; i--)
+        {
+            FrameQueries &slot = m_ring[(m_frame + m_ring.size() - i) % m_ring.size()];
+            if (!slot.pending) {
+                continue;
+            }
+
+            GLint available = 0;
+            glGetQueryObjectiv(slot.frameEnd, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                break;
+            }
+            read_results(slot);
+        }
+    }
+
+    void GpuTimer::begin_commit()
+    {
+        begin_section(Section::commit, -1);
+    }
+
+    void GpuTimer::end_commit()
+    {
+        end_section();
+    }
+
+    void GpuTimer::begin_batch(int batchID)
+    {
+        begin_section(Section::batch, batchID);
+    }
+
+    void GpuTimer::end_batch()
+    {
+        end_section();
+    }
+
+    void GpuTimer::begin_pass(GpuPass pass)
+    {
+        switch (pass)
+        {
+            case GpuPass::particles: begin_section(Section::particles, -1); break;
+            case GpuPass::sprites: begin_section(Section::sprites, -1); break;
+            case GpuPass::composite: begin_section(Section::composite, -1); break;
+            case GpuPass::feedback: begin_section(Section::feedback, -1); break;
+        }
+    }
+
+    void GpuTimer::end_pass()
+    {
+        end_section();
+    }
+
+    bool GpuTimer::collect(GpuTimings& timings)
+    {
+        if (!m_hasNewResult) {
+            return false;
+        }
+        timings = m_latest;
+        m_hasNewResult = false;
+        return true;
+    }
+
+    int GpuTimer::get_stall_count()
+    {
+        return m_stalls;
+    }
+
+    void GpuTimer::begin_section(Section section, int batchID)
+    {
+        // GL_TIME_ELAPSED queries can't be nested, sections outside of a frame are ignored.
+        if (!m_enabled || m_current == nullptr || m_sectionOpen) {
+            return;
+        }
+
+        if (m_current->used == m_current->queries.size()) {
+            GLuint query;
+            glGenQueries(1, &query);
+            m_current->queries.push_back(query);
+        }
+
+        m_current->sections.push_back(section);
+        m_current->batchIDs.push_back(batchID);
+        glBeginQuery(GL_TIME_ELAPSED, m_current->queries[m_current->used]);
+        m_current->used++;
+        m_sectionOpen = true;
+    }
+
+    void GpuTimer::end_section()
+    {
+        if (!m_sectionOpen) {
+            return;
+        }
+        glEndQuery(GL_TIME_ELAPSED);
+        m_sectionOpen = false;
+    }
+
+    void GpuTimer::read_results(FrameQueries& slot)
+    {
+        const double nsToMs = 0.000001;
+        GLuint64 begin, end, elapsed;
+
+        glGetQueryObjectui64v(slot.frameBegin, GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(slot.frameEnd, GL_QUERY_RESULT, &end);
+
+        GpuTimings timings;
+        timings.frame = slot.frame;
+        timings.cpuStart = slot.cpuStart;
+        timings.frameTime = (end - begin) * nsToMs;
+
+        for (size_t i = 0; i < slot.used; i++)
+        {
+            glGetQueryObjectui64v(slot.queries[i], GL_QUERY_RESULT, &elapsed);
+            switch (slot.sections[i])
+            {
+                case Section::commit: timings.commitTime += elapsed * nsToMs; break;
+                case Section::particles: timings.particleTime += elapsed * nsToMs; break;
+                case Section::sprites: timings.spriteTime += elapsed * nsToMs; break;
+                case Section::composite: timings.compositeTime += elapsed * nsToMs; break;
+                case Section::feedback: timings.feedbackTime += elapsed * nsToMs; break;
+                case Section::batch:
+                    timings.batchIDs.push_back(slot.batchIDs[i]);
+                    timings.batchTimes.push_back(elapsed * nsToMs);
+                    break;
+            }
+        }
+
+        slot.pending = false;
+
+        if (timings.frame > m_latest.frame) {
+            m_latest = std::move(timings);
+            m_hasNewResult = true;
+        }
+    }
+} // namespace ORCore
@@ -0,0 +1,105 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glad/glad.h>
+
+namespace ORCore
+{
+    // Passes of the frame timed as a whole, on top of the per batch times.
+    enum class GpuPass
+    {
+        particles, // Cpu and gpu particle draws.
+        sprites,
+        composite, // Reduced resolution layers drawn back into the frame.
+        feedback, // Virtual texture feedback.
+    };
+
+    // GPU times in milliseconds for a single frame.
+    struct GpuTimings
+    {
+        int frame = -1;
+        uint64_t cpuStart = 0; // Profiler::now() when the frame started.
+        double frameTime = 0.0; // First to last gpu command of the frame.
+        double commitTime = 0.0; // Buffer uploads from Renderer::commit
+        double particleTime = 0.0;
+        double spriteTime = 0.0;
+        double compositeTime = 0.0;
+        double feedbackTime = 0.0;
+        std::vector<int> batchIDs;
+        std::vector<double> batchTimes;
+    };
+
+    // Opt-in timer queries for the frame, buffer uploads, each batch draw and the other passes.
+    // Queries go into a ring of per-frame slots, results are read back once the
+    // gpu is done with them which is usually a few frames later. That way we
+    // never wait on the gpu unless the ring wraps around onto a slot that still
+    // hasn't finished.
+    class GpuTimer
+    {
+    public:
+        GpuTimer(int latency = 4);
+        ~GpuTimer();
+
+        void init_gl();
+        bool is_supported();
+        void set_enabled(bool enabled);
+        bool is_enabled();
+
+        void begin_frame();
+        void end_frame();
+
+        void begin_commit();
+        void end_commit();
+
+        void begin_batch(int batchID);
+        void end_batch();
+
+        // A pass timed more than once in a frame adds up.
+        void begin_pass(GpuPass pass);
+        void end_pass();
+
+        // Fills timings with the newest finished frame, returns false if no new frame has finished.
+        bool collect(GpuTimings& timings);
+
+        // Number of times the ring wrapped onto unfinished queries and had to wait.
+        int get_stall_count();
+
+    private:
+        enum class Section
+        {
+            commit,
+            batch,
+            particles,
+            sprites,
+            composite,
+            feedback,
+        };
+
+        struct FrameQueries
+        {
+            int frame = -1;
+            uint64_t cpuStart = 0;
+            bool pending = false;
+            GLuint frameBegin = 0;
+            GLuint frameEnd = 0;
+            std::vector<GLuint> queries; // Grown as needed and reused between frames.
+            std::vector<Section> sections;
+            std::vector<int> batchIDs;
+            size_t used = 0;
+        };
+
+        void begin_section(Section section, int batchID);
+        void end_section();
+        void read_results(FrameQueries& slot);
+
+        std::vector<FrameQueries> m_ring;
+        FrameQueries *m_current;
+        GpuTimings m_latest;
+        bool m_hasNewResult;
+        bool m_sectionOpen;
+        bool m_supported;
+        bool m_enabled;
+        int m_frame;
+        int m_stalls;
+    };
+} // namespace ORCore
@@ -17,7 +17,31 @@ namespace ORCore
         texture,
         point_size,
         blend_mode,
-        primitive
+        primitive,
+        layer, // Higher layers are drawn in front, see layer_depth()
+        variant // ShaderFeature flags, filled in by the renderer.
+    };
+
+    // Opaque objects are drawn first front to back with depth writes and no blending.
+    // Alpha blended objects are drawn after them back to front.
+    enum BlendMode
+    {
+        blend_opaque,
+        blend_alpha
+    };
+
+    // Features a shader variant is compiled with, each one maps to a define in the shader source.
+    enum ShaderFeature
+    {
+        feature_none = 0,
+        feature_textured = 1 << 0,
+        feature_vertex_color = 1 << 1,
+        feature_model_transform = 1 << 2,
+        feature_alpha_test = 1 << 3,
+        feature_virtual_texture = 1 << 4, // The texture is a VirtualTexture's cache.
+        feature_virtual_feedback = 1 << 5, // Writes tile requests instead of color, fragment shader only.
+        feature_all = feature_textured | feature_vertex_color | feature_model_transform | feature_alpha_test |
+                      feature_virtual_texture | feature_virtual_feedback
     };
     
     enum Primitive
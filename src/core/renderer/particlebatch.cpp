@@ -0,0 +1,101 @@
+#include "config.hpp"
+#include "particlebatch.hpp"
+#include "profiler.hpp"
+
+namespace ORCore
+{
+    ParticleBatch::ParticleBatch(ShaderProgram *program, Texture *gradient, int capacity, int id, RendererStats *stats)
+    : m_program(program), m_gradient(gradient), m_id(id), m_stats(stats), m_pointSize(1.0f), m_depth(0.0f), m_dirty(false)
+    {
+        m_particles.reserve(capacity);
+        init_gl();
+    }
+
+    void ParticleBatch::init_gl()
+    {
+        m_gradientSampID = m_program->uniform_attribute("gradientSampler");
+        m_paramsID = m_program->uniform_attribute("particleParams");
+
+        GLint positionLoc = m_program->vertex_attribute("position");
+        GLint ageLoc = m_program->vertex_attribute("age");
+
+        glGenVertexArrays(1, &m_vao);
+        glBindVertexArray(m_vao);
+
+        glGenBuffers(1, &m_vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+
+        if (positionLoc != -1) {
+            glEnableVertexAttribArray(positionLoc);
+            glVertexAttribPointer(positionLoc, 2, GL_FLOAT, GL_FALSE, sizeof(ParticleVertex), reinterpret_cast<void *>(offsetof(ParticleVertex, position)));
+        }
+        if (ageLoc != -1) {
+            glEnableVertexAttribArray(ageLoc);
+            glVertexAttribPointer(ageLoc, 1, GL_FLOAT, GL_FALSE, sizeof(ParticleVertex), reinterpret_cast<void *>(offsetof(ParticleVertex, age)));
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+    }
+
+    void ParticleBatch::set_point_size(float size)
+    {
+        m_pointSize = size;
+    }
+
+    void ParticleBatch::set_depth(float depth)
+    {
+        m_depth = depth;
+    }
+
+    std::vector<ParticleVertex>& ParticleBatch::edit_particles()
+    {
+        m_dirty = true;
+        return m_particles;
+    }
+
+    void ParticleBatch::commit()
+    {
+        if (m_dirty && !m_particles.empty()) {
+            PROFILE_ZONE("ParticleBatch::commit");
+            glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+            glBufferData(GL_ARRAY_BUFFER, m_particles.size()*sizeof(ParticleVertex), &m_particles[0], GL_STREAM_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+            m_stats->vertexBytes += m_particles.size()*sizeof(ParticleVertex);
+        }
+        m_dirty = false;
+    }
+
+    void ParticleBatch::render(float resolutionScale)
+    {
+        if (m_particles.empty()) {
+            m_stats->batchesSkipped++;
+            return;
+        }
+
+        glBindVertexArray(m_vao);
+
+        if (m_gradientSampID != -1 && m_gradient->bind(m_gradientSampID)) {
+            m_stats->textureBinds++;
+        }
+        if (m_paramsID != -1) {
+            m_program->set_uniform(m_paramsID, glm::vec4{m_pointSize * resolutionScale, m_depth, 0.0f, 0.0f});
+        }
+
+        // The shader fades the point size with age.
+        glEnable(GL_PROGRAM_POINT_SIZE);
+        glDrawArrays(GL_POINTS, 0, m_particles.size());
+        glDisable(GL_PROGRAM_POINT_SIZE);
+
+        m_stats->drawCalls++;
+        m_stats->batchesDrawn++;
+        m_stats->vertices += m_particles.size();
+    }
+
+    ParticleBatch::~ParticleBatch()
+    {
+        glDeleteBuffers(1, &m_vbo);
+        glDeleteVertexArrays(1, &m_vao);
+    }
+} // namespace ORCore
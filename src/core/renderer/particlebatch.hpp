@@ -0,0 +1,67 @@
+#pragma once
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader.hpp"
+#include "texture.hpp"
+#include "stats.hpp"
+
+namespace ORCore
+{
+    // Everything the gpu needs per particle, 12 bytes.
+    struct ParticleVertex
+    {
+        glm::vec2 position;
+        float age; // 0 when spawned, 1 when it dies.
+    };
+    static_assert(sizeof(ParticleVertex) == 12, "ParticleVertex must stay 12 bytes.");
+
+    // Draws particles as points from position and age alone. Colour, alpha and size
+    // are looked up by age from a gradient texture in the vertex shader, see
+    // data/shaders/particle.vs for the layout of the gradient.
+    class ParticleBatch
+    {
+    public:
+        ParticleBatch(ShaderProgram *program, Texture *gradient, int capacity, int id, RendererStats *stats);
+
+        void set_point_size(float size);
+        void set_depth(float depth);
+
+        // Particles can be changed in place, the whole array is uploaded again by the next commit().
+        std::vector<ParticleVertex>& edit_particles();
+
+        void commit();
+        void render(float resolutionScale = 1.0f);
+        ~ParticleBatch();
+
+        int get_id()
+        {
+            return m_id;
+        }
+
+        ShaderProgram* get_program()
+        {
+            return m_program;
+        }
+
+    private:
+        // Only run by the constructor, a second call would leak the vao and buffers.
+        void init_gl();
+
+        ShaderProgram *m_program;
+        Texture *m_gradient;
+        int m_id;
+        RendererStats *m_stats;
+        GLint m_gradientSampID;
+        GLint m_paramsID;
+
+        GLuint m_vao;
+        GLuint m_vbo;
+
+        float m_pointSize;
+        float m_depth;
+        bool m_dirty;
+        std::vector<ParticleVertex> m_particles;
+    };
+} // namespace ORCore
@@ -0,0 +1,158 @@
+#include "config.hpp"
+#include "programcache.hpp"
+
+#include <cstring>
+#include <cstdio>
+
+#include <spdlog/spdlog.h>
+
+#include "vfs.hpp"
+#include "stringutils.hpp"
+#include "profiler.hpp"
+#include "glinfo.hpp"
+
+namespace ORCore
+{
+    // Layout of a cache file, followed by the binary itself.
+    struct ProgramCacheHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t format;
+        uint32_t length;
+    };
+
+    static const char programCacheMagic[4] = {'O', 'R', 'P', 'B'};
+    static const uint32_t programCacheVersion = 1;
+
+    ProgramCache::ProgramCache(std::string directory)
+    : m_directory(directory), m_supported(false), m_hits(0), m_misses(0)
+    {
+    }
+
+    void ProgramCache::init_gl()
+    {
+        // We only ask for 3.2, most 3.x drivers still have the extension. See load_gl_extensions().
+        bool available = GLAD_GL_VERSION_4_1 ||
+                         (has_gl_extension("GL_ARB_get_program_binary") && glGetProgramBinary != nullptr &&
+                          glProgramBinary != nullptr && glProgramParameteri != nullptr);
+        GLint formats = 0;
+        if (available) {
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        }
+
+        // Some drivers expose the extension but report no formats, which means it won't work.
+        m_supported = formats > 0 && sysMakeDirectory(m_directory);
+
+        auto glString = [](GLenum name) {
+            const GLubyte *str = glGetString(name);
+            return str != nullptr ? std::string(reinterpret_cast<const char*>(str)) : std::string();
+        };
+        m_driverInfo = glString(GL_VENDOR) + "\n" + glString(GL_RENDERER) + "\n" + glString(GL_VERSION);
+    }
+
+    bool ProgramCache::is_supported()
+    {
+        return m_supported;
+    }
+
+    uint64_t ProgramCache::make_key(const std::vector<std::string>& sources)
+    {
+        uint64_t key = stringHash(m_driverInfo);
+        for (auto &source : sources)
+        {
+            // Hash the length as well so moving text between stages changes the key.
+            uint64_t size = source.size();
+            key = stringHash(reinterpret_cast<const char*>(&size), sizeof(size), key);
+            key = stringHash(source, key);
+        }
+        return key;
+    }
+
+    std::string ProgramCache::entry_path(uint64_t key)
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+        return m_directory + "/" + name;
+    }
+
+    bool ProgramCache::load(GLuint program, uint64_t key)
+    {
+        if (!m_supported) {
+            return false;
+        }
+        PROFILE_ZONE("ProgramCache::load");
+
+        // read_file logs when a file is missing which would be noise on every cold start.
+        std::string path = entry_path(key);
+        if (std::FILE *file = std::fopen(path.c_str(), "rb")) {
+            std::fclose(file);
+        } else {
+            m_misses++;
+            return false;
+        }
+
+        std::string data = read_file(path, FileMode::Binary);
+
+        ProgramCacheHeader header;
+        if (data.size() < sizeof(header)) {
+            m_misses++;
+            return false;
+        }
+        std::memcpy(&header, data.data(), sizeof(header));
+
+        if (std::memcmp(header.magic, programCacheMagic, sizeof(header.magic)) != 0 ||
+            header.version != programCacheVersion ||
+            header.length != data.size() - sizeof(header)) {
+            m_misses++;
+            return false;
+        }
+
+        glProgramBinary(program, header.format, data.data() + sizeof(header), header.length);
+
+        // The driver is free to reject a binary at any time, the caller falls back to compiling.
+        GLint status = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        if (status != GL_TRUE) {
+            spdlog::get("default")->info("Cached program binary rejected by the driver, recompiling.");
+            m_misses++;
+            return false;
+        }
+
+        m_hits++;
+        return true;
+    }
+
+    void ProgramCache::store(GLuint program, uint64_t key)
+    {
+        if (!m_supported) {
+            return;
+        }
+
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) {
+            return;
+        }
+
+        std::string data;
+        data.resize(sizeof(ProgramCacheHeader) + length);
+
+        ProgramCacheHeader header;
+        std::memcpy(header.magic, programCacheMagic, sizeof(header.magic));
+        header.version = programCacheVersion;
+
+        GLenum format;
+        GLsizei written = 0;
+        glGetProgramBinary(program, length, &written, &format, &data[sizeof(header)]);
+        if (written <= 0) {
+            return;
+        }
+        header.format = format;
+        header.length = written;
+        std::memcpy(&data[0], &header, sizeof(header));
+        data.resize(sizeof(header) + written);
+
+        write_file(entry_path(key), data, FileMode::Binary);
+    }
+} // namespace ORCore
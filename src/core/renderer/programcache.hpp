@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+
+namespace ORCore
+{
+    // On-disk cache of linked program binaries (ARB_get_program_binary).
+    // Entries are keyed by a hash of the final shader sources along with the
+    // driver's vendor, renderer and version strings, so a driver update or a
+    // different gpu just misses the cache rather than loading a bad binary.
+    class ProgramCache
+    {
+    public:
+        ProgramCache(std::string directory);
+
+        void init_gl();
+        bool is_supported();
+
+        uint64_t make_key(const std::vector<std::string>& sources);
+
+        // Returns true if the program was loaded and linked from the cache.
+        bool load(GLuint program, uint64_t key);
+        void store(GLuint program, uint64_t key);
+
+        int get_hits() { return m_hits; }
+        int get_misses() { return m_misses; }
+
+    private:
+        std::string entry_path(uint64_t key);
+
+        std::string m_directory;
+        std::string m_driverInfo;
+        bool m_supported;
+        int m_hits;
+        int m_misses;
+    };
+} // namespace ORCore
@@ -1,6 +1,12 @@
 #include "config.hpp"
 #include "renderer.hpp"
+#include "profiler.hpp"
+#include "glinfo.hpp"
+#include "stringutils.hpp"
+#include "vfs.hpp"
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 
 namespace ORCore
 {
@@ -18,8 +24,81 @@ namespace ORCore
         };
     }
 
+    namespace
+    {
+        // Identifies a shader by its file and defines, for finding programs already requested.
+        std::string shader_key(const ShaderInfo& info)
+        {
+            std::string key = info.path;
+            for (auto &define : info.defines)
+            {
+                key += "#" + define;
+            }
+            return key;
+        }
+    }
+
+    TextureHandle::TextureHandle()
+    : m_renderer(nullptr), m_id(-1)
+    {
+    }
+
+    TextureHandle::TextureHandle(Renderer *renderer, int id)
+    : m_renderer(renderer), m_id(id)
+    {
+    }
+
+    TextureHandle::TextureHandle(const TextureHandle& other)
+    : m_renderer(other.m_renderer), m_id(other.m_id)
+    {
+        if (m_renderer != nullptr) {
+            m_renderer->retain_texture(m_id);
+        }
+    }
+
+    TextureHandle::TextureHandle(TextureHandle&& other)
+    : m_renderer(other.m_renderer), m_id(other.m_id)
+    {
+        other.m_renderer = nullptr;
+        other.m_id = -1;
+    }
+
+    TextureHandle& TextureHandle::operator=(TextureHandle other)
+    {
+        std::swap(m_renderer, other.m_renderer);
+        std::swap(m_id, other.m_id);
+        return *this;
+    }
+
+    TextureHandle::~TextureHandle()
+    {
+        reset();
+    }
+
+    void TextureHandle::reset()
+    {
+        if (m_renderer != nullptr) {
+            m_renderer->release_texture(m_id);
+        }
+        m_renderer = nullptr;
+        m_id = -1;
+    }
+
+    float layer_depth(int layer)
+    {
+        layer = std::max(0, std::min(layer, maxLayers-1));
+        // Bigger z is closer to the camera with glm::ortho(..., -1.0f, 1.0f).
+        return (layer + 0.5f) / maxLayers * 2.0f - 1.0f;
+    }
+
+    static int state_value(const std::map<RenderState, int>& state, RenderState stateItem, int fallback)
+    {
+        auto item = state.find(stateItem);
+        return item == state.end() ? fallback : item->second;
+    }
+
     RenderObject::RenderObject()
-    :batchID(-1)
+    :batchID(-1), worldSpace(false)
     {
 
     }
@@ -85,21 +164,69 @@ namespace ORCore
         }
     }
 
+    void RenderObject::set_world_space(bool enabled)
+    {
+        worldSpace = enabled;
+    }
+
+    void RenderObject::set_layer(int layer)
+    {
+        set_state(RenderState::layer, layer);
+    }
+
+    void RenderObject::set_blend_mode(BlendMode mode)
+    {
+        set_state(RenderState::blend_mode, mode);
+    }
+
+    int RenderObject::get_layer()
+    {
+        return state_value(state, RenderState::layer, 0);
+    }
+
     void RenderObject::update()
     {
-        modelMatrix = glm::scale(glm::translate(glm::mat4(1.0f), mesh.translate), mesh.scale);
+        glm::vec3 translate = mesh.translate;
+        translate.z += layer_depth(get_layer());
+        modelMatrix = glm::scale(glm::translate(glm::mat4(1.0f), translate), mesh.scale);
     }
 
 
     Renderer::Renderer()
-    : m_logger(spdlog::get("default"))
+    : m_logger(spdlog::get("default")), m_passSplit(true), m_mainFramebuffer(0), m_compositeProgram(-1),
+      m_compositeSampler(-1), m_compositeVao(0), m_overdrawDebug(false), m_overdrawQuery(0),
+      m_parallelCompile(false), m_textureResidency(&m_textureStreamer), m_frame(0), m_virtualFeedbackScale(0.25f),
+      m_virtualTileBudget(8), m_textureUploadBudget(4 * 1024 * 1024), m_programCache("shadercache")
     {
 
     }
 
     void Renderer::init_gl()
     {
+        m_gpuTimer.init_gl();
+        m_programCache.init_gl();
+        m_frameUniforms.init_gl();
+        glGenQueries(1, &m_overdrawQuery);
+
+        // The composite triangle is built in the vertex shader but core profile still wants a vao bound.
+        glGenVertexArrays(1, &m_compositeVao);
+        m_compositeProgram = request_program({GL_VERTEX_SHADER, "./data/shaders/composite.vs"},
+                                             {GL_FRAGMENT_SHADER, "./data/shaders/composite.fs"});
+
+        glDepthFunc(GL_LEQUAL); // Objects on the same layer still draw in order.
+
+        m_parallelCompile = has_gl_extension("GL_KHR_parallel_shader_compile") ||
+                            has_gl_extension("GL_ARB_parallel_shader_compile");
+        m_logger->info("Parallel shader compile: {}", m_parallelCompile ? "supported" : "unsupported");
+
         // Add the blank texture by default as it will be the default texture.
+        m_textureStreamer.init_gl();
+        m_textureStreamer.set_content_check([this](Texture *texture, Texture *original, uint64_t hash) {
+            return share_texture(texture, original, hash);
+        });
+        m_virtualFeedback.init_gl();
+
+        // This is what requested textures draw with until they arrive so it can't be streamed itself.
         m_defaultTextureID = add_texture(ORCore::loadSTB("data/blank.png"));
     }
 
@@ -107,15 +234,38 @@ namespace ORCore
     {
         try
         {
+            int programID = resolve_program(batchState.at(RenderState::program), batchState.at(RenderState::variant));
+
+            // Batches look up attribute locations so the program has to be finished by now.
+            finish_programs();
+
+            int textureID = batchState.at(RenderState::texture);
+            m_programResources.retain(programID);
+            retain_texture(textureID);
+
             int id = m_batches.size();
             m_batches.push_back(
                 std::make_unique<Batch>(
-                    m_programs[batchState.at(RenderState::program)].get(),
-                    m_textures[batchState.at(RenderState::texture)].get(),
-                    batchSize, id));
+                    m_programs[programID].get(),
+                    m_textures[textureID].get(),
+                    batchSize, id, &m_stats));
 
             auto& batch = m_batches.back();
             batch->set_state(batchState);
+
+            auto virtualTexture = m_virtualTextures.find(textureID);
+            if (virtualTexture != m_virtualTextures.end()) {
+                batch->set_virtual_texture(virtualTexture->second.get());
+                int feedbackID = resolve_program(batchState.at(RenderState::program),
+                                                 batchState.at(RenderState::variant) | feature_virtual_feedback);
+                finish_programs();
+                if (feedbackID != programID && batch->set_feedback_program(m_programs[feedbackID].get())) {
+                    m_programResources.retain(feedbackID);
+                } else {
+                    m_logger->warn("Batch {} can't draw virtual texture feedback, its tiles won't be streamed", id);
+                }
+            }
+            m_stats.batchCreations++;
             return id;
         } catch (std::out_of_range &err) {
             throw std::runtime_error("Error: batch could not be created missing critital data");
@@ -125,6 +275,7 @@ namespace ORCore
     int Renderer::find_batch(const std::map<RenderState, int>& batchState)
     {
         // Find existing batch that isnt full or already submitted.
+        m_stats.batchLookups++;
 
         for (auto &batch : m_batches)
         {
@@ -171,11 +322,8 @@ namespace ORCore
 
         auto &state = obj.state;
 
-        // if there is no texture set it to the default.
-        if (state.find(RenderState::texture) == state.end())
-        {
-            state.insert({RenderState::texture, m_defaultTextureID});
-        }
+        obj.set_state(RenderState::variant, object_features(obj, false));
+        apply_default_state(obj);
 
         int batchId = find_batch(state);
 
@@ -188,7 +336,7 @@ namespace ORCore
         while (m_batches[batchId]->add_mesh(obj.mesh, obj.modelMatrix) != true)
         {
             m_batches[batchId]->commit(); // commit that batch as it is full.
-            batchId = find_batch(objIn.state); // find or create the next batch
+            batchId = find_batch(state); // find or create the next batch
             obj.batchID = batchId;
         }
 
@@ -203,11 +351,9 @@ namespace ORCore
 
         auto &state = obj.state;
 
-        // if there is no texture set it to the default.
-        if (state.find(RenderState::texture) == state.end())
-        {
-            state.insert({RenderState::texture, m_defaultTextureID});
-        }
+        // Geometry in a dedicated batch is replaced every frame so we can't look at it here.
+        obj.set_state(RenderState::variant, object_features(obj, true));
+        apply_default_state(obj);
 
         int batchId;
 
@@ -226,6 +372,26 @@ namespace ORCore
         return obj.id;
     }
 
+    // Fill in state the object didn't set so objects that differ only by defaults share batches.
+    void Renderer::apply_default_state(RenderObject& obj)
+    {
+        auto &state = obj.state;
+
+        // if there is no texture set it to the default.
+        if (state.find(RenderState::texture) == state.end())
+        {
+            state.insert({RenderState::texture, m_defaultTextureID});
+        }
+        if (state.find(RenderState::layer) == state.end())
+        {
+            state.insert({RenderState::layer, 0});
+        }
+        if (state.find(RenderState::blend_mode) == state.end())
+        {
+            state.insert({RenderState::blend_mode, blend_alpha});
+        }
+    }
+
     int Renderer::readd_object(int objID)
     {
         auto &obj = m_objects[objID];
@@ -234,34 +400,568 @@ namespace ORCore
 
     int Renderer::add_texture(Image&& img)
     {
-        int id = m_textures.size();
+        // Only shared by path, content hashes are of file bytes which a decoded image doesn't have.
+        int id = m_textureResources.acquire(img.path);
+        if (id != -1) {
+            return id;
+        }
+
+        id = m_textures.size();
         m_textures.push_back(std::make_unique<Texture>(GL_TEXTURE_2D));
         auto &texture = m_textures.back();
         texture->update_image_data(img);
+        m_textureResources.add(id, img.path);
+        return id;
+    }
+
+    int Renderer::request_texture(std::string path)
+    {
+        int id = m_textureResources.acquire(path);
+        if (id != -1) {
+            return id;
+        }
+
+        // Copies under other names are caught once a worker has hashed the file, see share_texture().
+        id = m_textures.size();
+        m_textures.push_back(std::make_unique<Texture>(GL_TEXTURE_2D));
+        auto &texture = m_textures.back();
+        texture->set_placeholder(m_textures[m_defaultTextureID].get());
+
+        // Without swizzle support everything is expanded to RGBA while decoding.
+        int components = has_texture_swizzle() ? 0 : 4;
+        m_textureResources.add(id, path);
+        m_textureResidency.add(texture.get(), path, components);
+        m_textureStreamer.request(texture.get(), std::move(path), components);
+        return id;
+    }
+
+    TextureHandle Renderer::load_texture(std::string path)
+    {
+        return TextureHandle(this, request_texture(std::move(path)));
+    }
+
+    void Renderer::retain_texture(int textureID)
+    {
+        m_textureResources.retain(textureID);
+    }
+
+    void Renderer::release_texture(int textureID)
+    {
+        auto &texture = m_textures[textureID];
+        if (texture == nullptr || !m_textureResources.release(textureID, texture->get_memory_size())) {
+            return;
+        }
+        m_textureStreamer.cancel(texture.get());
+        m_textureResidency.remove(texture.get());
+        m_editableImages.erase(textureID);
+        m_virtualTextures.erase(textureID);
+        texture.reset();
+
+        auto copy = m_textureCopies.find(textureID);
+        if (copy != m_textureCopies.end()) {
+            int original = copy->second;
+            m_textureCopies.erase(copy);
+            release_texture(original);
+        }
+    }
+
+    bool Renderer::share_texture(Texture *texture, Texture *original, uint64_t hash)
+    {
+        auto find = [this](Texture *t) {
+            auto found = std::find_if(m_textures.begin(), m_textures.end(), [t](const std::unique_ptr<Texture>& p) {
+                return p.get() == t;
+            });
+            return found == m_textures.end() ? -1 : static_cast<int>(found - m_textures.begin());
+        };
+        int id = find(texture);
+        int originalID = find(original);
+        if (id == -1 || originalID == -1) {
+            return false;
+        }
+        // Filing the original first makes the cache count the copy as a hit on it.
+        m_textureResources.add_content(originalID, hash);
+        if (m_textureResources.add_content(id, hash) != originalID) {
+            return false;
+        }
+
+        // The copy holds a reference so the original outlives it, and has nothing to evict.
+        m_textureResources.retain(originalID);
+        m_textureCopies[id] = originalID;
+        m_textureResidency.remove(texture);
+        return true;
+    }
+
+    int Renderer::add_editable_texture(Image&& img)
+    {
+        int id = m_textures.size();
+        m_textures.push_back(std::make_unique<Texture>(GL_TEXTURE_2D));
+        auto image = std::make_unique<EditableImage>(std::move(img));
+        image->upload_all(*m_textures.back());
+        m_editableImages[id] = std::move(image);
+        m_textureResources.add(id, "");
         return id;
     }
 
+    EditableImage* Renderer::get_editable_image(int textureID)
+    {
+        auto image = m_editableImages.find(textureID);
+        if (image == m_editableImages.end()) {
+            return nullptr;
+        }
+        return image->second.get();
+    }
+
+    int Renderer::add_virtual_texture(std::string path, int cacheTiles)
+    {
+        int id = m_textureResources.acquire(path);
+        if (id != -1) {
+            return id;
+        }
+
+        // Feedback ids are written into a byte with 0 meaning nothing drawn.
+        int feedbackID = 1;
+        for (auto &virtualTexture : m_virtualTextures)
+        {
+            feedbackID = std::max(feedbackID, virtualTexture.second->get_feedback_id() + 1);
+        }
+        if (feedbackID > 255) {
+            m_logger->error("Too many virtual textures, can't add {}", path);
+            return -1;
+        }
+
+        auto texture = std::make_unique<Texture>(GL_TEXTURE_2D);
+        auto virtualTexture = std::make_unique<VirtualTexture>(path, texture.get(), cacheTiles);
+        if (!virtualTexture->is_valid()) {
+            return -1;
+        }
+        virtualTexture->init_gl();
+        virtualTexture->set_feedback_id(feedbackID);
+        m_logger->info("Virtual texture {}: {:.2f} MB on the gpu", path,
+            virtualTexture->get_memory_size() / (1024.0 * 1024.0));
+
+        id = m_textures.size();
+        m_textures.push_back(std::move(texture));
+        m_virtualTextures[id] = std::move(virtualTexture);
+        m_textureResources.add(id, path);
+        return id;
+    }
+
+    VirtualTexture* Renderer::get_virtual_texture(int textureID)
+    {
+        auto virtualTexture = m_virtualTextures.find(textureID);
+        if (virtualTexture == m_virtualTextures.end()) {
+            return nullptr;
+        }
+        return virtualTexture->second.get();
+    }
+
+    void Renderer::set_virtual_feedback_scale(float scale)
+    {
+        m_virtualFeedbackScale = std::max(0.01f, std::min(scale, 1.0f));
+    }
+
+    void Renderer::set_virtual_tile_budget(int tiles)
+    {
+        m_virtualTileBudget = tiles;
+    }
+
+    void Renderer::set_baked_textures(bool enabled)
+    {
+        m_textureStreamer.set_use_baked(enabled);
+    }
+
+    int Renderer::get_baked_texture_count()
+    {
+        return m_textureStreamer.get_baked_count();
+    }
+
+    void Renderer::set_texture_budget(size_t bytes, int evictedSize)
+    {
+        m_textureResidency.set_budget(bytes);
+        m_textureResidency.set_evicted_size(evictedSize);
+    }
+
+    TextureResidency& Renderer::get_texture_residency()
+    {
+        return m_textureResidency;
+    }
+
+    void Renderer::set_texture_upload_budget(size_t bytes)
+    {
+        m_textureUploadBudget = bytes;
+    }
+
+    void Renderer::finish_textures()
+    {
+        PROFILE_ZONE("Renderer::finish_textures");
+        m_stats.textureUploadBytes += m_textureStreamer.finish();
+    }
+
+    void Renderer::log_texture_memory()
+    {
+        std::map<std::string, std::pair<int, size_t>> formats; // name -> count, bytes
+        size_t total = 0;
+        size_t rgba8Total = 0;
+        for (auto &texture : m_textures)
+        {
+            if (texture == nullptr) {
+                continue;
+            }
+            auto &entry = formats[texture_format_name(texture->get_format())];
+            entry.first++;
+            entry.second += texture->get_memory_size();
+            total += texture->get_memory_size();
+
+            int bitsPerTexel = 32;
+            switch (texture->get_format())
+            {
+                case GL_R8: bitsPerTexel = 8; break;
+                case GL_RG8: bitsPerTexel = 16; break;
+                case GL_RGB8: bitsPerTexel = 24; break;
+                case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: bitsPerTexel = 4; break;
+                case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: bitsPerTexel = 8; break;
+                default: break;
+            }
+            rgba8Total += texture->get_memory_size() * 32 / bitsPerTexel;
+        }
+
+        for (auto &format : formats)
+        {
+            m_logger->info("Texture memory {}: {} textures, {:.2f} MB", format.first,
+                format.second.first, format.second.second / (1024.0 * 1024.0));
+        }
+        m_logger->info("Texture memory total: {:.2f} MB, {:.2f} MB saved over RGBA8",
+            total / (1024.0 * 1024.0), (rgba8Total - total) / (1024.0 * 1024.0));
+    }
+
+    void Renderer::log_resource_cache()
+    {
+        size_t saved = m_textureResources.get_bytes_saved([this](int id) {
+            return m_textures[id]->get_memory_size();
+        });
+        m_logger->info("Resource cache: textures {} hits, {} misses, {:.2f} MB saved; programs {} hits, {} misses",
+            m_textureResources.get_hits(), m_textureResources.get_misses(), saved / (1024.0 * 1024.0),
+            m_programResources.get_hits(), m_programResources.get_misses());
+    }
+
+    ResourceCache& Renderer::get_texture_resources()
+    {
+        return m_textureResources;
+    }
+
+    ResourceCache& Renderer::get_program_resources()
+    {
+        return m_programResources;
+    }
+
+    int Renderer::add_sprite_batch(int program, int texture, int capacity)
+    {
+        int programID = resolve_program(program, feature_none);
+
+        // Attribute locations are looked up when the batch is created.
+        finish_programs();
+
+        m_programResources.retain(programID);
+        retain_texture(texture);
+
+        int id = m_spriteBatches.size();
+        m_spriteBatches.push_back(
+            std::make_unique<SpriteBatch>(
+                m_programs[programID].get(),
+                m_textures[texture].get(),
+                capacity, id, &m_stats));
+        m_stats.batchCreations++;
+        return id;
+    }
+
+    SpriteBatch* Renderer::get_sprite_batch(int batchID)
+    {
+        return m_spriteBatches[batchID].get();
+    }
+
+    int Renderer::add_particle_batch(int program, int gradientTexture, int layer, int capacity)
+    {
+        int programID = resolve_program(program, feature_none);
+        finish_programs();
+
+        m_programResources.retain(programID);
+        retain_texture(gradientTexture);
+
+        int id = m_particleBatches.size();
+        auto batch = std::make_unique<ParticleBatch>(
+            m_programs[programID].get(),
+            m_textures[gradientTexture].get(),
+            capacity, id, &m_stats);
+        batch->set_depth(layer_depth(layer));
+        m_particleBatches.push_back({layer, std::move(batch)});
+        m_stats.batchCreations++;
+        return id;
+    }
+
+    ParticleBatch* Renderer::get_particle_batch(int batchID)
+    {
+        return m_particleBatches[batchID].particles.get();
+    }
+
+    int Renderer::add_gpu_particle_batch(int updateProgram, int program, int gradientTexture, int layer, int capacity)
+    {
+        int updateID = resolve_program(updateProgram, feature_none);
+        int programID = resolve_program(program, feature_none);
+        finish_programs();
+
+        m_programResources.retain(updateID);
+        m_programResources.retain(programID);
+        retain_texture(gradientTexture);
+
+        int id = m_gpuParticleBatches.size();
+        auto batch = std::make_unique<GpuParticleBatch>(
+            m_programs[updateID].get(),
+            m_programs[programID].get(),
+            m_textures[gradientTexture].get(),
+            capacity, id, &m_stats);
+        batch->set_depth(layer_depth(layer));
+        m_gpuParticleBatches.push_back({layer, std::move(batch)});
+        m_stats.batchCreations++;
+        m_logger->info("Gpu particle batch {}: {} particles, {:.2f} MB on the gpu", id, capacity,
+            capacity * sizeof(GpuParticle) * 2 / (1024.0 * 1024.0));
+        return id;
+    }
+
+    GpuParticleBatch* Renderer::get_gpu_particle_batch(int batchID)
+    {
+        return m_gpuParticleBatches[batchID].particles.get();
+    }
+
     int Renderer::add_program(Shader&& vertex, Shader&& fragment)
     {
         int id = m_programs.size();
-        m_programs.push_back(std::make_unique<ShaderProgram>(vertex, fragment));
-        auto &program = m_programs.back();
-        program->check_error();
+        m_programs.push_back(std::make_unique<ShaderProgram>(vertex, fragment, &m_programCache));
+        m_pendingPrograms.push_back(id);
+        m_programResources.add(id, "");
         return id;
     }
 
+    int Renderer::add_feedback_program(ShaderInfo vertex, ShaderInfo fragment, std::vector<std::string> varyings)
+    {
+        Shader vertexShader(vertex);
+        Shader fragmentShader(fragment);
+        int id = m_programs.size();
+        m_programs.push_back(std::make_unique<ShaderProgram>(vertexShader, fragmentShader, &m_programCache, std::move(varyings)));
+        m_pendingPrograms.push_back(id);
+        m_programResources.add(id, "");
+        return id;
+    }
+
+    int Renderer::add_program_variants(ShaderInfo vertex, ShaderInfo fragment)
+    {
+        std::string key = shader_key(vertex) + "|" + shader_key(fragment) + "|variants";
+        int id = m_programResources.acquire(key);
+        if (id != -1) {
+            return id;
+        }
+
+        // The slot itself never holds a program, batches use one of the variants.
+        id = m_programs.size();
+        m_programs.push_back(nullptr);
+        m_programVariants.insert({id, ProgramVariants{vertex, fragment, {}}});
+        m_programResources.add(id, key);
+        return id;
+    }
+
+    void Renderer::prepare_variant(int programID, int features)
+    {
+        resolve_program(programID, features);
+    }
+
+    int Renderer::object_features(const RenderObject& obj, bool dynamic)
+    {
+        int features = feature_none;
+
+        // Untextured objects would otherwise sample the blank default texture.
+        auto texture = obj.state.find(RenderState::texture);
+        if (texture != obj.state.end()) {
+            features |= feature_textured;
+            if (m_virtualTextures.find(texture->second) != m_virtualTextures.end()) {
+                features |= feature_virtual_texture;
+            }
+        }
+
+        if (!obj.worldSpace) {
+            features |= feature_model_transform;
+        }
+
+        // Opaque objects still need their transparent texels cut out.
+        if ((features & feature_textured) &&
+            state_value(obj.state, RenderState::blend_mode, blend_alpha) == blend_opaque) {
+            features |= feature_alpha_test;
+        }
+
+        if (dynamic) {
+            features |= feature_vertex_color;
+        } else {
+            for (auto &vertex : obj.mesh.vertices)
+            {
+                if (vertex.color != glm::vec4{1.0f, 1.0f, 1.0f, 1.0f}) {
+                    features |= feature_vertex_color;
+                    break;
+                }
+            }
+        }
+        return features;
+    }
+
+    int Renderer::resolve_program(int programID, int features)
+    {
+        auto family = m_programVariants.find(programID);
+        if (family == m_programVariants.end()) {
+            return programID;
+        }
+
+        auto &variants = family->second;
+        auto compiled = variants.compiled.find(features);
+        if (compiled != variants.compiled.end()) {
+            return compiled->second;
+        }
+
+        std::vector<std::string> defines;
+        if (features & feature_textured) {
+            defines.push_back("TEXTURED");
+        }
+        if (features & feature_vertex_color) {
+            defines.push_back("VERTEX_COLOR");
+        }
+        if (features & feature_model_transform) {
+            defines.push_back("MODEL_TRANSFORM");
+        }
+        if (features & feature_alpha_test) {
+            defines.push_back("ALPHA_TEST");
+        }
+        if (features & feature_virtual_texture) {
+            defines.push_back("VIRTUAL_TEXTURE");
+        }
+
+        ShaderInfo vertex = variants.vertex;
+        ShaderInfo fragment = variants.fragment;
+        vertex.defines.insert(vertex.defines.end(), defines.begin(), defines.end());
+        fragment.defines.insert(fragment.defines.end(), defines.begin(), defines.end());
+        // The vertex shader has to match the plain variant's so the feedback pass can share its vao.
+        if (features & feature_virtual_feedback) {
+            fragment.defines.push_back("VIRTUAL_FEEDBACK");
+        }
+
+        m_logger->info("Compiling shader variant {} of program {}", features, programID);
+        int variantID = request_program(vertex, fragment);
+        variants.compiled.insert({features, variantID});
+        return variantID;
+    }
+
+    int Renderer::request_program(ShaderInfo vertex, ShaderInfo fragment)
+    {
+        std::string key = shader_key(vertex) + "|" + shader_key(fragment);
+        int id = m_programResources.acquire(key);
+        if (id != -1) {
+            return id;
+        }
+
+        id = m_programs.size();
+        m_programs.push_back(nullptr);
+        m_programResources.add(id, key);
+
+        auto readSource = [](ShaderInfo info) {
+            return preprocess_shader(info.path, info.defines);
+        };
+
+        m_programRequests.push_back({id, vertex, fragment,
+            std::async(std::launch::async, readSource, vertex),
+            std::async(std::launch::async, readSource, fragment)});
+        return id;
+    }
+
+    void Renderer::release_program(int programID)
+    {
+        if (!m_programResources.release(programID)) {
+            return;
+        }
+
+        auto family = m_programVariants.find(programID);
+        if (family != m_programVariants.end()) {
+            auto compiled = std::move(family->second.compiled);
+            m_programVariants.erase(family);
+            for (auto &variant : compiled)
+            {
+                release_program(variant.second);
+            }
+            return;
+        }
+
+        // It may still be waiting to be compiled or checked.
+        finish_programs();
+        m_programs[programID].reset();
+    }
+
+    void Renderer::submit_programs()
+    {
+        PROFILE_ZONE("Renderer::submit_programs");
+        for (auto &request : m_programRequests)
+        {
+            Shader vertex(request.vertexInfo, request.vertexSource.get());
+            Shader fragment(request.fragmentInfo, request.fragmentSource.get());
+            m_programs[request.id] = std::make_unique<ShaderProgram>(vertex, fragment, &m_programCache);
+            m_pendingPrograms.push_back(request.id);
+        }
+        m_programRequests.clear();
+    }
+
+    bool Renderer::programs_ready()
+    {
+        submit_programs();
+        for (int id : m_pendingPrograms)
+        {
+            if (!m_programs[id]->is_ready(m_parallelCompile)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void Renderer::finish_programs()
+    {
+        if (m_programRequests.empty() && m_pendingPrograms.empty()) {
+            return;
+        }
+        submit_programs();
+
+        PROFILE_ZONE("Renderer::finish_programs");
+        for (int id : m_pendingPrograms)
+        {
+            m_programs[id]->check_error();
+            m_programs[id]->bind_uniform_block("FrameUniforms", frameUniformBinding);
+        }
+        m_pendingPrograms.clear();
+    }
+
     void Renderer::set_camera_transform(std::string name, glm::mat4&& transform)
     {
-        try {
-            m_cameraUniforms.at(name) = transform;
-        } catch (std::out_of_range &err) {
-            m_cameraUniforms.insert({name, transform});
+        if (!m_frameUniforms.set_camera(name, transform)) {
+            m_logger->warn("No camera named {} in the frame uniforms.", name);
         }
     }
 
+    void Renderer::set_viewport(int x, int y, int width, int height)
+    {
+        m_frameUniforms.set_viewport(x, y, width, height);
+    }
+
+    void Renderer::set_frame_time(double time, double deltaTime)
+    {
+        m_frameUniforms.set_time(static_cast<float>(time), static_cast<float>(deltaTime));
+    }
+
     // commit all remaining batches.
     void Renderer::commit()
     {
+        PROFILE_ZONE("Renderer::commit");
+        m_gpuTimer.begin_commit();
         for (auto &batch : m_batches)
         {
             if (!batch->is_committed())
@@ -269,30 +969,286 @@ namespace ORCore
                 batch->commit();
             }
         }
-        // m_logger->info("Batches: {}", m_batches.size());
-
-        // GLint size;
-        // glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &size);
-        // m_logger->info("Max buffer texture size: {}", size);
-        // glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &size);
-        // m_logger->info("Max texture units: {}", size);
-        // glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &size);
-        // m_logger->info("Max combined texture units: {}", size);
+        for (auto &batch : m_spriteBatches)
+        {
+            batch->commit();
+        }
+        for (auto &batch : m_particleBatches)
+        {
+            batch.particles->commit();
+        }
+        for (auto &batch : m_gpuParticleBatches)
+        {
+            batch.particles->simulate();
+        }
+        m_gpuTimer.end_commit();
     }
 
     void Renderer::render()
     {
-        // TODO - Do sorting of batches to minimize state changes.
-        for (auto &batch : m_batches)
-        {
-            ShaderProgram* program = batch->get_program();
-            program->use();
-            for (auto &cam : m_cameraUniforms)
+        PROFILE_ZONE("Renderer::render");
+        m_stats.uniformBytes += m_frameUniforms.upload();
+
+        if (!m_virtualTextures.empty()) {
+            render_virtual_feedback();
+        }
+
+        if (m_overdrawDebug) {
+            glBeginQuery(GL_SAMPLES_PASSED, m_overdrawQuery);
+        }
+
+        if (!m_passSplit) {
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            for (auto &batch : m_batches)
+            {
+                render_batch(*batch);
+            }
+            for (auto &batch : m_particleBatches)
             {
-                program->set_uniform(program->uniform_attribute(cam.first), cam.second);
+                render_particles(*batch.particles);
             }
+            for (auto &batch : m_gpuParticleBatches)
+            {
+                render_gpu_particles(*batch.particles);
+            }
+        } else {
+            m_opaqueBatches.clear();
+            m_transparentDraws.clear();
+            for (auto &batch : m_batches)
+            {
+                auto &state = batch->get_state();
+                if (state_value(state, RenderState::blend_mode, blend_alpha) == blend_opaque) {
+                    m_opaqueBatches.push_back(batch.get());
+                } else {
+                    m_transparentDraws.push_back({state_value(state, RenderState::layer, 0), batch.get(), nullptr, nullptr});
+                }
+            }
+            for (auto &batch : m_particleBatches)
+            {
+                m_transparentDraws.push_back({batch.layer, nullptr, batch.particles.get(), nullptr});
+            }
+            for (auto &batch : m_gpuParticleBatches)
+            {
+                m_transparentDraws.push_back({batch.layer, nullptr, nullptr, batch.particles.get()});
+            }
+
+            auto layer = [](Batch* batch) {
+                return state_value(batch->get_state(), RenderState::layer, 0);
+            };
+
+            // Front to back so the depth test rejects everything hidden behind opaque objects.
+            std::stable_sort(m_opaqueBatches.begin(), m_opaqueBatches.end(),
+                [&layer](Batch* a, Batch* b) { return layer(a) > layer(b); });
+            std::stable_sort(m_transparentDraws.begin(), m_transparentDraws.end(),
+                [](const LayerDraw& a, const LayerDraw& b) { return a.layer < b.layer; });
+
+            glEnable(GL_DEPTH_TEST);
+            glDepthMask(GL_TRUE);
+            glDisable(GL_BLEND);
+            for (auto *batch : m_opaqueBatches)
+            {
+                render_batch(*batch);
+            }
+
+            glDepthMask(GL_FALSE);
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+            RenderTarget *layerTarget = nullptr;
+            int targetLayer = 0;
+            for (auto &draw : m_transparentDraws)
+            {
+                int batchLayer = draw.layer;
+                if (layerTarget != nullptr && batchLayer != targetLayer) {
+                    composite_layer_target(layerTarget);
+                    layerTarget = nullptr;
+                }
+
+                auto scale = m_layerScales.find(batchLayer);
+                float resolutionScale = scale == m_layerScales.end() ? 1.0f : scale->second;
+                if (resolutionScale < 1.0f && layerTarget == nullptr) {
+                    layerTarget = begin_layer_target(resolutionScale);
+                    targetLayer = batchLayer;
+                }
+                if (draw.batch != nullptr) {
+                    render_batch(*draw.batch, resolutionScale);
+                } else if (draw.particles != nullptr) {
+                    render_particles(*draw.particles, resolutionScale);
+                } else {
+                    render_gpu_particles(*draw.gpuParticles, resolutionScale);
+                }
+            }
+            if (layerTarget != nullptr) {
+                composite_layer_target(layerTarget);
+            }
+        }
+
+        // Sprites use their own depth and are always blended.
+        m_gpuTimer.begin_pass(GpuPass::sprites);
+        for (auto &batch : m_spriteBatches)
+        {
+            batch->get_program()->use();
+            m_stats.programBinds++;
             batch->render();
         }
+        m_gpuTimer.end_pass();
+
+        // glClear respects the depth mask so it has to be left on.
+        glDepthMask(GL_TRUE);
+        glDisable(GL_DEPTH_TEST);
+
+        if (m_overdrawDebug) {
+            glEndQuery(GL_SAMPLES_PASSED);
+        }
+    }
+
+    void Renderer::render_batch(Batch& batch, float resolutionScale)
+    {
+        batch.get_program()->use();
+        m_stats.programBinds++;
+        m_gpuTimer.begin_batch(batch.get_id());
+        batch.render(resolutionScale);
+        m_gpuTimer.end_batch();
+    }
+
+    void Renderer::render_particles(ParticleBatch& batch, float resolutionScale)
+    {
+        batch.get_program()->use();
+        m_stats.programBinds++;
+        m_gpuTimer.begin_pass(GpuPass::particles);
+        batch.render(resolutionScale);
+        m_gpuTimer.end_pass();
+    }
+
+    void Renderer::render_gpu_particles(GpuParticleBatch& batch, float resolutionScale)
+    {
+        batch.get_program()->use();
+        m_stats.programBinds++;
+        m_gpuTimer.begin_pass(GpuPass::particles);
+        batch.render(resolutionScale);
+        m_gpuTimer.end_pass();
+    }
+
+    void Renderer::render_virtual_feedback()
+    {
+        PROFILE_ZONE("Renderer::render_virtual_feedback");
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &m_mainFramebuffer);
+        GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+
+        auto &viewport = m_frameUniforms.get_data().viewport;
+        int width = std::max(1, static_cast<int>(viewport.z * m_virtualFeedbackScale));
+        int height = std::max(1, static_cast<int>(viewport.w * m_virtualFeedbackScale));
+        // Hidden texels are only known when the main pass depth tests, see render().
+        bool occlusion = m_passSplit;
+        RenderTarget *target = m_targetPool.acquire(width, height, occlusion);
+        m_gpuTimer.begin_pass(GpuPass::feedback);
+        m_virtualFeedback.begin(target);
+        glDisable(GL_BLEND);
+
+        auto opaque = [](Batch& batch) {
+            return state_value(batch.get_state(), RenderState::blend_mode, blend_alpha) == blend_opaque;
+        };
+        if (occlusion) {
+            // Opaque batches hide what's behind them like they do in the main pass. Their depth
+            // goes in first so texels they cover never ask for tiles.
+            glEnable(GL_DEPTH_TEST);
+            glDepthMask(GL_TRUE);
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            for (auto &batch : m_batches)
+            {
+                if (!batch->has_feedback() && opaque(*batch)) {
+                    batch->get_program()->use();
+                    m_stats.programBinds++;
+                    batch->render();
+                }
+            }
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        } else {
+            // Everything is drawn without the pass split, tiles under other objects get loaded too.
+            glDisable(GL_DEPTH_TEST);
+        }
+
+        // Derivatives are larger at the lower resolution, which would ask for coarser tiles than drawn.
+        // Opaque ones go first so they can hide the rest, blended ones don't hide anything.
+        float lodBias = std::log2(m_virtualFeedbackScale);
+        for (int pass = 0; pass < 2; pass++)
+        {
+            glDepthMask(pass == 0 ? GL_TRUE : GL_FALSE);
+            for (auto &batch : m_batches)
+            {
+                if (batch->has_feedback() && opaque(*batch) == (pass == 0)) {
+                    batch->render_feedback(lodBias);
+                    m_stats.programBinds++;
+                }
+            }
+        }
+        glDepthMask(GL_TRUE);
+
+        m_virtualFeedback.end();
+        m_gpuTimer.end_pass();
+        m_targetPool.release(target);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_mainFramebuffer);
+        glViewport(viewport.x, viewport.y, viewport.z, viewport.w);
+        if (depthTest) {
+            glEnable(GL_DEPTH_TEST);
+        } else {
+            glDisable(GL_DEPTH_TEST);
+        }
+    }
+
+    RenderTarget* Renderer::begin_layer_target(float scale)
+    {
+        // Headless runs draw into their own framebuffer rather than 0 so ask which one is bound.
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &m_mainFramebuffer);
+
+        auto &viewport = m_frameUniforms.get_data().viewport;
+        int width = std::max(1, static_cast<int>(viewport.z * scale));
+        int height = std::max(1, static_cast<int>(viewport.w * scale));
+
+        RenderTarget *target = m_targetPool.acquire(width, height);
+        target->bind_target();
+
+        GLfloat clear[] = {0.0f, 0.0f, 0.0f, 0.0f};
+        glClearBufferfv(GL_COLOR, 0, clear);
+
+        // The target has no depth buffer. Alpha is accumulated separately so the
+        // target ends up premultiplied, which is what the composite expects.
+        glDisable(GL_DEPTH_TEST);
+        glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        return target;
+    }
+
+    void Renderer::composite_layer_target(RenderTarget* target)
+    {
+        PROFILE_ZONE("Renderer::composite_layer_target");
+        auto &viewport = m_frameUniforms.get_data().viewport;
+        glBindFramebuffer(GL_FRAMEBUFFER, m_mainFramebuffer);
+        glViewport(viewport.x, viewport.y, viewport.z, viewport.w);
+
+        ShaderProgram *program = m_programs[m_compositeProgram].get();
+        if (program == nullptr || m_compositeSampler == -1) {
+            finish_programs();
+            program = m_programs[m_compositeProgram].get();
+            m_compositeSampler = program->uniform_attribute("layerSampler");
+        }
+
+        program->use();
+        m_stats.programBinds++;
+        if (target->bind(m_compositeSampler)) {
+            m_stats.textureBinds++;
+        }
+
+        m_gpuTimer.begin_pass(GpuPass::composite);
+        glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        glBindVertexArray(m_compositeVao);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        m_gpuTimer.end_pass();
+        m_stats.drawCalls++;
+
+        glEnable(GL_DEPTH_TEST);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        m_targetPool.release(target);
     }
 
     void Renderer::clear()
@@ -303,8 +1259,126 @@ namespace ORCore
         }
     }
 
+    void Renderer::begin_frame()
+    {
+        m_gpuTimer.begin_frame();
+
+        m_frame++;
+        Texture::set_frame(m_frame);
+        m_textureResidency.update(m_textures, m_frame);
+        m_stats.textureResidentBytes = m_textureResidency.get_resident_bytes();
+        m_stats.textureEvictions = m_textureResidency.get_frame_evictions();
+        m_stats.textureReloads = m_textureResidency.get_frame_reloads();
+
+        m_stats.textureUploadBytes += m_textureStreamer.update(m_textureUploadBudget);
+        for (auto &image : m_editableImages)
+        {
+            m_stats.textureUploadBytes += image.second->upload_dirty(*m_textures[image.first]);
+        }
+
+        if (!m_virtualTextures.empty()) {
+            m_virtualFeedback.read([this](int feedbackID, int level, int x, int y) {
+                for (auto &texture : m_virtualTextures)
+                {
+                    if (texture.second->get_feedback_id() == feedbackID) {
+                        texture.second->request_tile(level, x, y);
+                        break;
+                    }
+                }
+            });
+            for (auto &texture : m_virtualTextures)
+            {
+                int tiles = texture.second->update(m_virtualTileBudget, m_frame);
+                m_stats.virtualTileUploads += tiles;
+                m_stats.virtualTilesResident += texture.second->get_resident_tiles();
+                m_stats.textureUploadBytes += tiles * texture.second->get_tile_bytes();
+            }
+        }
+    }
+
+    void Renderer::end_frame()
+    {
+        m_gpuTimer.end_frame();
+        m_targetPool.end_frame();
+
+        if (m_gpuTimer.collect(m_gpuTimings)) {
+            Profiler::record_gpu(m_gpuTimings);
+            m_stats.gpuFrame = m_gpuTimings.frame;
+            m_stats.gpuFrameTime = m_gpuTimings.frameTime;
+            m_stats.gpuCommitTime = m_gpuTimings.commitTime;
+            m_stats.gpuParticleTime = m_gpuTimings.particleTime;
+            m_stats.gpuSpriteTime = m_gpuTimings.spriteTime;
+            m_stats.gpuCompositeTime = m_gpuTimings.compositeTime;
+            m_stats.gpuFeedbackTime = m_gpuTimings.feedbackTime;
+            for (size_t i = 0; i < m_gpuTimings.batchTimes.size(); i++)
+            {
+                m_stats.gpuBatchTime += m_gpuTimings.batchTimes[i];
+                if (m_gpuTimings.batchTimes[i] > m_stats.gpuSlowestBatchTime) {
+                    m_stats.gpuSlowestBatchTime = m_gpuTimings.batchTimes[i];
+                    m_stats.gpuSlowestBatch = m_gpuTimings.batchIDs[i];
+                }
+            }
+        }
+
+        if (m_overdrawDebug) {
+            GLuint64 samples = 0;
+            glGetQueryObjectui64v(m_overdrawQuery, GL_QUERY_RESULT, &samples);
+            auto &viewport = m_frameUniforms.get_data().viewport;
+            double pixels = static_cast<double>(viewport.z) * viewport.w;
+            m_stats.samplesPassed = samples;
+            m_stats.overdraw = pixels > 0.0 ? samples / pixels : 0.0;
+        }
+
+        m_frameStats = m_stats;
+        m_stats.reset();
+    }
+
+    const RendererStats& Renderer::get_stats()
+    {
+        return m_frameStats;
+    }
+
+    void Renderer::set_gpu_timing(bool enabled)
+    {
+        m_gpuTimer.set_enabled(enabled);
+        if (enabled && !m_gpuTimer.is_supported()) {
+            m_logger->warn("Gpu timer queries are not supported by this driver.");
+        }
+    }
+
+    const GpuTimings& Renderer::get_gpu_timings()
+    {
+        return m_gpuTimings;
+    }
+
+    void Renderer::set_overdraw_debug(bool enabled)
+    {
+        m_overdrawDebug = enabled;
+    }
+
+    void Renderer::set_pass_split(bool enabled)
+    {
+        m_passSplit = enabled;
+    }
+
+    void Renderer::set_layer_scale(int layer, float scale)
+    {
+        m_layerScales[layer] = std::max(0.05f, std::min(scale, 1.0f));
+    }
+
+    ProgramCache& Renderer::get_program_cache()
+    {
+        return m_programCache;
+    }
+
     Renderer::~Renderer()
     {
+        if (m_overdrawQuery != 0) {
+            glDeleteQueries(1, &m_overdrawQuery);
+        }
+        if (m_compositeVao != 0) {
+            glDeleteVertexArrays(1, &m_compositeVao);
+        }
 
     }
 
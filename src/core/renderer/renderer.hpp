@@ -1,5 +1,6 @@
 #pragma once
 #include <memory>
+#include <future>
 #include <unordered_map>
 #include <map>
 #include <string>
@@ -7,8 +8,20 @@
 #include <spdlog/spdlog.h>
 
 #include "texture.hpp"
+#include "texturestreamer.hpp"
+#include "textureresidency.hpp"
+#include "editableimage.hpp"
+#include "resourcecache.hpp"
+#include "virtualtexture.hpp"
 #include "batch.hpp"
+#include "spritebatch.hpp"
+#include "particlebatch.hpp"
+#include "gpuparticlebatch.hpp"
 #include "mesh.hpp"
+#include "stats.hpp"
+#include "gputimer.hpp"
+#include "frameuniforms.hpp"
+#include "rendertarget.hpp"
 
 namespace ORCore
 {
@@ -17,6 +30,11 @@ namespace ORCore
 
     void set_state(std::map<RenderState, int>& state, RenderState stateItem, int value);
 
+    const int maxLayers = 256;
+
+    // Z value for a layer within the -1 to 1 range of the game's ortho projection.
+    float layer_depth(int layer);
+
     struct RenderObject
     {
         Mesh mesh;
@@ -24,6 +42,7 @@ namespace ORCore
         std::map<RenderState, int> state;
         int id; // id of this object in the renderer.
         int batchID;
+        bool worldSpace; // Geometry is already in world space so no model matrix is needed.
         RenderObject();
         void set_state(RenderState stateItem, int value);
         void set_scale(glm::vec3&& scale);
@@ -33,9 +52,35 @@ namespace ORCore
         void set_texture(int _texture);
         void set_program(int _program);
         void set_point_size(int pointSize);
+        void set_world_space(bool enabled);
+        void set_layer(int layer);
+        void set_blend_mode(BlendMode mode);
+        int get_layer();
         void update();
     };
 
+    class Renderer;
+
+    // Holds a reference to a renderer texture, released when the handle is destroyed or
+    // assigned over. Copies take a reference of their own.
+    class TextureHandle
+    {
+    public:
+        TextureHandle();
+        TextureHandle(Renderer *renderer, int id); // Takes over a reference the caller already has.
+        TextureHandle(const TextureHandle& other);
+        TextureHandle(TextureHandle&& other);
+        TextureHandle& operator=(TextureHandle other);
+        ~TextureHandle();
+
+        int get() const { return m_id; }
+        void reset();
+
+    private:
+        Renderer *m_renderer;
+        int m_id;
+    };
+
     // Builds and renders batches from objects.
     class Renderer
     {
@@ -48,24 +93,229 @@ namespace ORCore
         int readd_object(int objID);
         RenderObject* get_object(int objID);
         void update_object(int objID);
+        // Images added with the same path share one texture.
         int add_texture(Image&& img);
+
+        // Decodes path on a worker thread and uploads it a little at a time from begin_frame().
+        // The id can be used straight away, it draws with the default texture until loaded.
+        // A path already loaded returns the existing texture. A file found to have the same
+        // bytes as one already loaded is never uploaded and draws with that texture instead.
+        int request_texture(std::string path);
+        TextureHandle load_texture(std::string path); // request_texture() wrapped in a handle.
+
+        // Every add or request takes a reference to the texture, and batches using it hold one
+        // too. The texture is freed once the last reference is released.
+        void retain_texture(int textureID);
+        void release_texture(int textureID);
+
+        // Textures that are changed on the cpu, see EditableImage. begin_frame() uploads
+        // the regions that changed since the last frame.
+        int add_editable_texture(Image&& img);
+        EditableImage* get_editable_image(int textureID);
+
+        // Textures too large to load whole, drawn from the tiles of a .orvt file (see texbake --virtual)
+        // that a feedback pass finds on screen. The id is used like any other texture by objects
+        // whose program was made by add_program_variants(). Returns -1 if the file can't be loaded.
+        int add_virtual_texture(std::string path, int cacheTiles = 16);
+        VirtualTexture* get_virtual_texture(int textureID);
+
+        // The feedback pass is drawn at this fraction of the viewport, 0.25 by default.
+        void set_virtual_feedback_scale(float scale);
+        // Caps how many virtual texture tiles begin_frame() uploads each frame.
+        void set_virtual_tile_budget(int tiles);
+
+        // Requested textures load from a baked .ortex next to the image when there is one,
+        // see the texbake tool. Turning this off always decodes the original image.
+        void set_baked_textures(bool enabled);
+        int get_baked_texture_count();
+
+        // Keeps textures loaded by request_texture() under a memory budget by evicting the least
+        // recently bound ones down to a mip no larger than evictedSize (or entirely when 0).
+        // Evicted textures are streamed back in when next drawn. A budget of 0 disables eviction.
+        void set_texture_budget(size_t bytes, int evictedSize = 32);
+        TextureResidency& get_texture_residency();
+
+        // Caps how many bytes of texture data begin_frame() uploads each frame.
+        void set_texture_upload_budget(size_t bytes);
+
+        // Waits for every requested texture to be decoded and uploaded, used for preloading.
+        void finish_textures();
+
+        // Logs the memory used by textures for each format, along with what RGBA8 would have used.
+        void log_texture_memory();
+
+        // Logs how often textures and programs were found already loaded, and the texture memory that saved.
+        void log_resource_cache();
+        ResourceCache& get_texture_resources();
+        ResourceCache& get_program_resources();
+
+        // Sprite batches sit alongside objects for large numbers of textured rectangles.
+        // The program has to take Sprite records, see data/shaders/sprite.vs.
+        int add_sprite_batch(int program, int texture, int capacity);
+        SpriteBatch* get_sprite_batch(int batchID);
+
+        // Particle batches are always alpha blended and drawn with the rest of their layer.
+        // The program has to take ParticleVertex records, see data/shaders/particle.vs.
+        int add_particle_batch(int program, int gradientTexture, int layer, int capacity);
+        ParticleBatch* get_particle_batch(int batchID);
+
+        // Particles simulated on the gpu by updateProgram, a program made by add_feedback_program()
+        // from data/shaders/particleupdate.vs. They're drawn the same as a particle batch.
+        // They're stepped in commit(), see GpuParticleBatch.
+        int add_gpu_particle_batch(int updateProgram, int program, int gradientTexture, int layer, int capacity);
+        GpuParticleBatch* get_gpu_particle_batch(int batchID);
+
         int add_program(Shader&& vertex, Shader&& fragment);
+
+        // A program whose vertex shader outputs are captured by transform feedback, in the order given.
+        int add_feedback_program(ShaderInfo vertex, ShaderInfo fragment, std::vector<std::string> varyings);
+
+        // Adds a program whose variants are compiled on demand from ShaderFeature defines.
+        // Objects using it get the cheapest variant that covers their state.
+        int add_program_variants(ShaderInfo vertex, ShaderInfo fragment);
+
+        // Queues a variant for compilation ahead of time so it isn't compiled when first used.
+        void prepare_variant(int programID, int features);
+
+        // Queues a program whose sources are read on a background thread. The id can be used
+        // straight away, compilation is started by submit_programs().
+        // Requesting the same sources and defines again returns the existing program.
+        int request_program(ShaderInfo vertex, ShaderInfo fragment);
+
+        // Programs are reference counted the same way as textures. Releasing a program
+        // made by add_program_variants() releases its variants.
+        void release_program(int programID);
+
+        // Starts compiling and linking every requested program without checking the results,
+        // so the driver can work on them while we load other assets.
+        void submit_programs();
+
+        // True once the driver has finished every pending program.
+        bool programs_ready();
+
+        // Checks compile/link status of every pending program, throws on failure.
+        // Called automatically before a batch first uses a program.
+        void finish_programs();
+
+        // These go into the FrameUniforms block which is uploaded once per frame in render().
         void set_camera_transform(std::string name, glm::mat4&& transform);
-        // add global attribute/uniforms for shaders ?
+        void set_viewport(int x, int y, int width, int height);
+        void set_frame_time(double time, double deltaTime);
         void commit();
         void render();
         void clear();
+
+        void begin_frame();
+        // Finishes counting stats for this frame, they are available from get_stats() until the next end_frame().
+        void end_frame();
+        const RendererStats& get_stats();
+
+        // Gpu timer queries are off by default as they add a little overhead.
+        void set_gpu_timing(bool enabled);
+        const GpuTimings& get_gpu_timings();
+
+        // Counts the samples that pass the depth test each frame, giving the average
+        // overdraw in the stats. Reading the query back waits on the gpu so this is for debugging.
+        void set_overdraw_debug(bool enabled);
+
+        // With the pass split off every batch is drawn blended in the order it was
+        // created, the same as before layers existed. Useful for comparing overdraw.
+        void set_pass_split(bool enabled);
+
+        // Draws an alpha blended layer into a pooled target at a fraction of the viewport size,
+        // which is then upsampled and composited in the layer's place. 1.0 draws it directly.
+        // Opaque batches always draw at full resolution.
+        void set_layer_scale(int layer, float scale);
+
+        ProgramCache& get_program_cache();
         ~Renderer();
 
     private:
+        int object_features(const RenderObject& obj, bool dynamic);
+        int resolve_program(int programID, int features);
         int create_batch(const std::map<RenderState, int>& batchState, int batchSize);
         int find_batch(const std::map<RenderState, int>& batchState);
+        void apply_default_state(RenderObject& obj);
+        void render_batch(Batch& batch, float resolutionScale = 1.0f);
+        void render_particles(ParticleBatch& batch, float resolutionScale = 1.0f);
+        void render_gpu_particles(GpuParticleBatch& batch, float resolutionScale = 1.0f);
+        RenderTarget* begin_layer_target(float scale);
+        void composite_layer_target(RenderTarget* target);
+        void render_virtual_feedback();
+        bool share_texture(Texture *texture, Texture *original, uint64_t hash); // The streamer's content check.
         std::vector<RenderObject> m_objects;
         std::vector<std::unique_ptr<Batch>> m_batches;
-        std::unordered_map<std::string, glm::mat4> m_cameraUniforms;
+        std::vector<std::unique_ptr<SpriteBatch>> m_spriteBatches;
+        struct LayeredParticleBatch
+        {
+            int layer;
+            std::unique_ptr<ParticleBatch> particles;
+        };
+        std::vector<LayeredParticleBatch> m_particleBatches;
+        struct LayeredGpuParticleBatch
+        {
+            int layer;
+            std::unique_ptr<GpuParticleBatch> particles;
+        };
+        std::vector<LayeredGpuParticleBatch> m_gpuParticleBatches;
+        FrameUniforms m_frameUniforms;
         std::vector<std::unique_ptr<Texture>> m_textures;
         std::vector<std::unique_ptr<ShaderProgram>> m_programs;
         std::shared_ptr<spdlog::logger> m_logger;
+        struct ProgramRequest
+        {
+            int id;
+            ShaderInfo vertexInfo;
+            ShaderInfo fragmentInfo;
+            std::future<std::string> vertexSource;
+            std::future<std::string> fragmentSource;
+        };
+        std::vector<ProgramRequest> m_programRequests;
+        std::vector<int> m_pendingPrograms; // Linked but not yet checked.
+
+        struct ProgramVariants
+        {
+            ShaderInfo vertex;
+            ShaderInfo fragment;
+            std::map<int, int> compiled; // features -> program id
+        };
+        std::unordered_map<int, ProgramVariants> m_programVariants;
+        std::vector<Batch*> m_opaqueBatches; // Reused every frame to sort batches into passes.
+        struct LayerDraw
+        {
+            int layer;
+            Batch *batch; // One of these is set.
+            ParticleBatch *particles;
+            GpuParticleBatch *gpuParticles;
+        };
+        std::vector<LayerDraw> m_transparentDraws;
+        bool m_passSplit;
+        std::map<int, float> m_layerScales;
+        RenderTargetPool m_targetPool;
+        GLint m_mainFramebuffer; // Framebuffer reduced layers are composited back onto.
+        int m_compositeProgram;
+        GLint m_compositeSampler;
+        GLuint m_compositeVao;
+        bool m_overdrawDebug;
+        GLuint m_overdrawQuery;
+        bool m_parallelCompile;
         int m_defaultTextureID;
+        TextureStreamer m_textureStreamer;
+        TextureResidency m_textureResidency;
+        uint64_t m_frame;
+        std::unordered_map<int, std::unique_ptr<EditableImage>> m_editableImages; // texture id -> image
+        ResourceCache m_textureResources; // Freed textures are left as null in m_textures.
+        std::unordered_map<int, int> m_textureCopies; // texture id -> the texture it draws with, holding a reference
+        ResourceCache m_programResources;
+        std::unordered_map<int, std::unique_ptr<VirtualTexture>> m_virtualTextures; // texture id -> virtual texture
+        VirtualTextureFeedback m_virtualFeedback;
+        float m_virtualFeedbackScale;
+        int m_virtualTileBudget;
+        size_t m_textureUploadBudget;
+        RendererStats m_stats;
+        RendererStats m_frameStats;
+        ProgramCache m_programCache;
+        GpuTimer m_gpuTimer;
+        GpuTimings m_gpuTimings;
     };
 }
\ No newline at end of file
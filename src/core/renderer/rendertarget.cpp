@@ -0,0 +1,102 @@
+#include "config.hpp"
+#include "rendertarget.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+
+namespace ORCore
+{
+    RenderTarget::RenderTarget(int width, int height, bool depth)
+    : TextureBase(GL_TEXTURE_2D), m_width(width), m_height(height), m_depth(depth), m_fbo(0), m_depthBuffer(0),
+      m_inUse(false), m_lastUsedFrame(0)
+    {
+        init_gl();
+    }
+
+    RenderTarget::~RenderTarget()
+    {
+        unbind();
+        glDeleteFramebuffers(1, &m_fbo);
+        if (m_depthBuffer != 0) {
+            glDeleteRenderbuffers(1, &m_depthBuffer);
+        }
+        glDeleteTextures(1, &m_oglTexID);
+    }
+
+    void RenderTarget::init_gl()
+    {
+        glGenTextures(1, &m_oglTexID);
+        bind_for_update();
+        glTexImage2D(m_texTargetType, 0, GL_RGBA8, m_width, m_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        // Linear filtering does the upsampling when the target is composited at a larger size.
+        glTexParameteri(m_texTargetType, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(m_texTargetType, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(m_texTargetType, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(m_texTargetType, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(m_texTargetType, 0);
+
+        GLint previous = 0;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous);
+
+        glGenFramebuffers(1, &m_fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_texTargetType, m_oglTexID, 0);
+        if (m_depth) {
+            glGenRenderbuffers(1, &m_depthBuffer);
+            glBindRenderbuffer(GL_RENDERBUFFER, m_depthBuffer);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, m_width, m_height);
+            glBindRenderbuffer(GL_RENDERBUFFER, 0);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depthBuffer);
+        }
+
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        glBindFramebuffer(GL_FRAMEBUFFER, previous);
+
+        if (status != GL_FRAMEBUFFER_COMPLETE) {
+            throw std::runtime_error("Error: Render target framebuffer is incomplete.");
+        }
+    }
+
+    void RenderTarget::bind_target()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+        glViewport(0, 0, m_width, m_height);
+    }
+
+    RenderTargetPool::RenderTargetPool(int maxIdleFrames)
+    : m_maxIdleFrames(maxIdleFrames), m_frame(0)
+    {
+    }
+
+    RenderTarget* RenderTargetPool::acquire(int width, int height, bool depth)
+    {
+        for (auto &target : m_targets)
+        {
+            if (!target->m_inUse && target->m_width == width && target->m_height == height && target->m_depth == depth) {
+                target->m_inUse = true;
+                target->m_lastUsedFrame = m_frame;
+                return target.get();
+            }
+        }
+
+        m_targets.push_back(std::make_unique<RenderTarget>(width, height, depth));
+        auto &target = m_targets.back();
+        target->m_inUse = true;
+        target->m_lastUsedFrame = m_frame;
+        return target.get();
+    }
+
+    void RenderTargetPool::release(RenderTarget* target)
+    {
+        target->m_inUse = false;
+    }
+
+    void RenderTargetPool::end_frame()
+    {
+        m_frame++;
+        auto idle = [this](const std::unique_ptr<RenderTarget>& target) {
+            return !target->m_inUse && m_frame - target->m_lastUsedFrame > m_maxIdleFrames;
+        };
+        m_targets.erase(std::remove_if(m_targets.begin(), m_targets.end(), idle), m_targets.end());
+    }
+} // namespace ORCore
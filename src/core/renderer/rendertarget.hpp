@@ -0,0 +1,59 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <glad/glad.h>
+
+#include "texture.hpp"
+
+namespace ORCore
+{
+    // Framebuffer with a color texture that can be sampled once rendering into it is done.
+    // Depth is only attached when asked for, layers drawn into a target can't be hidden by
+    // the main scene either way.
+    class RenderTarget : public TextureBase
+    {
+    public:
+        RenderTarget(int width, int height, bool depth = false);
+        ~RenderTarget();
+
+        void init_gl();
+
+        // Binds the framebuffer and sets the viewport to cover it.
+        void bind_target();
+
+        int get_width() { return m_width; }
+        int get_height() { return m_height; }
+        bool has_depth() { return m_depthBuffer != 0; }
+
+    private:
+        friend class RenderTargetPool;
+        int m_width;
+        int m_height;
+        bool m_depth;
+        GLuint m_fbo;
+        GLuint m_depthBuffer;
+        bool m_inUse;
+        int m_lastUsedFrame;
+    };
+
+    // Hands out render targets by size, reusing them between frames. Targets that
+    // haven't been used for a while are freed so a window resize doesn't leave
+    // old sizes around forever.
+    class RenderTargetPool
+    {
+    public:
+        RenderTargetPool(int maxIdleFrames = 60);
+
+        RenderTarget* acquire(int width, int height, bool depth = false);
+        void release(RenderTarget* target);
+
+        void end_frame();
+
+        int get_target_count() { return m_targets.size(); }
+
+    private:
+        std::vector<std::unique_ptr<RenderTarget>> m_targets;
+        int m_maxIdleFrames;
+        int m_frame;
+    };
+} // namespace ORCore
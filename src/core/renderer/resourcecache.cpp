@@ -0,0 +1,143 @@
+#include "config.hpp"
+#include "resourcecache.hpp"
+
+namespace ORCore
+{
+    namespace
+    {
+        // "./data/a.png" and "data/a.png" are the same file.
+        std::string normalize_key(const std::string& key)
+        {
+            size_t start = 0;
+            while (key.compare(start, 2, "./") == 0)
+            {
+                start += 2;
+            }
+            return key.substr(start);
+        }
+    }
+
+    ResourceCache::ResourceCache()
+    : m_hits(0), m_misses(0), m_freedBytesSaved(0)
+    {
+    }
+
+    int ResourceCache::acquire(const std::string& key)
+    {
+        auto found = m_keys.find(normalize_key(key));
+        if (found == m_keys.end()) {
+            return -1;
+        }
+        auto &entry = m_entries[found->second];
+        entry.references++;
+        entry.hits++;
+        m_hits++;
+        return found->second;
+    }
+
+    int ResourceCache::acquire_content(uint64_t hash, const std::string& key)
+    {
+        auto found = m_hashes.find(hash);
+        if (hash == 0 || found == m_hashes.end()) {
+            return -1;
+        }
+        auto &entry = m_entries[found->second];
+        entry.references++;
+        entry.hits++;
+        m_hits++;
+
+        std::string normalized = normalize_key(key);
+        if (!normalized.empty()) {
+            m_keys[normalized] = found->second;
+            entry.keys.push_back(normalized);
+        }
+        return found->second;
+    }
+
+    void ResourceCache::add(int id, const std::string& key, uint64_t hash)
+    {
+        Entry entry {1, 0, hash, {}};
+        std::string normalized = normalize_key(key);
+        if (!normalized.empty()) {
+            m_keys[normalized] = id;
+            entry.keys.push_back(normalized);
+            m_misses++;
+        }
+        if (hash != 0) {
+            m_hashes[hash] = id;
+        }
+        m_entries[id] = std::move(entry);
+    }
+
+    int ResourceCache::add_content(int id, uint64_t hash)
+    {
+        auto entry = m_entries.find(id);
+        if (hash == 0 || entry == m_entries.end()) {
+            return -1;
+        }
+        auto found = m_hashes.find(hash);
+        if (found == m_hashes.end()) {
+            entry->second.hash = hash;
+            m_hashes[hash] = id;
+            return -1;
+        }
+        if (found->second == id) {
+            return -1;
+        }
+
+        // id was counted as a miss when it was added.
+        m_entries[found->second].hits++;
+        m_hits++;
+        m_misses--;
+        return found->second;
+    }
+
+    void ResourceCache::retain(int id)
+    {
+        auto found = m_entries.find(id);
+        if (found != m_entries.end()) {
+            found->second.references++;
+        }
+    }
+
+    bool ResourceCache::release(int id, size_t bytes)
+    {
+        auto found = m_entries.find(id);
+        if (found == m_entries.end()) {
+            return false;
+        }
+        auto &entry = found->second;
+        if (--entry.references > 0) {
+            return false;
+        }
+
+        m_freedBytesSaved += bytes * entry.hits;
+        for (auto &key : entry.keys)
+        {
+            m_keys.erase(key);
+        }
+        if (entry.hash != 0) {
+            m_hashes.erase(entry.hash);
+        }
+        m_entries.erase(found);
+        return true;
+    }
+
+    int ResourceCache::get_references(int id)
+    {
+        auto found = m_entries.find(id);
+        return found == m_entries.end() ? 0 : found->second.references;
+    }
+
+    size_t ResourceCache::get_bytes_saved(const std::function<size_t(int)>& sizeOf)
+    {
+        size_t saved = m_freedBytesSaved;
+        for (auto &entry : m_entries)
+        {
+            if (entry.second.hits > 0) {
+                saved += sizeOf(entry.first) * entry.second.hits;
+            }
+        }
+        return saved;
+    }
+} // namespace ORCore
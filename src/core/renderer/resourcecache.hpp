@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ORCore
+{
+    // Keeps track of loaded resources by key (normally a vfs path) and content hash so
+    // each unique resource is only loaded once, and counts the references held to them.
+    // The cache only deals in ids, the owner stores the resources and frees them when
+    // release() says the last reference has gone.
+    class ResourceCache
+    {
+    public:
+        ResourceCache();
+
+        // Returns the id filed under key and takes a reference to it, or -1 when it isn't cached.
+        int acquire(const std::string& key);
+
+        // The same for a content hash. A hit also files key under the resource it found
+        // so next time acquire(key) finds it without hashing anything.
+        int acquire_content(uint64_t hash, const std::string& key);
+
+        // Files a newly loaded resource holding one reference. Resources without a key or
+        // hash (0) can't be shared but are still reference counted.
+        void add(int id, const std::string& key, uint64_t hash = 0);
+
+        // Files the hash of a resource added without one, once it's known. Returns the id
+        // of another resource that already has that content, counted as a hit, or -1.
+        int add_content(int id, uint64_t hash);
+
+        void retain(int id);
+
+        // Drops a reference, returns true when it was the last one and the resource should be
+        // freed. bytes is the resource's size, kept for get_bytes_saved().
+        bool release(int id, size_t bytes = 0);
+
+        int get_references(int id);
+        int get_hits() { return m_hits; }
+        int get_misses() { return m_misses; }
+
+        // What the hits would have loaded again without the cache, sizeOf gives the size of a
+        // resource that is still loaded.
+        size_t get_bytes_saved(const std::function<size_t(int)>& sizeOf);
+
+    private:
+        struct Entry
+        {
+            int references;
+            int hits;
+            uint64_t hash;
+            std::vector<std::string> keys;
+        };
+
+        std::unordered_map<int, Entry> m_entries;
+        std::unordered_map<std::string, int> m_keys;
+        std::unordered_map<uint64_t, int> m_hashes;
+        int m_hits;
+        int m_misses;
+        size_t m_freedBytesSaved; // Savings of resources that have since been freed.
+    };
+} // namespace ORCore
@@ -1,29 +1,114 @@
 #include "config.hpp"
 #include <iostream>
 #include <stdexcept>
+#include <algorithm>
 
 #include <spdlog/spdlog.h>
 #include <glad/glad.h>
 #include "vfs.hpp"
 #include "shader.hpp"
+#include "glinfo.hpp"
+#include "stringutils.hpp"
+#include "profiler.hpp"
 
 namespace ORCore
 {
     static std::shared_ptr<spdlog::logger> logger;
     static int _programCount = 0;
 
-    Shader::Shader(ShaderInfo _info): info(_info)
+    static std::string preprocess_file(const std::string& path, std::vector<std::string>& included, int depth)
     {
+        if (depth > 16) {
+            throw std::runtime_error("Shader includes nested too deeply: " + path);
+        }
+        included.push_back(path);
+
+        std::string directory;
+        auto sep = path.find_last_of("/\\");
+        if (sep != std::string::npos) {
+            directory = path.substr(0, sep+1);
+        }
+
+        std::string output;
+        std::vector<std::string> lines = stringSplit(read_file(path), "\n");
+        for (size_t i = 0; i < lines.size(); i++)
+        {
+            const std::string &line = lines[i];
+            auto start = line.find_first_not_of(" \t");
+            if (start == std::string::npos || line.compare(start, 8, "#include") != 0) {
+                output += line;
+                output += '\n';
+                continue;
+            }
+
+            auto open = line.find('"', start);
+            auto close = open == std::string::npos ? open : line.find('"', open+1);
+            if (close == std::string::npos) {
+                throw std::runtime_error("Malformed #include in " + path + ": " + line);
+            }
+
+            // Each file is only included once, the same as #pragma once in c.
+            std::string includePath = directory + line.substr(open+1, close-open-1);
+            if (std::find(included.begin(), included.end(), includePath) == included.end()) {
+                output += "#line 1\n";
+                output += preprocess_file(includePath, included, depth+1);
+            }
+            // Keep error messages pointing at the right line in this file.
+            output += "#line " + std::to_string(i+2) + "\n";
+        }
+        return output;
+    }
+
+    std::string preprocess_shader(const std::string& path, const std::vector<std::string>& defines)
+    {
+        PROFILE_ZONE("preprocess_shader");
+        std::vector<std::string> included;
+        std::string source = preprocess_file(path, included, 0);
+
+        if (defines.empty()) {
+            return source;
+        }
+
+        // #version has to come first so defines go right after it.
+        std::string defineBlock;
+        for (auto &define : defines)
+        {
+            defineBlock += "#define " + define + "\n";
+        }
+
+        auto version = source.find("#version");
+        if (version == std::string::npos) {
+            return defineBlock + "#line 1\n" + source;
+        }
+        auto lineEnd = source.find('\n', version);
+        if (lineEnd == std::string::npos) {
+            return source + "\n" + defineBlock;
+        }
+        int versionLine = std::count(source.begin(), source.begin() + lineEnd, '\n') + 1;
+        source.insert(lineEnd+1, defineBlock + "#line " + std::to_string(versionLine+1) + "\n");
+        return source;
+    }
+
+    Shader::Shader(ShaderInfo _info): shader(0), info(_info)
+    {
+
+        logger = spdlog::get("default");
+        source = preprocess_shader(info.path, info.defines);
+    }
 
+    Shader::Shader(ShaderInfo _info, std::string shaderSource): shader(0), info(_info), source(std::move(shaderSource))
+    {
         logger = spdlog::get("default");
-        init_gl();
     }
 
     void Shader::init_gl()
     {
+        if (shader != 0) {
+            return;
+        }
+        PROFILE_ZONE("Shader::init_gl");
         shader = glCreateShader(info.type);
-        std::string data {read_file(info.path)};
-        const char *c_str = data.c_str();
+        const char *c_str = source.c_str();
 
         glShaderSource(shader, 1, &c_str, nullptr);
         glCompileShader(shader);
@@ -36,6 +121,9 @@ namespace ORCore
 
     void Shader::check_error()
     {
+        if (shader == 0) { // Never compiled, the program was loaded from a binary.
+            return;
+        }
         GLint status;
 
         glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
@@ -59,18 +147,57 @@ namespace ORCore
     }
 
 
-    ShaderProgram::ShaderProgram(Shader& vertex, Shader& fragment)
-    : m_vertex(vertex), m_fragment(fragment)
+    ShaderProgram::ShaderProgram(Shader& vertex, Shader& fragment, ProgramCache *cache, std::vector<std::string> feedbackVaryings)
+    : m_vertex(vertex), m_fragment(fragment), m_feedbackVaryings(std::move(feedbackVaryings)), m_cache(cache),
+      m_cacheKey(0), m_fromCache(false)
     {
+        PROFILE_ZONE("ShaderProgram link");
         logger = spdlog::get("default");
         _programCount++;
         m_programID = _programCount;
         m_program = glCreateProgram();
+        set_feedback_varyings();
+
+        if (m_cache != nullptr && m_cache->is_supported()) {
+            std::vector<std::string> sources {m_vertex.source, m_fragment.source};
+            if (!m_feedbackVaryings.empty()) {
+                // The same sources capturing different outputs link to a different program.
+                sources.push_back(stringJoin(m_feedbackVaryings, ","));
+            }
+            m_cacheKey = m_cache->make_key(sources);
+            m_fromCache = m_cache->load(m_program, m_cacheKey);
+
+            if (!m_fromCache) {
+                // Start over with a clean program object in case the driver rejected a binary.
+                glDeleteProgram(m_program);
+                m_program = glCreateProgram();
+                set_feedback_varyings();
+                glProgramParameteri(m_program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+            }
+        }
 
-        glAttachShader(m_program, m_vertex.shader);
-        glAttachShader(m_program, m_fragment.shader);
+        if (!m_fromCache) {
+            m_vertex.init_gl();
+            m_fragment.init_gl();
 
-        glLinkProgram(m_program);
+            glAttachShader(m_program, m_vertex.shader);
+            glAttachShader(m_program, m_fragment.shader);
+
+            glLinkProgram(m_program);
+        }
+    }
+
+    void ShaderProgram::set_feedback_varyings()
+    {
+        if (m_feedbackVaryings.empty()) {
+            return;
+        }
+        std::vector<const char*> names;
+        for (auto &name : m_feedbackVaryings)
+        {
+            names.push_back(name.c_str());
+        }
+        glTransformFeedbackVaryings(m_program, names.size(), names.data(), GL_INTERLEAVED_ATTRIBS);
     }
 
     ShaderProgram::~ShaderProgram()
@@ -85,6 +212,7 @@ namespace ORCore
 
     void ShaderProgram::check_error()
     {
+        PROFILE_ZONE("ShaderProgram::check_error");
         // We want to check the compile/link status of the shaders all at once.
         // At some place that isn't right after the shader compilation step.
         // That way the drivers can better parallelize shader compilation.
@@ -106,12 +234,27 @@ namespace ORCore
             logger->error(logData.get());
 
             throw std::runtime_error("Shader linkage failed.");
+        } else if (m_fromCache) {
+            logger->info("Shader loaded from program cache.");
         } else {
             logger->info("Shader linked sucessfully.");
+            if (m_cache != nullptr) {
+                m_cache->store(m_program, m_cacheKey);
+            }
         }
     }
 
 
+    bool ShaderProgram::is_ready(bool parallelCompile)
+    {
+        if (!parallelCompile || m_fromCache) {
+            return true;
+        }
+        GLint status = GL_FALSE;
+        glGetProgramiv(m_program, GL_COMPLETION_STATUS_KHR, &status);
+        return status == GL_TRUE;
+    }
+
     void ShaderProgram::use()
     {
         glUseProgram(m_program);
@@ -133,6 +276,14 @@ namespace ORCore
         return glGetUniformLocation(m_program, name.c_str());
     }
 
+    void ShaderProgram::bind_uniform_block(std::string name, unsigned int binding)
+    {
+        GLuint index = glGetUniformBlockIndex(m_program, name.c_str());
+        if (index != GL_INVALID_INDEX) {
+            glUniformBlockBinding(m_program, index, binding);
+        }
+    }
+
 
     void ShaderProgram::set_uniform(int uniform, int value)
     {
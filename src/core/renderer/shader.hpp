@@ -1,23 +1,33 @@
 #pragma once
 #include <string>
 #include <array>
+#include <vector>
 #include <glm/glm.hpp>
 
+#include "programcache.hpp"
+
 namespace ORCore
 {
     struct ShaderInfo
     {
         unsigned int type;
         std::string path;
+        std::vector<std::string> defines; // Added after #version when the source is preprocessed.
     };
 
+    // Reads a shader, resolving #include "file" relative to the including file and
+    // inserting a #define for each of the given defines.
+    std::string preprocess_shader(const std::string& path, const std::vector<std::string>& defines);
+
 
     struct Shader
     {
         unsigned int shader;
         ShaderInfo info;
+        std::string source;
         Shader(ShaderInfo);
-        void init_gl();
+        Shader(ShaderInfo, std::string shaderSource); // For sources that have already been read.
+        void init_gl(); // Compiles the shader, skipped entirely when the program comes from the cache.
         ~Shader();
         void check_error();
     };
@@ -25,19 +35,28 @@ namespace ORCore
     class ShaderProgram
     {
     public:
-        ShaderProgram(Shader& vertex, Shader& fragment);
+        // feedbackVaryings are captured interleaved by transform feedback, in that order.
+        ShaderProgram(Shader& vertex, Shader& fragment, ProgramCache *cache = nullptr,
+                      std::vector<std::string> feedbackVaryings = {});
         ~ShaderProgram();
 
         int get_id();
         
         void check_error();
 
+        // Polls GL_COMPLETION_STATUS_KHR so callers can do other work while the driver compiles.
+        // Always true when the driver can't compile in parallel.
+        bool is_ready(bool parallelCompile);
+
         void use();
         void disuse();
 
         int vertex_attribute(std::string name);
         int uniform_attribute(std::string name);
 
+        // Attaches a uniform block to a binding point, does nothing if the program doesn't use the block.
+        void bind_uniform_block(std::string name, unsigned int binding);
+
         void set_uniform(int uniform, int value);
         void set_uniform(int uniform, float value);
 
@@ -60,8 +79,13 @@ namespace ORCore
     private:
         Shader m_vertex;
         Shader m_fragment;
+        std::vector<std::string> m_feedbackVaryings;
         unsigned int m_program;
         int m_programID;
+        ProgramCache *m_cache;
+        uint64_t m_cacheKey;
+        bool m_fromCache;
 
+        void set_feedback_varyings();
     };
 } // namespace ORCore
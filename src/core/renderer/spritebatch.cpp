@@ -0,0 +1,137 @@
+#include "config.hpp"
+#include "spritebatch.hpp"
+#include "profiler.hpp"
+
+namespace ORCore
+{
+    uint32_t pack_color(const glm::vec4& color)
+    {
+        glm::vec4 clamped = glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f;
+        return static_cast<uint32_t>(clamped.r) |
+               static_cast<uint32_t>(clamped.g) << 8 |
+               static_cast<uint32_t>(clamped.b) << 16 |
+               static_cast<uint32_t>(clamped.a) << 24;
+    }
+
+    SpriteBatch::SpriteBatch(ShaderProgram *program, Texture *texture, int capacity, int id, RendererStats *stats)
+    : m_program(program), m_texture(texture), m_id(id), m_stats(stats), m_uvRectTexBuffer(GL_RGBA32F),
+      m_spritesDirty(false), m_uvRectsDirty(false)
+    {
+        m_sprites.reserve(capacity);
+        init_gl();
+
+        // Index 0 is always the whole texture.
+        add_uv_rect(glm::vec4{0.0f, 0.0f, 1.0f, 1.0f});
+    }
+
+    void SpriteBatch::init_gl()
+    {
+        m_texSampID = m_program->uniform_attribute("textureSampler");
+        m_uvRectTexID = m_program->uniform_attribute("uvRects");
+
+        glGenVertexArrays(1, &m_vao);
+        glBindVertexArray(m_vao);
+
+        glGenBuffers(1, &m_spriteBufferObject);
+        glBindBuffer(GL_ARRAY_BUFFER, m_spriteBufferObject);
+
+        // Every attribute advances once per instance, the six vertices of a quad all see the same sprite.
+        auto instanceAttrib = [this](const char *name, int size, GLenum type, GLboolean normalized, size_t offset) {
+            GLint loc = m_program->vertex_attribute(name);
+            if (loc == -1) {
+                return;
+            }
+            glEnableVertexAttribArray(loc);
+            if (type == GL_UNSIGNED_INT) {
+                glVertexAttribIPointer(loc, size, type, sizeof(Sprite), reinterpret_cast<void *>(offset));
+            } else {
+                glVertexAttribPointer(loc, size, type, normalized, sizeof(Sprite), reinterpret_cast<void *>(offset));
+            }
+            glVertexAttribDivisor(loc, 1);
+        };
+
+        instanceAttrib("spritePosition", 2, GL_FLOAT, GL_FALSE, offsetof(Sprite, position));
+        instanceAttrib("spriteSize", 2, GL_FLOAT, GL_FALSE, offsetof(Sprite, size));
+        instanceAttrib("spriteRotation", 1, GL_FLOAT, GL_FALSE, offsetof(Sprite, rotation));
+        instanceAttrib("spriteDepth", 1, GL_FLOAT, GL_FALSE, offsetof(Sprite, depth));
+        instanceAttrib("spriteUVRect", 1, GL_UNSIGNED_INT, GL_FALSE, offsetof(Sprite, uvRect));
+        instanceAttrib("spriteColor", 4, GL_UNSIGNED_BYTE, GL_TRUE, offsetof(Sprite, color));
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+
+        glGenBuffers(1, &m_uvRectBufferObject);
+    }
+
+    uint32_t SpriteBatch::add_uv_rect(const glm::vec4& rect)
+    {
+        m_uvRects.push_back(rect);
+        m_uvRectsDirty = true;
+        return m_uvRects.size() - 1;
+    }
+
+    std::vector<Sprite>& SpriteBatch::edit_sprites()
+    {
+        m_spritesDirty = true;
+        return m_sprites;
+    }
+
+    const std::vector<Sprite>& SpriteBatch::get_sprites()
+    {
+        return m_sprites;
+    }
+
+    void SpriteBatch::commit()
+    {
+        if (m_uvRectsDirty) {
+            glBindBuffer(GL_TEXTURE_BUFFER, m_uvRectBufferObject);
+            glBufferData(GL_TEXTURE_BUFFER, m_uvRects.size()*sizeof(glm::vec4), &m_uvRects[0], GL_STATIC_DRAW);
+            glBindBuffer(GL_TEXTURE_BUFFER, 0);
+            m_uvRectTexBuffer.assign_buffer(m_uvRectBufferObject);
+            m_uvRectsDirty = false;
+        }
+
+        if (m_spritesDirty && !m_sprites.empty()) {
+            PROFILE_ZONE("SpriteBatch::commit");
+            // A single upload of the whole array, giving the driver a fresh buffer each
+            // time so we never wait on last frame's draw.
+            glBindBuffer(GL_ARRAY_BUFFER, m_spriteBufferObject);
+            glBufferData(GL_ARRAY_BUFFER, m_sprites.size()*sizeof(Sprite), &m_sprites[0], GL_STREAM_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+            m_stats->spriteBytes += m_sprites.size()*sizeof(Sprite);
+        }
+        m_spritesDirty = false;
+    }
+
+    void SpriteBatch::render()
+    {
+        if (m_sprites.empty()) {
+            m_stats->batchesSkipped++;
+            return;
+        }
+
+        glBindVertexArray(m_vao);
+
+        if (m_texSampID != -1 && m_texture->bind(m_texSampID)) {
+            m_stats->textureBinds++;
+        }
+        if (m_uvRectTexID != -1) {
+            m_uvRectTexBuffer.bind(m_uvRectTexID);
+        }
+
+        glDrawArraysInstanced(GL_TRIANGLES, 0, 6, m_sprites.size());
+
+        m_stats->drawCalls++;
+        m_stats->batchesDrawn++;
+        m_stats->sprites += m_sprites.size();
+        m_stats->vertices += m_sprites.size()*6;
+    }
+
+    SpriteBatch::~SpriteBatch()
+    {
+        glDeleteBuffers(1, &m_spriteBufferObject);
+        glDeleteBuffers(1, &m_uvRectBufferObject);
+        glDeleteVertexArrays(1, &m_vao);
+    }
+} // namespace ORCore
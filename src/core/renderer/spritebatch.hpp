@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader.hpp"
+#include "texture.hpp"
+#include "stats.hpp"
+
+namespace ORCore
+{
+    // One sprite as it is stored on the gpu, 32 bytes.
+    struct Sprite
+    {
+        glm::vec2 position; // Center of the sprite.
+        glm::vec2 size;
+        float rotation; // Radians around the center.
+        float depth;
+        uint32_t uvRect; // Index of a rect added with SpriteBatch::add_uv_rect
+        uint32_t color; // RGBA8 from pack_color, red in the lowest byte.
+    };
+    static_assert(sizeof(Sprite) == 32, "Sprite records must stay 32 bytes.");
+
+    uint32_t pack_color(const glm::vec4& color);
+
+    // Draws textured rectangles straight from an array of Sprite records.
+    // Each record is an instance, the vertex shader builds the quad corners from
+    // gl_VertexID so there is no per-vertex data or matrix buffer at all.
+    class SpriteBatch
+    {
+    public:
+        SpriteBatch(ShaderProgram *program, Texture *texture, int capacity, int id, RendererStats *stats);
+
+        // Rect is min uv in xy and max uv in zw, returns the index sprites refer to it by.
+        uint32_t add_uv_rect(const glm::vec4& rect);
+
+        // Sprites can be changed in place, the whole array is uploaded again by the next commit().
+        std::vector<Sprite>& edit_sprites();
+        const std::vector<Sprite>& get_sprites();
+
+        void commit();
+        void render();
+        ~SpriteBatch();
+
+        int get_id()
+        {
+            return m_id;
+        }
+
+        ShaderProgram* get_program()
+        {
+            return m_program;
+        }
+
+    private:
+        // Only run by the constructor, a second call would leak the vao and buffers.
+        void init_gl();
+
+        ShaderProgram *m_program;
+        Texture *m_texture;
+        int m_id;
+        RendererStats *m_stats;
+        BufferTexture m_uvRectTexBuffer;
+        GLint m_texSampID;
+        GLint m_uvRectTexID;
+
+        GLuint m_vao;
+        GLuint m_spriteBufferObject;
+        GLuint m_uvRectBufferObject;
+
+        bool m_spritesDirty;
+        bool m_uvRectsDirty;
+        std::vector<Sprite> m_sprites;
+        std::vector<glm::vec4> m_uvRects;
+    };
+} // namespace ORCore
@@ -0,0 +1,91 @@
+#include "config.hpp"
+#include "stats.hpp"
+
+namespace ORCore
+{
+    StatsWriter::StatsWriter(std::string filename, StatsFormat format)
+    : m_out(filename), m_format(format)
+    {
+        if (m_out && m_format == StatsFormat::CSV) {
+            m_out << "frame,ms,draw_calls,batches_drawn,batches_skipped,vertices,sprites,"
+                  << "vertex_bytes,matrix_bytes,index_bytes,uniform_bytes,sprite_bytes,texture_upload_bytes,"
+                  << "texture_resident_bytes,texture_evictions,texture_reloads,virtual_tile_uploads,virtual_tiles_resident,"
+                  << "program_binds,texture_binds,samples_passed,overdraw,"
+                  << "batch_lookups,batch_creations,"
+                  << "gpu_frame,gpu_frame_ms,gpu_commit_ms,gpu_particle_ms,gpu_sprite_ms,gpu_composite_ms,gpu_feedback_ms,gpu_batch_ms,gpu_slowest_batch,gpu_slowest_batch_ms\n";
+        }
+    }
+
+    bool StatsWriter::is_open()
+    {
+        return static_cast<bool>(m_out);
+    }
+
+    void StatsWriter::write(int frame, double frameTime, const RendererStats& stats)
+    {
+        if (!m_out) {
+            return;
+        }
+
+        if (m_format == StatsFormat::CSV) {
+            m_out << frame << ',' << frameTime << ','
+                  << stats.drawCalls << ',' << stats.batchesDrawn << ',' << stats.batchesSkipped << ','
+                  << stats.vertices << ',' << stats.sprites << ','
+                  << stats.vertexBytes << ',' << stats.matrixBytes << ',' << stats.indexBytes << ',' << stats.uniformBytes << ',' << stats.spriteBytes << ','
+                  << stats.textureUploadBytes << ',' << stats.textureResidentBytes << ',' << stats.textureEvictions << ',' << stats.textureReloads << ','
+                  << stats.virtualTileUploads << ',' << stats.virtualTilesResident << ','
+                  << stats.programBinds << ',' << stats.textureBinds << ','
+                  << stats.samplesPassed << ',' << stats.overdraw << ','
+                  << stats.batchLookups << ',' << stats.batchCreations << ','
+                  << stats.gpuFrame << ',' << stats.gpuFrameTime << ',' << stats.gpuCommitTime << ','
+                  << stats.gpuParticleTime << ',' << stats.gpuSpriteTime << ',' << stats.gpuCompositeTime << ',' << stats.gpuFeedbackTime << ','
+                  << stats.gpuBatchTime << ',' << stats.gpuSlowestBatch << ',' << stats.gpuSlowestBatchTime << '\n';
+        } else {
+            m_out << "{\"frame\":" << frame
+                  << ",\"ms\":" << frameTime
+                  << ",\"draw_calls\":" << stats.drawCalls
+                  << ",\"batches_drawn\":" << stats.batchesDrawn
+                  << ",\"batches_skipped\":" << stats.batchesSkipped
+                  << ",\"vertices\":" << stats.vertices
+                  << ",\"sprites\":" << stats.sprites
+                  << ",\"vertex_bytes\":" << stats.vertexBytes
+                  << ",\"matrix_bytes\":" << stats.matrixBytes
+                  << ",\"index_bytes\":" << stats.indexBytes
+                  << ",\"uniform_bytes\":" << stats.uniformBytes
+                  << ",\"sprite_bytes\":" << stats.spriteBytes
+                  << ",\"texture_upload_bytes\":" << stats.textureUploadBytes
+                  << ",\"texture_resident_bytes\":" << stats.textureResidentBytes
+                  << ",\"texture_evictions\":" << stats.textureEvictions
+                  << ",\"texture_reloads\":" << stats.textureReloads
+                  << ",\"virtual_tile_uploads\":" << stats.virtualTileUploads
+                  << ",\"virtual_tiles_resident\":" << stats.virtualTilesResident
+                  << ",\"program_binds\":" << stats.programBinds
+                  << ",\"texture_binds\":" << stats.textureBinds
+                  << ",\"samples_passed\":" << stats.samplesPassed
+                  << ",\"overdraw\":" << stats.overdraw
+                  << ",\"batch_lookups\":" << stats.batchLookups
+                  << ",\"batch_creations\":" << stats.batchCreations
+                  << ",\"gpu_frame\":" << stats.gpuFrame
+                  << ",\"gpu_frame_ms\":" << stats.gpuFrameTime
+                  << ",\"gpu_commit_ms\":" << stats.gpuCommitTime
+                  << ",\"gpu_particle_ms\":" << stats.gpuParticleTime
+                  << ",\"gpu_sprite_ms\":" << stats.gpuSpriteTime
+                  << ",\"gpu_composite_ms\":" << stats.gpuCompositeTime
+                  << ",\"gpu_feedback_ms\":" << stats.gpuFeedbackTime
+                  << ",\"gpu_batch_ms\":" << stats.gpuBatchTime
+                  << ",\"gpu_slowest_batch\":" << stats.gpuSlowestBatch
+                  << ",\"gpu_slowest_batch_ms\":" << stats.gpuSlowestBatchTime
+                  << "}\n";
+        }
+    }
+
+    StatsFormat StatsWriter::format_from_path(const std::string& filename)
+    {
+        const std::string ext = ".json";
+        if (filename.size() >= ext.size() &&
+            filename.compare(filename.size() - ext.size(), ext.size(), ext) == 0) {
+            return StatsFormat::JSON;
+        }
+        return StatsFormat::CSV;
+    }
+} // namespace ORCore
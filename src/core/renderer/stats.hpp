@@ -0,0 +1,90 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <fstream>
+
+namespace ORCore
+{
+    // Counters for everything the renderer does in a frame.
+    // These are reset by Renderer::end_frame().
+    struct RendererStats
+    {
+        int drawCalls = 0;
+        int batchesDrawn = 0;
+        int batchesSkipped = 0; // Batches with nothing in them.
+        uint64_t vertices = 0;
+        uint64_t sprites = 0;
+
+        // Bytes uploaded per buffer type.
+        uint64_t vertexBytes = 0;
+        uint64_t matrixBytes = 0;
+        uint64_t indexBytes = 0;
+        uint64_t uniformBytes = 0;
+        uint64_t spriteBytes = 0;
+        uint64_t textureUploadBytes = 0; // Streamed texture data, see Renderer::request_texture
+
+        // See TextureResidency, resident bytes include textures that can't be evicted.
+        uint64_t textureResidentBytes = 0;
+        int textureEvictions = 0;
+        int textureReloads = 0;
+
+        // See VirtualTexture, the uploaded tiles are counted in textureUploadBytes too.
+        int virtualTileUploads = 0;
+        int virtualTilesResident = 0;
+
+        int programBinds = 0;
+        int textureBinds = 0;
+
+        // Only filled in when overdraw debugging is on.
+        uint64_t samplesPassed = 0;
+        double overdraw = 0.0; // Samples passed per pixel of the viewport.
+
+        int batchLookups = 0; // Calls to Renderer::find_batch
+        int batchCreations = 0;
+
+        // Gpu times in milliseconds when gpu timing is enabled. Timer queries are read back
+        // a few frames late so these belong to gpuFrame rather than the current frame.
+        int gpuFrame = -1;
+        double gpuFrameTime = 0.0;
+        double gpuCommitTime = 0.0;
+        double gpuParticleTime = 0.0;
+        double gpuSpriteTime = 0.0;
+        double gpuCompositeTime = 0.0;
+        double gpuFeedbackTime = 0.0;
+        double gpuBatchTime = 0.0; // Sum over all batches.
+        int gpuSlowestBatch = -1;
+        double gpuSlowestBatchTime = 0.0;
+
+        void reset()
+        {
+            *this = RendererStats();
+        }
+
+        uint64_t bytes_uploaded() const
+        {
+            return vertexBytes + matrixBytes + indexBytes + uniformBytes + spriteBytes + textureUploadBytes;
+        }
+    };
+
+    enum class StatsFormat
+    {
+        CSV,
+        JSON, // One json object per line.
+    };
+
+    // Writes per-frame renderer stats out to a file for looking at trends over time.
+    class StatsWriter
+    {
+    public:
+        StatsWriter(std::string filename, StatsFormat format);
+        bool is_open();
+        void write(int frame, double frameTime, const RendererStats& stats);
+
+        // Picks the format based on the file extension, defaulting to csv.
+        static StatsFormat format_from_path(const std::string& filename);
+
+    private:
+        std::ofstream m_out;
+        StatsFormat m_format;
+    };
+} // namespace ORCore
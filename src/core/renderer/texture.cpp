@@ -1,8 +1,17 @@
 #include "config.hpp"
 #include "texture.hpp"
 #include <iostream>
+#include <cstdlib>
+#include <algorithm>
+
+#if defined(ENABLE_SSSE3) && defined(_MSC_VER)
+#   include <intrin.h>
+#endif
 
 #include "vfs.hpp"
+#include "texturecompress.hpp"
+#include "glinfo.hpp"
+#include "profiler.hpp"
 
 #define STB_IMAGE_IMPLEMENTATION
 #define STBI_NO_STDIO
@@ -23,59 +32,104 @@
 
 namespace ORCore
 {
-    // TODO - This doesn't really fit here anymore, should find a better place for it.
-    //        Could call it asset loaders or something smf could be moved there as well.
-    Image loadSTB(std::string filename)
+    void PixelDeleter::operator()(unsigned char *pixels) const
     {
-        std::string mem_buf = ORCore::read_file( filename, FileMode::Binary );
+        std::free(pixels);
+    }
 
-        Image imgData;
+    PixelBuffer allocate_pixels(size_t size)
+    {
+        return PixelBuffer(static_cast<unsigned char*>(std::malloc(size)));
+    }
 
-        auto conv_mem = std::make_unique<unsigned char[]>( mem_buf.size() );
+#if defined(ENABLE_SSSE3)
+    // In texturessse3.cpp, the only file built with SSSE3 code generation.
+    size_t expand_to_rgba_ssse3(const unsigned char *src, unsigned char *dst, size_t pixels, int comp);
+
+    static bool cpu_has_ssse3()
+    {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 9)) != 0;
+#else
+        return __builtin_cpu_supports("ssse3");
+#endif
+    }
+#endif
+
+    // Expands tightly packed 1, 2 or 3 channel pixels to RGBA in one row-major pass.
+    static void expand_to_rgba(const unsigned char *src, unsigned char *dst, size_t pixels, int comp)
+    {
+        size_t i = 0;
+#if defined(ENABLE_SSSE3)
+        static const bool ssse3 = cpu_has_ssse3();
+        if (ssse3) {
+            i = expand_to_rgba_ssse3(src, dst, pixels, comp);
+        }
+#endif
+        // Whatever is left over, or everything without SSSE3.
+        for (; i < pixels; i++)
+        {
+            const unsigned char *s = src + i*comp;
+            unsigned char *d = dst + i*4;
+            if (comp >= 3) {
+                d[0] = s[0];
+                d[1] = s[1];
+                d[2] = s[2];
+            } else {
+                d[0] = d[1] = d[2] = s[0];
+            }
+            d[3] = (comp == 2) ? s[1] : 255U;
+        }
+    }
 
-        // to prevent potential issues convert each value seperately
-        // one could cast the int* to unsigned int* however this could have large issues there can be
-        // platform differances on how this is imeplemented.
-        for (size_t i = 0; i < mem_buf.size(); i++) {
-            conv_mem[i] = static_cast<unsigned char>(mem_buf[i]);
+    // TODO - This doesn't really fit here anymore, should find a better place for it.
+    //        Could call it asset loaders or something smf could be moved there as well.
+    Image loadSTB(std::string filename, int components)
+    {
+        // stb decodes straight out of the mapping so the file is never copied.
+        MappedFile file(filename);
+        if (!file.is_open()) {
+            std::cout << "Failed to get image data" << std::endl;
+            Image imgData;
+            imgData.path = filename;
+            return imgData;
         }
+        return loadSTB(file.data(), file.size(), filename, components);
+    }
 
-        unsigned char *img_buf;
-        int comp;
+    Image loadSTB(const unsigned char *data, size_t size, std::string filename, int components)
+    {
+        PROFILE_ZONE("loadSTB");
+        Image imgData;
+        imgData.path = filename;
 
-        img_buf = stbi_load_from_memory( &conv_mem[0], mem_buf.size(), &imgData.width, &imgData.height, &comp, 0 );
+        int comp;
+        unsigned char *img_buf = stbi_load_from_memory(data, size, &imgData.width, &imgData.height, &comp, 0);
 
         if ( img_buf == nullptr )
         {
             std::cout << "Failed to get image data" << std::endl;
+            imgData.width = imgData.height = 0;
+            return imgData;
         }
 
+        size_t pixels = static_cast<size_t>(imgData.width) * imgData.height;
 
-        imgData.length = imgData.width * imgData.height * 4;
-		imgData.pixelData = std::make_unique<unsigned char[]>(imgData.length);
-
-        // We have to copy the data out of the returned data from stb.
-        // This was an issue with the previous implementation where the data was destroyed before
-        // opengl could copy the data to the gpu. OpenGL may even require the image data to be persistant
-        // cpu side if not it may be a good idea to do so anyways.
-        int i, j;
-        // currently the main reason the loop is setup like this, is that it makes it a bit easier to convert RGB to RGBA.
-        for (int x = 0;x < imgData.width; x++) {
-            for (int y = 0; y < imgData.height; y++) {
-                i = 4 * (y * imgData.width + x);
-                j = comp * (y * imgData.width + x);
-                imgData.pixelData[i+0] = img_buf[j+0];
-                imgData.pixelData[i+1] = img_buf[j+1];
-                imgData.pixelData[i+2] = img_buf[j+2];
-                if (comp == 4) {
-                    imgData.pixelData[i+3] = img_buf[j+3];
-                } else {
-                    imgData.pixelData[i+3] = 255U;
-                }
-            }
+        if (components == 4 && comp != 4) {
+            imgData.components = 4;
+            imgData.length = pixels * 4;
+            imgData.pixelData = allocate_pixels(imgData.length);
+            expand_to_rgba(img_buf, imgData.pixelData.get(), pixels, comp);
+            stbi_image_free( img_buf );
+        } else {
+            // Keep stb's buffer as is.
+            imgData.components = comp;
+            imgData.length = pixels * comp;
+            imgData.pixelData.reset(img_buf);
         }
-        stbi_image_free( img_buf );
-        return std::move(imgData);
+        return imgData;
     }
 
 
@@ -97,10 +151,12 @@ namespace ORCore
         unbind();
     }
 
-    void TextureBase::bind(GLuint location)
+    bool TextureBase::bind(GLuint location)
     {
+        bool bound = false;
         if (m_texIsBound == false)
         {
+            bound = true;
             m_texBindingPoint = aquire_bindpoint();
             m_texIsBound = true;
 
@@ -110,6 +166,7 @@ namespace ORCore
         }
 
         glUniform1i(location, m_texBindingPoint);
+        return bound;
     }
 
     void TextureBase::unbind()
@@ -131,6 +188,14 @@ namespace ORCore
         return m_texID;
     }
 
+    // Unit 0 is never handed out as a bindpoint so it's free for creating and uploading
+    // textures without knocking out the ones that stay bound between draws.
+    void TextureBase::bind_for_update()
+    {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(m_texTargetType, m_oglTexID);
+    }
+
     GLenum TextureBase::aquire_bindpoint()
     {
         GLenum rtnPoint;
@@ -153,16 +218,42 @@ namespace ORCore
     }
 
     Texture::Texture(GLenum targetType)
-    :TextureBase(targetType)
+    :TextureBase(targetType), m_texFormat(GL_RGBA8), m_pixelFormat(GL_RGBA), m_width(0), m_height(0), m_components(4), m_levels(1),
+     m_memorySize(0), m_mipmaps(true), m_filtered(true), m_loaded(false), m_placeholder(nullptr), m_previousTexID(0), m_lastBound(0), m_uploadCount(0)
     {
         init_gl();
     }
 
+    Texture::~Texture()
+    {
+        glDeleteTextures(1, &m_oglTexID);
+        if (m_previousTexID != 0) {
+            glDeleteTextures(1, &m_previousTexID);
+        }
+    }
+
+    uint64_t Texture::sm_frame = 0;
+
+    void Texture::set_frame(uint64_t frame)
+    {
+        sm_frame = frame;
+    }
+
+    void Texture::set_mipmaps(bool mipmaps)
+    {
+        m_mipmaps = mipmaps;
+    }
+
+    void Texture::set_filtered(bool filtered)
+    {
+        m_filtered = filtered;
+    }
+
 
     void Texture::init_gl()
     {
         glGenTextures(1, &m_oglTexID);
-        glBindTexture(m_texTargetType, m_oglTexID);
+        bind_for_update();
         glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
         glTexParameteri(m_texTargetType, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
         glTexParameteri(m_texTargetType, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
@@ -171,9 +262,207 @@ namespace ORCore
 
     void Texture::update_image_data(Image& img)
     {
-        glBindTexture(m_texTargetType, m_oglTexID);
-        glTexImage2D(m_texTargetType, 0, GL_RGBA, img.width, img.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, &(img.pixelData.get())[0]);
-        glGenerateMipmap(m_texTargetType);
+        const unsigned char *pixels = img.pixelData.get();
+        int components = img.components;
+
+        // Swizzles are core in 3.3, without them gray images are expanded to RGBA instead.
+        PixelBuffer expanded;
+        if (components < 3 && !has_texture_swizzle()) {
+            size_t count = static_cast<size_t>(img.width) * img.height;
+            expanded = allocate_pixels(count * 4);
+            expand_to_rgba(pixels, expanded.get(), count, components);
+            pixels = expanded.get();
+            components = 4;
+        }
+
+        allocate(img.width, img.height, components);
+        upload_rows(0, img.height, pixels);
+        finish_upload();
+    }
+
+    void Texture::allocate(int width, int height, int components)
+    {
+        GLint swizzle[4] = {GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA};
+        switch (components)
+        {
+            case 1:
+                m_texFormat = GL_R8;
+                m_pixelFormat = GL_RED;
+                swizzle[1] = swizzle[2] = GL_RED;
+                swizzle[3] = GL_ONE;
+                break;
+            case 2:
+                m_texFormat = GL_RG8;
+                m_pixelFormat = GL_RG;
+                swizzle[1] = swizzle[2] = GL_RED;
+                swizzle[3] = GL_GREEN;
+                break;
+            case 3:
+                m_texFormat = GL_RGB8;
+                m_pixelFormat = GL_RGB;
+                break;
+            default:
+                m_texFormat = GL_RGBA8;
+                m_pixelFormat = GL_RGBA;
+                break;
+        }
+        begin_replace();
+        m_width = width;
+        m_height = height;
+        m_components = components;
+        m_levels = 1;
+        m_loaded = false;
+
+        bind_for_update();
+        glTexImage2D(m_texTargetType, 0, m_texFormat, width, height, 0, m_pixelFormat, GL_UNSIGNED_BYTE, nullptr);
+        if (components < 3) {
+            glTexParameteriv(m_texTargetType, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+        }
+
+        // A full mip chain adds about a third on top of the base level.
+        size_t baseSize = static_cast<size_t>(width) * height * components;
+        m_memorySize = m_mipmaps ? baseSize + baseSize / 3 : baseSize;
+    }
+
+    void Texture::upload_rows(int y, int rows, const void *pixels)
+    {
+        bind_for_update();
+        glTexSubImage2D(m_texTargetType, 0, 0, y, m_width, rows, m_pixelFormat, GL_UNSIGNED_BYTE, pixels);
+    }
+
+    void Texture::upload_level(int level, int width, int height, const void *pixels)
+    {
+        bind_for_update();
+        glTexImage2D(m_texTargetType, level, m_texFormat, width, height, 0, m_pixelFormat, GL_UNSIGNED_BYTE, pixels);
+        m_levels = std::max(m_levels, level + 1);
+    }
+
+    void Texture::upload_region(int level, int x, int y, int width, int height, int rowLength, const void *pixels)
+    {
+        bind_for_update();
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, rowLength);
+        glTexSubImage2D(m_texTargetType, level, x, y, width, height, m_pixelFormat, GL_UNSIGNED_BYTE, pixels);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    }
+
+    void Texture::allocate_compressed(int width, int height, BlockFormat format)
+    {
+        m_texFormat = format == BlockFormat::BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        begin_replace();
+        m_width = width;
+        m_height = height;
+        m_levels = 1;
+        m_loaded = false;
+
+        size_t baseSize = compressed_size(format, width, height);
+        m_memorySize = baseSize + baseSize / 3;
+    }
+
+    void Texture::upload_compressed_level(int level, int width, int height, const void *blocks, size_t size)
+    {
+        bind_for_update();
+        glCompressedTexImage2D(m_texTargetType, level, m_texFormat, width, height, 0, size, blocks);
+        m_levels = std::max(m_levels, level + 1);
+    }
+
+    // Replacing a loaded texture goes into a new gl texture so the old contents can keep
+    // being drawn until finish_upload swaps them over.
+    void Texture::begin_replace()
+    {
+        if (m_loaded && m_previousTexID == 0) {
+            m_previousTexID = m_oglTexID;
+            init_gl();
+        }
+    }
+
+    void Texture::finish_upload()
+    {
+        bind_for_update();
+        glTexParameteri(m_texTargetType, GL_TEXTURE_MIN_FILTER, m_filtered ? GL_LINEAR_MIPMAP_NEAREST : GL_NEAREST);
+        if (m_levels > 1 || is_compressed() || !m_mipmaps) {
+            glTexParameteri(m_texTargetType, GL_TEXTURE_MAX_LEVEL, m_levels - 1);
+        } else {
+            glTexParameteri(m_texTargetType, GL_TEXTURE_MAX_LEVEL, 1000);
+            glGenerateMipmap(m_texTargetType);
+        }
+
+        if (m_previousTexID != 0) {
+            if (m_texIsBound) {
+                glActiveTexture(GL_TEXTURE0 + m_texBindingPoint);
+                glBindTexture(m_texTargetType, m_oglTexID);
+                glActiveTexture(GL_TEXTURE0);
+            }
+            glDeleteTextures(1, &m_previousTexID);
+            m_previousTexID = 0;
+        }
+        m_loaded = true;
+        m_uploadCount++;
+    }
+
+    size_t Texture::evict()
+    {
+        if (!m_loaded) {
+            return 0;
+        }
+        size_t before = m_memorySize;
+
+        // Start again with an empty texture.
+        unbind();
+        glDeleteTextures(1, &m_oglTexID);
+        init_gl();
+        m_memorySize = 0;
+        m_loaded = false;
+        return before;
+    }
+
+    bool Texture::is_compressed()
+    {
+        return m_texFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || m_texFormat == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    }
+
+    void Texture::set_placeholder(Texture *placeholder)
+    {
+        m_placeholder = placeholder;
+    }
+
+    bool Texture::bind(GLuint location)
+    {
+        m_lastBound = sm_frame;
+        if (!m_loaded && m_previousTexID != 0) {
+            // Still replacing the contents, keep drawing the old ones.
+            std::swap(m_oglTexID, m_previousTexID);
+            bool bound = TextureBase::bind(location);
+            std::swap(m_oglTexID, m_previousTexID);
+            return bound;
+        }
+        if (!m_loaded && m_placeholder != nullptr) {
+            return m_placeholder->bind(location);
+        }
+        return TextureBase::bind(location);
+    }
+
+    bool has_texture_swizzle()
+    {
+        return GLAD_GL_VERSION_3_3 || has_gl_extension("GL_ARB_texture_swizzle");
+    }
+
+    bool has_texture_compression()
+    {
+        return has_gl_extension("GL_EXT_texture_compression_s3tc");
+    }
+
+    const char* texture_format_name(GLenum format)
+    {
+        switch (format)
+        {
+            case GL_R8: return "R8";
+            case GL_RG8: return "RG8";
+            case GL_RGB8: return "RGB8";
+            case GL_RGBA8: return "RGBA8";
+            case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: return "BC1";
+            case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return "BC3";
+            default: return "unknown";
+        }
     }
 
     BufferTexture::BufferTexture(GLenum bufferType)
@@ -189,7 +478,7 @@ namespace ORCore
 
     void BufferTexture::assign_buffer(GLuint buffer)
     {
-        glBindTexture(m_texTargetType, m_oglTexID);
+        bind_for_update();
         glTexBuffer(m_texTargetType, m_bufferType, buffer);
     }
 
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <string>
 #include <memory>
 #include <vector>
@@ -6,29 +7,55 @@
 
 #include "shader.hpp"
 
+// S3TC isn't core so glad doesn't have these.
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#   define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#   define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
 namespace ORCore
 {
 
+    // Pixel data is malloc'd so buffers decoded by stb can be kept without a copy.
+    struct PixelDeleter
+    {
+        void operator()(unsigned char *pixels) const;
+    };
+    using PixelBuffer = std::unique_ptr<unsigned char[], PixelDeleter>;
+
+    PixelBuffer allocate_pixels(size_t size);
+
     struct Image
     {
         std::string path;
-        int width;
-        int height;
-        std::unique_ptr<unsigned char[]> pixelData;
-        int length;
+        int width = 0;
+        int height = 0;
+        int components = 4; // Channels per pixel, 1 to 4.
+        PixelBuffer pixelData;
+        int length = 0;
     };
 
-    Image loadSTB(std::string filename);
+    // Images keep the channel count stored in the file unless components asks for a
+    // specific one, only expanding to RGBA (4) is supported.
+    Image loadSTB(std::string filename, int components = 0);
+
+    // The same for a file that's already mapped or read, filename is only recorded in the image.
+    Image loadSTB(const unsigned char *data, size_t size, std::string filename, int components = 0);
+
+    enum class BlockFormat;
 
     class TextureBase
     {
     public:
         TextureBase(GLenum targetType);
         virtual ~TextureBase();
-        void bind(GLuint location);
+        bool bind(GLuint location); // Returns true if the texture had to be bound.
         void unbind();
         int get_id(); // Internal texture ID
     protected:
+        void bind_for_update();
         GLenum aquire_bindpoint();
         void release_bindpoint(GLenum bindpoint);
 
@@ -47,13 +74,84 @@ namespace ORCore
     {
     public:
         Texture(GLenum targetType);
+        ~Texture();
         void init_gl();
+
+        // Textures only sampled at their full size can skip the mip chain, set it before allocate.
+        void set_mipmaps(bool mipmaps);
+
+        // Textures holding data rather than color can turn filtering off, set it before finish_upload.
+        void set_filtered(bool filtered);
+
+        // Picks R8/RG8/RGB8/RGBA8 from the image's channel count. One and two channel
+        // images are swizzled so shaders still see gray in rgb, and alpha in a.
         void update_image_data(Image& img);
+
+        // Uploading in pieces, update_image_data does all three at once. Pixels can be
+        // an offset into a bound GL_PIXEL_UNPACK_BUFFER. Rows are tightly packed.
+        void allocate(int width, int height, int components);
+        void upload_rows(int y, int rows, const void *pixels);
+        // Supplies a whole mip level, when any are given finish_upload won't generate them.
+        void upload_level(int level, int width, int height, const void *pixels);
+
+        // Replaces part of a level that has already been uploaded. rowLength is the width in
+        // texels of the image pixels points into, so a region can be sent without copying it out.
+        void upload_region(int level, int x, int y, int width, int height, int rowLength, const void *pixels);
+
+        // The same for block compressed data, every level has to be supplied.
+        void allocate_compressed(int width, int height, BlockFormat format);
+        void upload_compressed_level(int level, int width, int height, const void *blocks, size_t size);
+        void finish_upload();
+
+        // Until the texture is loaded the placeholder is bound in its place. When loaded
+        // contents are being replaced the old ones are bound until finish_upload.
+        void set_placeholder(Texture *placeholder);
+        bool bind(GLuint location);
+        bool is_loaded() { return m_loaded; }
+        bool is_compressed();
+
+        // Frees the texture's memory, the placeholder is drawn until it's uploaded again.
+        // Returns the bytes freed.
+        size_t evict();
+
+        // Textures remember the frame they were last bound in, for picking what to evict.
+        static void set_frame(uint64_t frame);
+        uint64_t get_last_bound() { return m_lastBound; }
+        int get_upload_count() { return m_uploadCount; } // Times finish_upload has been called.
+
+        int get_width() { return m_width; }
+        int get_height() { return m_height; }
+        GLenum get_format() { return m_texFormat; }
+        size_t get_memory_size() { return m_memorySize; } // Estimated, including mipmaps.
     private:
+        void begin_replace();
+
+        static uint64_t sm_frame;
 
         GLenum m_texFormat;
+        GLenum m_pixelFormat;
+        int m_width;
+        int m_height;
+        int m_components;
+        int m_levels; // Mip levels supplied by upload_level, including the base.
+        size_t m_memorySize;
+        bool m_mipmaps;
+        bool m_filtered;
+        bool m_loaded;
+        Texture *m_placeholder;
+        GLuint m_previousTexID; // Contents being replaced, see begin_replace.
+        uint64_t m_lastBound;
+        int m_uploadCount;
     };
 
+    // False when one and two channel images have to be expanded to RGBA before upload.
+    bool has_texture_swizzle();
+
+    // False when BC1/BC3 textures have to be decompressed before upload.
+    bool has_texture_compression();
+
+    const char* texture_format_name(GLenum format);
+
     class BufferTexture : public TextureBase
     {
     public:
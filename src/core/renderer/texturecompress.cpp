@@ -0,0 +1,504 @@
+#include "config.hpp"
+#include "texturecompress.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   define TEXTURECOMPRESS_SSE
+#   include <emmintrin.h>
+#endif
+
+#include "profiler.hpp"
+#include "workerpool.hpp"
+
+namespace ORCore
+{
+    size_t block_size(BlockFormat format)
+    {
+        return format == BlockFormat::BC1 ? 8 : 16;
+    }
+
+    size_t compressed_size(BlockFormat format, int width, int height)
+    {
+        size_t blocksX = (width + 3) / 4;
+        size_t blocksY = (height + 3) / 4;
+        return blocksX * blocksY * block_size(format);
+    }
+
+    // Reads a 4x4 block out as RGBA, edges are clamped for images that aren't a multiple of 4.
+    static void fetch_block(const unsigned char *pixels, int width, int height, int components,
+                            int blockX, int blockY, unsigned char *rgba)
+    {
+        for (int y = 0; y < 4; y++)
+        {
+            int sy = std::min(blockY * 4 + y, height - 1);
+            for (int x = 0; x < 4; x++)
+            {
+                int sx = std::min(blockX * 4 + x, width - 1);
+                const unsigned char *src = pixels + (static_cast<size_t>(sy) * width + sx) * components;
+                unsigned char *dst = rgba + (y * 4 + x) * 4;
+                if (components >= 3) {
+                    dst[0] = src[0];
+                    dst[1] = src[1];
+                    dst[2] = src[2];
+                } else {
+                    dst[0] = dst[1] = dst[2] = src[0];
+                }
+                dst[3] = (components == 2 || components == 4) ? src[components - 1] : 255U;
+            }
+        }
+    }
+
+    // Per channel min and max over the 16 texels of a block.
+    static void block_bounds(const unsigned char *rgba, unsigned char *minColor, unsigned char *maxColor)
+    {
+#if defined(TEXTURECOMPRESS_SSE)
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba));
+        __m128i hi = lo;
+        for (int row = 1; row < 4; row++)
+        {
+            __m128i texels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + row * 16));
+            lo = _mm_min_epu8(lo, texels);
+            hi = _mm_max_epu8(hi, texels);
+        }
+        // Fold the four texels in each register down to one.
+        lo = _mm_min_epu8(lo, _mm_srli_si128(lo, 8));
+        hi = _mm_max_epu8(hi, _mm_srli_si128(hi, 8));
+        lo = _mm_min_epu8(lo, _mm_srli_si128(lo, 4));
+        hi = _mm_max_epu8(hi, _mm_srli_si128(hi, 4));
+        int packedMin = _mm_cvtsi128_si32(lo);
+        int packedMax = _mm_cvtsi128_si32(hi);
+        std::memcpy(minColor, &packedMin, 4);
+        std::memcpy(maxColor, &packedMax, 4);
+#else
+        for (int c = 0; c < 4; c++)
+        {
+            minColor[c] = maxColor[c] = rgba[c];
+        }
+        for (int i = 1; i < 16; i++)
+        {
+            for (int c = 0; c < 4; c++)
+            {
+                minColor[c] = std::min(minColor[c], rgba[i * 4 + c]);
+                maxColor[c] = std::max(maxColor[c], rgba[i * 4 + c]);
+            }
+        }
+#endif
+    }
+
+    static uint16_t pack_565(const float *color)
+    {
+        auto quantize = [](float value, int maxValue) {
+            return static_cast<int>(std::max(0.0f, std::min(value / 255.0f, 1.0f)) * maxValue + 0.5f);
+        };
+        return static_cast<uint16_t>((quantize(color[0], 31) << 11) | (quantize(color[1], 63) << 5) | quantize(color[2], 31));
+    }
+
+    static void unpack_565(uint16_t packed, int *color)
+    {
+        int r = (packed >> 11) & 31;
+        int g = (packed >> 5) & 63;
+        int b = packed & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    }
+
+    static void color_palette(uint16_t color0, uint16_t color1, int palette[4][3])
+    {
+        unpack_565(color0, palette[0]);
+        unpack_565(color1, palette[1]);
+        for (int c = 0; c < 3; c++)
+        {
+            if (color0 > color1) {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            } else {
+                palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+                palette[3][c] = 0;
+            }
+        }
+    }
+
+    static void write_u16(unsigned char *out, uint16_t value)
+    {
+        out[0] = value & 0xFF;
+        out[1] = value >> 8;
+    }
+
+    static uint16_t read_u16(const unsigned char *in)
+    {
+        return static_cast<uint16_t>(in[0] | (in[1] << 8));
+    }
+
+    // Picks the palette entry closest to each texel by squared rgb distance, the lowest
+    // index wins ties. Returns the 16 2 bit indices packed with texel 0 lowest.
+    static uint32_t color_indices(const unsigned char *rgba, const int palette[4][3])
+    {
+        uint32_t indices = 0;
+#if defined(TEXTURECOMPRESS_SSE)
+        // Four texels at a time, widened to 16 bits with alpha masked off. madd squares the
+        // differences and sums r+g and b+a pairs, adding those pairs gives each texel's error.
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i rgbMask = _mm_set1_epi32(0x00FFFFFF);
+        __m128i entries[4];
+        for (int p = 0; p < 4; p++)
+        {
+            entries[p] = _mm_setr_epi16(palette[p][0], palette[p][1], palette[p][2], 0,
+                                        palette[p][0], palette[p][1], palette[p][2], 0);
+        }
+        for (int group = 0; group < 4; group++)
+        {
+            __m128i texels = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + group * 16)), rgbMask);
+            __m128i low = _mm_unpacklo_epi8(texels, zero);
+            __m128i high = _mm_unpackhi_epi8(texels, zero);
+
+            __m128i bestError = _mm_setzero_si128();
+            __m128i best = _mm_setzero_si128();
+            for (int p = 0; p < 4; p++)
+            {
+                __m128i lowDiff = _mm_sub_epi16(low, entries[p]);
+                __m128i highDiff = _mm_sub_epi16(high, entries[p]);
+                __m128i lowSquares = _mm_madd_epi16(lowDiff, lowDiff);
+                __m128i highSquares = _mm_madd_epi16(highDiff, highDiff);
+                lowSquares = _mm_add_epi32(lowSquares, _mm_shuffle_epi32(lowSquares, _MM_SHUFFLE(2, 3, 0, 1)));
+                highSquares = _mm_add_epi32(highSquares, _mm_shuffle_epi32(highSquares, _MM_SHUFFLE(2, 3, 0, 1)));
+                __m128i error = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lowSquares),
+                                                                _mm_castsi128_ps(highSquares), _MM_SHUFFLE(2, 0, 2, 0)));
+                if (p == 0) {
+                    bestError = error;
+                    continue;
+                }
+                __m128i better = _mm_cmplt_epi32(error, bestError);
+                bestError = _mm_or_si128(_mm_and_si128(better, error), _mm_andnot_si128(better, bestError));
+                best = _mm_or_si128(_mm_and_si128(better, _mm_set1_epi32(p)), _mm_andnot_si128(better, best));
+            }
+
+            // Each lane holds 0-3, pack them down to a byte of four 2 bit indices.
+            best = _mm_or_si128(best, _mm_srli_epi64(best, 30));
+            int packed = (_mm_cvtsi128_si32(best) & 0xF) | ((_mm_cvtsi128_si32(_mm_srli_si128(best, 8)) & 0xF) << 4);
+            indices |= static_cast<uint32_t>(packed) << (group * 8);
+        }
+#else
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0;
+            int bestError = 1 << 30;
+            for (int p = 0; p < 4; p++)
+            {
+                int dr = rgba[i * 4 + 0] - palette[p][0];
+                int dg = rgba[i * 4 + 1] - palette[p][1];
+                int db = rgba[i * 4 + 2] - palette[p][2];
+                int error = dr * dr + dg * dg + db * db;
+                if (error < bestError) {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= static_cast<uint32_t>(best) << (i * 2);
+        }
+#endif
+        return indices;
+    }
+
+    // Fits the endpoints to the block's principal axis, then picks the closest of the four
+    // palette entries for each texel.
+    static void encode_color_block(const unsigned char *rgba, unsigned char *out)
+    {
+        unsigned char minColor[4];
+        unsigned char maxColor[4];
+        block_bounds(rgba, minColor, maxColor);
+
+        float mean[3] = {0.0f, 0.0f, 0.0f};
+        for (int i = 0; i < 16; i++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                mean[c] += rgba[i * 4 + c] / 16.0f;
+            }
+        }
+
+        float axis[3];
+        for (int c = 0; c < 3; c++)
+        {
+            axis[c] = static_cast<float>(maxColor[c] - minColor[c]);
+        }
+
+        if (axis[0] == 0.0f && axis[1] == 0.0f && axis[2] == 0.0f) {
+            // Solid block, both endpoints the same and every index 0.
+            uint16_t color = pack_565(mean);
+            write_u16(out, color);
+            write_u16(out + 2, color);
+            std::memset(out + 4, 0, 4);
+            return;
+        }
+
+        float covariance[6] = {}; // rr rg rb gg gb bb
+        for (int i = 0; i < 16; i++)
+        {
+            float r = rgba[i * 4 + 0] - mean[0];
+            float g = rgba[i * 4 + 1] - mean[1];
+            float b = rgba[i * 4 + 2] - mean[2];
+            covariance[0] += r * r;
+            covariance[1] += r * g;
+            covariance[2] += r * b;
+            covariance[3] += g * g;
+            covariance[4] += g * b;
+            covariance[5] += b * b;
+        }
+
+        // A few rounds of power iteration starting from the bounding box diagonal.
+        for (int iteration = 0; iteration < 4; iteration++)
+        {
+            float x = axis[0] * covariance[0] + axis[1] * covariance[1] + axis[2] * covariance[2];
+            float y = axis[0] * covariance[1] + axis[1] * covariance[3] + axis[2] * covariance[4];
+            float z = axis[0] * covariance[2] + axis[1] * covariance[4] + axis[2] * covariance[5];
+            float length = std::max(std::max(std::fabs(x), std::fabs(y)), std::fabs(z));
+            if (length == 0.0f) {
+                break;
+            }
+            axis[0] = x / length;
+            axis[1] = y / length;
+            axis[2] = z / length;
+        }
+        float length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+        for (int c = 0; c < 3; c++)
+        {
+            axis[c] /= length;
+        }
+
+        float lowest = 0.0f;
+        float highest = 0.0f;
+        for (int i = 0; i < 16; i++)
+        {
+            float t = (rgba[i * 4 + 0] - mean[0]) * axis[0] +
+                      (rgba[i * 4 + 1] - mean[1]) * axis[1] +
+                      (rgba[i * 4 + 2] - mean[2]) * axis[2];
+            lowest = std::min(lowest, t);
+            highest = std::max(highest, t);
+        }
+
+        // Pull the endpoints in a little, the extremes are rarely hit exactly after quantizing.
+        float inset = (highest - lowest) / 16.0f;
+        float end0[3];
+        float end1[3];
+        for (int c = 0; c < 3; c++)
+        {
+            end0[c] = mean[c] + axis[c] * (highest - inset);
+            end1[c] = mean[c] + axis[c] * (lowest + inset);
+        }
+
+        uint16_t color0 = pack_565(end0);
+        uint16_t color1 = pack_565(end1);
+        if (color0 < color1) {
+            std::swap(color0, color1);
+        }
+
+        uint32_t indices = 0;
+        if (color0 != color1) {
+            int palette[4][3];
+            color_palette(color0, color1, palette);
+            indices = color_indices(rgba, palette);
+        }
+
+        write_u16(out, color0);
+        write_u16(out + 2, color1);
+        for (int i = 0; i < 4; i++)
+        {
+            out[4 + i] = (indices >> (i * 8)) & 0xFF;
+        }
+    }
+
+    static void alpha_palette(int alpha0, int alpha1, int palette[8])
+    {
+        palette[0] = alpha0;
+        palette[1] = alpha1;
+        if (alpha0 > alpha1) {
+            for (int i = 1; i < 7; i++)
+            {
+                palette[i + 1] = ((7 - i) * alpha0 + i * alpha1) / 7;
+            }
+        } else {
+            for (int i = 1; i < 5; i++)
+            {
+                palette[i + 1] = ((5 - i) * alpha0 + i * alpha1) / 5;
+            }
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+    }
+
+    // Picks the closest palette entry to each texel's alpha, the lowest index wins ties.
+    // Returns the 16 3 bit indices packed with texel 0 lowest.
+    static uint64_t alpha_indices(const unsigned char *rgba, const int palette[8])
+    {
+        uint16_t best[16];
+#if defined(TEXTURECOMPRESS_SSE)
+        // All 16 alphas as 16 bit lanes in two registers, compared against one entry at a time.
+        __m128i alphas[2];
+        for (int half = 0; half < 2; half++)
+        {
+            __m128i first = _mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + half * 32)), 24);
+            __m128i second = _mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + half * 32 + 16)), 24);
+            alphas[half] = _mm_packs_epi32(first, second);
+        }
+        for (int half = 0; half < 2; half++)
+        {
+            __m128i bestError = _mm_setzero_si128();
+            __m128i bestIndex = _mm_setzero_si128();
+            for (int p = 0; p < 8; p++)
+            {
+                __m128i difference = _mm_sub_epi16(alphas[half], _mm_set1_epi16(static_cast<short>(palette[p])));
+                __m128i error = _mm_max_epi16(difference, _mm_sub_epi16(_mm_setzero_si128(), difference));
+                if (p == 0) {
+                    bestError = error;
+                    continue;
+                }
+                __m128i better = _mm_cmplt_epi16(error, bestError);
+                bestError = _mm_or_si128(_mm_and_si128(better, error), _mm_andnot_si128(better, bestError));
+                bestIndex = _mm_or_si128(_mm_and_si128(better, _mm_set1_epi16(static_cast<short>(p))),
+                                         _mm_andnot_si128(better, bestIndex));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(best + half * 8), bestIndex);
+        }
+#else
+        for (int i = 0; i < 16; i++)
+        {
+            int alpha = rgba[i * 4 + 3];
+            best[i] = 0;
+            for (int p = 1; p < 8; p++)
+            {
+                if (std::abs(alpha - palette[p]) < std::abs(alpha - palette[best[i]])) {
+                    best[i] = p;
+                }
+            }
+        }
+#endif
+        uint64_t indices = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            indices |= static_cast<uint64_t>(best[i]) << (i * 3);
+        }
+        return indices;
+    }
+
+    static void encode_alpha_block(const unsigned char *rgba, unsigned char *out)
+    {
+        unsigned char minColor[4];
+        unsigned char maxColor[4];
+        block_bounds(rgba, minColor, maxColor);
+
+        int alpha0 = maxColor[3];
+        int alpha1 = minColor[3];
+        out[0] = alpha0;
+        out[1] = alpha1;
+
+        uint64_t indices = 0;
+        if (alpha0 != alpha1) {
+            int palette[8];
+            alpha_palette(alpha0, alpha1, palette);
+            indices = alpha_indices(rgba, palette);
+        }
+        for (int i = 0; i < 6; i++)
+        {
+            out[2 + i] = (indices >> (i * 8)) & 0xFF;
+        }
+    }
+
+    std::string compress_image(const unsigned char *pixels, int width, int height, int components,
+                               BlockFormat format, WorkerPool *pool)
+    {
+        PROFILE_ZONE("compress_image");
+        int blocksX = (width + 3) / 4;
+        int blocksY = (height + 3) / 4;
+        size_t blockBytes = block_size(format);
+        std::string out(compressed_size(format, width, height), '\0');
+
+        auto encodeRow = [&](int blockY) {
+            unsigned char rgba[64];
+            for (int blockX = 0; blockX < blocksX; blockX++)
+            {
+                unsigned char *block = reinterpret_cast<unsigned char*>(&out[(static_cast<size_t>(blockY) * blocksX + blockX) * blockBytes]);
+                fetch_block(pixels, width, height, components, blockX, blockY, rgba);
+                if (format == BlockFormat::BC3) {
+                    encode_alpha_block(rgba, block);
+                    block += 8;
+                }
+                encode_color_block(rgba, block);
+            }
+        };
+
+        // The pool hands rows of blocks out one at a time so uneven rows balance out.
+        if (pool != nullptr) {
+            pool->run(blocksY, encodeRow);
+        } else {
+            for (int blockY = 0; blockY < blocksY; blockY++)
+            {
+                encodeRow(blockY);
+            }
+        }
+        return out;
+    }
+
+    PixelBuffer decompress_image(const unsigned char *blocks, int width, int height, BlockFormat format)
+    {
+        PROFILE_ZONE("decompress_image");
+        int blocksX = (width + 3) / 4;
+        int blocksY = (height + 3) / 4;
+        size_t blockBytes = block_size(format);
+        PixelBuffer pixels = allocate_pixels(static_cast<size_t>(width) * height * 4);
+
+        for (int blockY = 0; blockY < blocksY; blockY++)
+        {
+            for (int blockX = 0; blockX < blocksX; blockX++)
+            {
+                const unsigned char *block = blocks + (static_cast<size_t>(blockY) * blocksX + blockX) * blockBytes;
+
+                int alphas[16];
+                if (format == BlockFormat::BC3) {
+                    int palette[8];
+                    alpha_palette(block[0], block[1], palette);
+                    uint64_t indices = 0;
+                    for (int i = 0; i < 6; i++)
+                    {
+                        indices |= static_cast<uint64_t>(block[2 + i]) << (i * 8);
+                    }
+                    for (int i = 0; i < 16; i++)
+                    {
+                        alphas[i] = palette[(indices >> (i * 3)) & 7];
+                    }
+                    block += 8;
+                } else {
+                    std::fill(alphas, alphas + 16, 255);
+                }
+
+                int palette[4][3];
+                color_palette(read_u16(block), read_u16(block + 2), palette);
+                uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | (static_cast<uint32_t>(block[7]) << 24);
+
+                for (int y = 0; y < 4; y++)
+                {
+                    int py = blockY * 4 + y;
+                    for (int x = 0; x < 4; x++)
+                    {
+                        int px = blockX * 4 + x;
+                        if (px >= width || py >= height) {
+                            continue;
+                        }
+                        int i = y * 4 + x;
+                        const int *color = palette[(indices >> (i * 2)) & 3];
+                        unsigned char *dst = pixels.get() + (static_cast<size_t>(py) * width + px) * 4;
+                        dst[0] = color[0];
+                        dst[1] = color[1];
+                        dst[2] = color[2];
+                        dst[3] = alphas[i];
+                    }
+                }
+            }
+        }
+        return pixels;
+    }
+} // namespace ORCore
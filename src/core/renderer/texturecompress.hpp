@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+#include "texture.hpp"
+
+namespace ORCore
+{
+    class WorkerPool;
+
+    // BC1 (DXT1) and BC3 (DXT5) block compression. Both work on 4x4 texel blocks,
+    // BC1 stores color in 8 bytes per block, BC3 adds 8 bytes of alpha.
+    enum class BlockFormat
+    {
+        BC1,
+        BC3,
+    };
+
+    size_t block_size(BlockFormat format);
+    size_t compressed_size(BlockFormat format, int width, int height);
+
+    // Compresses tightly packed pixels with 1 to 4 channels, splitting the image's
+    // rows of blocks across pool when one is given.
+    std::string compress_image(const unsigned char *pixels, int width, int height, int components,
+                               BlockFormat format, WorkerPool *pool = nullptr);
+
+    // Expands compressed blocks back out to RGBA, for drivers without s3tc support.
+    PixelBuffer decompress_image(const unsigned char *blocks, int width, int height, BlockFormat format);
+} // namespace ORCore
@@ -0,0 +1,310 @@
+#include "config.hpp"
+#include "texturefile.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "stringutils.hpp"
+
+namespace ORCore
+{
+    std::string baked_texture_path(const std::string& imagePath)
+    {
+        size_t dot = imagePath.find_last_of('.');
+        size_t slash = imagePath.find_last_of("/\\");
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+            return imagePath + ".ortex";
+        }
+        return imagePath.substr(0, dot) + ".ortex";
+    }
+
+    // Mips are built from float pixels with color premultiplied by alpha, so transparent
+    // texels don't bleed their color into the edges of what's left.
+    struct FloatImage
+    {
+        int width;
+        int height;
+        std::vector<float> data;
+    };
+
+    static float srgb_to_linear(float c)
+    {
+        return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    static float linear_to_srgb(float c)
+    {
+        return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+    }
+
+    static bool has_alpha(int components)
+    {
+        return components == 2 || components == 4;
+    }
+
+    static FloatImage to_float(const unsigned char *pixels, int width, int height, int components, bool srgb)
+    {
+        float decode[256];
+        for (int i = 0; i < 256; i++)
+        {
+            decode[i] = srgb ? srgb_to_linear(i / 255.0f) : i / 255.0f;
+        }
+
+        FloatImage out {width, height, {}};
+        size_t count = static_cast<size_t>(width) * height;
+        out.data.resize(count * components);
+        int colorChannels = has_alpha(components) ? components - 1 : components;
+        for (size_t i = 0; i < count; i++)
+        {
+            const unsigned char *src = pixels + i * components;
+            float *dst = &out.data[i * components];
+            float alpha = has_alpha(components) ? src[components - 1] / 255.0f : 1.0f;
+            for (int c = 0; c < colorChannels; c++)
+            {
+                dst[c] = decode[src[c]] * alpha;
+            }
+            if (has_alpha(components)) {
+                dst[components - 1] = alpha;
+            }
+        }
+        return out;
+    }
+
+    static void to_bytes(const FloatImage& img, int components, bool srgb, unsigned char *out)
+    {
+        size_t count = static_cast<size_t>(img.width) * img.height;
+        int colorChannels = has_alpha(components) ? components - 1 : components;
+        for (size_t i = 0; i < count; i++)
+        {
+            const float *src = &img.data[i * components];
+            unsigned char *dst = out + i * components;
+            float alpha = has_alpha(components) ? src[components - 1] : 1.0f;
+            for (int c = 0; c < colorChannels; c++)
+            {
+                float value = alpha > 0.0f ? std::min(src[c] / alpha, 1.0f) : 0.0f;
+                if (srgb) {
+                    value = linear_to_srgb(value);
+                }
+                dst[c] = static_cast<unsigned char>(std::max(0.0f, std::min(value, 1.0f)) * 255.0f + 0.5f);
+            }
+            if (has_alpha(components)) {
+                dst[components - 1] = static_cast<unsigned char>(std::max(0.0f, std::min(alpha, 1.0f)) * 255.0f + 0.5f);
+            }
+        }
+    }
+
+    // Halves one axis with a [1 3 3 1] / 8 kernel, which is a bilinear tent over the
+    // four nearest source texels. Much less aliasing than a plain 2x2 box.
+    static FloatImage downsample_axis(const FloatImage& src, int components, bool horizontal)
+    {
+        const float weights[4] = {1.0f / 8.0f, 3.0f / 8.0f, 3.0f / 8.0f, 1.0f / 8.0f};
+
+        FloatImage dst;
+        dst.width = horizontal ? std::max(1, src.width / 2) : src.width;
+        dst.height = horizontal ? src.height : std::max(1, src.height / 2);
+        dst.data.assign(static_cast<size_t>(dst.width) * dst.height * components, 0.0f);
+
+        int srcSize = horizontal ? src.width : src.height;
+        for (int y = 0; y < dst.height; y++)
+        {
+            for (int x = 0; x < dst.width; x++)
+            {
+                float *out = &dst.data[(static_cast<size_t>(y) * dst.width + x) * components];
+                int center = horizontal ? x * 2 : y * 2;
+                for (int tap = 0; tap < 4; tap++)
+                {
+                    int s = std::max(0, std::min(center - 1 + tap, srcSize - 1));
+                    int sx = horizontal ? s : x;
+                    int sy = horizontal ? y : s;
+                    const float *in = &src.data[(static_cast<size_t>(sy) * src.width + sx) * components];
+                    for (int c = 0; c < components; c++)
+                    {
+                        out[c] += in[c] * weights[tap];
+                    }
+                }
+            }
+        }
+        return dst;
+    }
+
+    static uint64_t hash_file(const std::string& path)
+    {
+        MappedFile file(path);
+        if (!file.is_open()) {
+            return 0;
+        }
+        return stringHash(reinterpret_cast<const char*>(file.data()), file.size());
+    }
+
+    static size_t align_offset(size_t offset)
+    {
+        return (offset + textureFileAlignment - 1) / textureFileAlignment * textureFileAlignment;
+    }
+
+    std::vector<MipLevel> build_mip_chain(const Image& img, bool srgb)
+    {
+        int components = img.components;
+        // Gray images are treated as data, only color is converted to linear light.
+        bool linearize = srgb && components >= 3;
+
+        std::vector<MipLevel> levels;
+        levels.push_back({img.width, img.height,
+            std::string(reinterpret_cast<const char*>(img.pixelData.get()), static_cast<size_t>(img.width) * img.height * components)});
+
+        // Every level comes from the float copy of the one above it so rounding doesn't build
+        // up down the chain. Only the level being halved is kept in floats.
+        FloatImage current = to_float(img.pixelData.get(), img.width, img.height, components, linearize);
+        while (current.width > 1 || current.height > 1)
+        {
+            FloatImage half = downsample_axis(current, components, true);
+            current = downsample_axis(half, components, false);
+
+            MipLevel level {current.width, current.height, {}};
+            level.pixels.resize(static_cast<size_t>(current.width) * current.height * components);
+            to_bytes(current, components, linearize, reinterpret_cast<unsigned char*>(&level.pixels[0]));
+            levels.push_back(std::move(level));
+        }
+        return levels;
+    }
+
+    bool bake_texture(const Image& img, const std::string& filename, bool srgb, bool compress, WorkerPool *pool)
+    {
+        if (img.pixelData == nullptr || img.width <= 0 || img.height <= 0) {
+            return false;
+        }
+        int components = img.components;
+        bool linearize = srgb && components >= 3;
+        std::vector<MipLevel> mips = build_mip_chain(img, srgb);
+
+        TextureFileHeader header {};
+        std::memcpy(header.magic, "ORTX", 4);
+        header.version = textureFileVersion;
+        header.width = img.width;
+        header.height = img.height;
+        header.components = components;
+        header.levelCount = mips.size();
+        header.flags = linearize ? texture_file_srgb : 0;
+        header.format = texture_file_raw;
+        FileStamp source;
+        if (!img.path.empty() && sysGetFileStamp(img.path, source)) {
+            header.sourceSize = source.size;
+            header.sourceModified = source.modified;
+            header.sourceHash = hash_file(img.path);
+        }
+        BlockFormat blockFormat = BlockFormat::BC1;
+        if (compress) {
+            bool alpha = has_alpha(components);
+            header.format = alpha ? texture_file_bc3 : texture_file_bc1;
+            blockFormat = alpha ? BlockFormat::BC3 : BlockFormat::BC1;
+        }
+
+        // Every level as bytes in the image's own channel layout, compressed after if asked.
+        std::vector<std::string> levelData(mips.size());
+        for (size_t i = 0; i < mips.size(); i++)
+        {
+            levelData[i] = std::move(mips[i].pixels);
+        }
+        if (compress) {
+            for (size_t i = 0; i < mips.size(); i++)
+            {
+                levelData[i] = compress_image(reinterpret_cast<const unsigned char*>(levelData[i].data()),
+                                              mips[i].width, mips[i].height, components, blockFormat, pool);
+            }
+        }
+
+        std::vector<TextureFileLevel> levels(mips.size());
+        size_t offset = sizeof(TextureFileHeader) + sizeof(TextureFileLevel) * levels.size();
+        for (size_t i = 0; i < mips.size(); i++)
+        {
+            offset = align_offset(offset);
+            levels[i].width = mips[i].width;
+            levels[i].height = mips[i].height;
+            levels[i].offset = offset;
+            levels[i].size = levelData[i].size();
+            offset += levels[i].size;
+        }
+
+        std::string data(offset, '\0');
+        std::memcpy(&data[0], &header, sizeof(header));
+        std::memcpy(&data[sizeof(header)], levels.data(), sizeof(TextureFileLevel) * levels.size());
+        for (size_t i = 0; i < mips.size(); i++)
+        {
+            std::memcpy(&data[levels[i].offset], levelData[i].data(), levels[i].size);
+        }
+
+        return write_file(filename, data, FileMode::Binary);
+    }
+
+    TextureFile::TextureFile(std::string filename)
+    : m_header(nullptr), m_levels(nullptr)
+    {
+        // Missing baked files are normal, don't have the mapping complain about them.
+        if (!std::ifstream(filename)) {
+            return;
+        }
+        m_file = std::make_unique<MappedFile>(filename);
+        if (!m_file->is_open() || m_file->size() < sizeof(TextureFileHeader)) {
+            return;
+        }
+
+        auto header = reinterpret_cast<const TextureFileHeader*>(m_file->data());
+        if (std::memcmp(header->magic, "ORTX", 4) != 0 || header->version != textureFileVersion ||
+            header->components < 1 || header->components > 4 || header->levelCount == 0 ||
+            header->format > texture_file_bc3) {
+            std::cout << "Invalid baked texture: " << filename << std::endl;
+            return;
+        }
+
+        size_t tableEnd = sizeof(TextureFileHeader) + sizeof(TextureFileLevel) * static_cast<size_t>(header->levelCount);
+        if (tableEnd > m_file->size()) {
+            std::cout << "Invalid baked texture: " << filename << std::endl;
+            return;
+        }
+        auto levels = reinterpret_cast<const TextureFileLevel*>(m_file->data() + sizeof(TextureFileHeader));
+        for (uint32_t i = 0; i < header->levelCount; i++)
+        {
+            uint64_t expected = static_cast<uint64_t>(levels[i].width) * levels[i].height * header->components;
+            if (header->format == texture_file_bc1) {
+                expected = compressed_size(BlockFormat::BC1, levels[i].width, levels[i].height);
+            } else if (header->format == texture_file_bc3) {
+                expected = compressed_size(BlockFormat::BC3, levels[i].width, levels[i].height);
+            }
+            // Checked without adding them, a corrupt offset could wrap round.
+            if (levels[i].offset > m_file->size() || levels[i].size > m_file->size() - levels[i].offset ||
+                levels[i].size != expected) {
+                std::cout << "Invalid baked texture: " << filename << std::endl;
+                return;
+            }
+        }
+
+        m_header = header;
+        m_levels = levels;
+    }
+
+    bool TextureFile::matches_source(const std::string& path)
+    {
+        FileStamp source;
+        if (m_header->sourceSize == 0 || !sysGetFileStamp(path, source)) {
+            return true;
+        }
+        if (source.size != m_header->sourceSize) {
+            return false;
+        }
+        return source.modified == m_header->sourceModified || hash_file(path) == m_header->sourceHash;
+    }
+
+    Image TextureFile::decompress()
+    {
+        Image img;
+        img.width = m_header->width;
+        img.height = m_header->height;
+        img.components = 4;
+        img.length = img.width * img.height * 4;
+        img.pixelData = decompress_image(get_level_data(0), img.width, img.height, get_block_format());
+        return img;
+    }
+} // namespace ORCore
@@ -0,0 +1,105 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "texture.hpp"
+#include "texturecompress.hpp"
+#include "vfs.hpp"
+
+namespace ORCore
+{
+    // Baked textures, written by the texbake tool. The file is a header, a table of
+    // mip levels, then each level's tightly packed pixels starting on an aligned offset
+    // so levels can be handed to gl straight out of a file mapping.
+    const uint32_t textureFileVersion = 2;
+    const uint32_t textureFileAlignment = 256;
+
+    enum TextureFileFlags
+    {
+        texture_file_srgb = 1 << 0, // Mips were filtered in linear light.
+    };
+
+    // How the levels are stored, files from before compression have this zeroed.
+    enum TextureFileFormat
+    {
+        texture_file_raw = 0, // Tightly packed pixels with header.components channels.
+        texture_file_bc1 = 1, // Images without alpha.
+        texture_file_bc3 = 2, // Images with alpha.
+    };
+
+    struct TextureFileHeader
+    {
+        char magic[4]; // "ORTX"
+        uint32_t version;
+        uint32_t width;
+        uint32_t height;
+        uint32_t components;
+        uint32_t levelCount;
+        uint32_t flags;
+        uint32_t format; // TextureFileFormat
+        // The image it was baked from, all 0 when that wasn't known. See TextureFile::matches_source().
+        uint64_t sourceSize;
+        int64_t sourceModified;
+        uint64_t sourceHash;
+    };
+
+    struct TextureFileLevel
+    {
+        uint32_t width;
+        uint32_t height;
+        uint64_t offset; // From the start of the file.
+        uint64_t size;
+    };
+
+    // Returns where the baked version of an image lives, the extension is swapped for .ortex.
+    std::string baked_texture_path(const std::string& imagePath);
+
+    struct MipLevel
+    {
+        int width;
+        int height;
+        std::string pixels; // Tightly packed in the image's own channel layout.
+    };
+
+    // img followed by every level below it down to 1x1, filtered the way bake_texture does.
+    // Level 0 is an exact copy of img. Color is filtered in linear light when srgb is set.
+    std::vector<MipLevel> build_mip_chain(const Image& img, bool srgb);
+
+    // Builds the full mip chain for img and writes it out. Color images are filtered in
+    // linear light unless srgb is false. With compress the levels are stored as BC1, or
+    // BC3 when the image has alpha, spread across pool when one is given. The file img.path
+    // names is recorded as the source. Returns false if the file couldn't be written.
+    bool bake_texture(const Image& img, const std::string& filename, bool srgb = true, bool compress = false,
+                      WorkerPool *pool = nullptr);
+
+    // Read only view of a baked texture through a memory mapping, nothing is decoded or copied.
+    class TextureFile
+    {
+    public:
+        TextureFile(std::string filename);
+
+        bool is_valid() { return m_header != nullptr; }
+        // False when the image at path has changed since it was baked. Size and modification
+        // time are checked first, the file is only hashed when just the time differs (a copy).
+        // A missing image matches, so baked files can ship on their own.
+        bool matches_source(const std::string& path);
+        const TextureFileHeader& get_header() { return *m_header; }
+        int get_level_count() { return m_header->levelCount; }
+        const TextureFileLevel& get_level(int level) { return m_levels[level]; }
+        const unsigned char* get_level_data(int level) { return m_file->data() + m_levels[level].offset; }
+
+        bool is_compressed() { return m_header->format != texture_file_raw; }
+        BlockFormat get_block_format() { return m_header->format == texture_file_bc1 ? BlockFormat::BC1 : BlockFormat::BC3; }
+
+        // Expands the base level of a compressed file to RGBA, for when the driver can't
+        // sample the blocks itself. Mips have to be generated again after this.
+        Image decompress();
+
+    private:
+        std::unique_ptr<MappedFile> m_file;
+        const TextureFileHeader *m_header;
+        const TextureFileLevel *m_levels;
+    };
+} // namespace ORCore
@@ -0,0 +1,125 @@
+#include "config.hpp"
+#include "textureresidency.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+
+namespace ORCore
+{
+    // Frames to wait before loading a file that failed again, so a missing or broken
+    // file isn't decoded every frame it's drawn.
+    const uint64_t retryDelay = 300;
+
+    TextureResidency::TextureResidency(TextureStreamer *streamer)
+    : m_streamer(streamer), m_budget(0), m_evictedSize(32), m_residentBytes(0), m_frameEvictions(0),
+      m_frameReloads(0), m_totalEvictions(0), m_totalReloads(0)
+    {
+    }
+
+    void TextureResidency::set_budget(size_t bytes)
+    {
+        m_budget = bytes;
+    }
+
+    void TextureResidency::set_evicted_size(int size)
+    {
+        m_evictedSize = size;
+    }
+
+    void TextureResidency::add(Texture *texture, std::string path, int components)
+    {
+        m_entries.push_back({texture, std::move(path), components, State::loading, texture->get_upload_count(), 0});
+    }
+
+    void TextureResidency::remove(Texture *texture)
+    {
+        m_entries.erase(std::remove_if(m_entries.begin(), m_entries.end(), [texture](const Entry& entry) {
+            return entry.texture == texture;
+        }), m_entries.end());
+    }
+
+    int TextureResidency::get_evicted_count()
+    {
+        return std::count_if(m_entries.begin(), m_entries.end(), [](const Entry& entry) {
+            return entry.state != State::resident;
+        });
+    }
+
+    void TextureResidency::update(const std::vector<std::unique_ptr<Texture>>& textures, uint64_t frame)
+    {
+        PROFILE_ZONE("TextureResidency::update");
+        m_frameEvictions = 0;
+        m_frameReloads = 0;
+
+        m_streamer->take_failed(m_failed);
+        for (auto &entry : m_entries)
+        {
+            bool uploaded = entry.texture->get_upload_count() != entry.uploadCount;
+            bool failed = std::find(m_failed.begin(), m_failed.end(), entry.texture) != m_failed.end();
+            if ((entry.state == State::loading || entry.state == State::shrinking) && failed) {
+                // Nothing will arrive, treat it as evicted so it's tried again later.
+                entry.state = State::evicted;
+                entry.retryFrame = frame + retryDelay;
+            } else if (entry.state == State::loading && uploaded) {
+                entry.state = State::resident;
+            } else if (entry.state == State::shrinking && uploaded) {
+                entry.state = State::evicted;
+            } else if (entry.state == State::evicted && entry.texture->get_last_bound() + 1 >= frame &&
+                       frame >= entry.retryFrame) {
+                // Drawn last frame with its low mip or placeholder, bring it back.
+                entry.uploadCount = entry.texture->get_upload_count();
+                entry.state = State::loading;
+                m_streamer->request(entry.texture, entry.path, entry.components);
+                m_frameReloads++;
+            }
+        }
+        m_totalReloads += m_frameReloads;
+
+        m_residentBytes = 0;
+        for (auto &texture : textures)
+        {
+            if (texture != nullptr) {
+                m_residentBytes += texture->get_memory_size();
+            }
+        }
+        if (m_budget == 0 || m_residentBytes <= m_budget) {
+            return;
+        }
+
+        // Anything drawn last frame is still in use, evicting it would only bring it straight back.
+        m_candidates.clear();
+        for (auto &entry : m_entries)
+        {
+            if (entry.state == State::resident && entry.texture->get_last_bound() + 1 < frame) {
+                m_candidates.push_back(&entry);
+            }
+        }
+        std::sort(m_candidates.begin(), m_candidates.end(), [](Entry *a, Entry *b) {
+            return a->texture->get_last_bound() < b->texture->get_last_bound();
+        });
+
+        for (auto *entry : m_candidates)
+        {
+            if (m_residentBytes <= m_budget) {
+                break;
+            }
+            Texture *texture = entry->texture;
+            if (m_evictedSize > 0 && std::max(texture->get_width(), texture->get_height()) <= m_evictedSize) {
+                continue; // Already no bigger than its low mip.
+            }
+            size_t freed = texture->evict();
+            if (freed == 0) {
+                continue;
+            }
+            m_residentBytes -= freed;
+            entry->state = State::evicted;
+            if (m_evictedSize > 0) {
+                entry->uploadCount = texture->get_upload_count();
+                entry->state = State::shrinking;
+                m_streamer->request(texture, entry->path, entry->components, m_evictedSize);
+            }
+            m_frameEvictions++;
+        }
+        m_totalEvictions += m_frameEvictions;
+    }
+} // namespace ORCore
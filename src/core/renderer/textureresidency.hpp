@@ -0,0 +1,75 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "texture.hpp"
+#include "texturestreamer.hpp"
+
+namespace ORCore
+{
+    // Keeps texture memory under a budget by evicting the textures that were bound
+    // longest ago. Evicted textures drop to a low mip (or nothing) and are streamed back
+    // in from their file the next time they're drawn. The low mip is streamed from the
+    // file too, nothing is read back from the gpu. Only textures loaded from a file
+    // can be evicted, everything else counts against the budget but stays resident.
+    class TextureResidency
+    {
+    public:
+        TextureResidency(TextureStreamer *streamer);
+
+        // 0 turns eviction off, which is the default.
+        void set_budget(size_t bytes);
+
+        // Evicted textures keep their first mip no larger than this, 0 drops them entirely.
+        void set_evicted_size(int size);
+
+        // Tracks a texture the streamer has been asked to load from path.
+        void add(Texture *texture, std::string path, int components);
+        void remove(Texture *texture);
+
+        // Call once per frame before drawing. Reloads evicted textures drawn last frame, then
+        // evicts until the textures fit in the budget.
+        // Freed textures are left as null in textures.
+        void update(const std::vector<std::unique_ptr<Texture>>& textures, uint64_t frame);
+
+        size_t get_budget() { return m_budget; }
+        size_t get_resident_bytes() { return m_residentBytes; }
+        int get_evicted_count(); // Textures currently evicted or reloading.
+        int get_frame_evictions() { return m_frameEvictions; }
+        int get_frame_reloads() { return m_frameReloads; }
+        uint64_t get_total_evictions() { return m_totalEvictions; }
+        uint64_t get_total_reloads() { return m_totalReloads; }
+
+    private:
+        enum class State
+        {
+            loading, // The streamer has it.
+            shrinking, // Evicted, the streamer is loading its low mip.
+            resident,
+            evicted,
+        };
+
+        struct Entry
+        {
+            Texture *texture;
+            std::string path;
+            int components;
+            State state;
+            int uploadCount; // The texture's upload count when the load was requested.
+            uint64_t retryFrame; // A failed load isn't requested again before this frame.
+        };
+
+        TextureStreamer *m_streamer;
+        std::vector<Entry> m_entries;
+        std::vector<Entry*> m_candidates; // Reused every update.
+        std::vector<Texture*> m_failed; // The same.
+        size_t m_budget;
+        int m_evictedSize;
+        size_t m_residentBytes;
+        int m_frameEvictions;
+        int m_frameReloads;
+        uint64_t m_totalEvictions;
+        uint64_t m_totalReloads;
+    };
+} // namespace ORCore
@@ -0,0 +1,56 @@
+#include "config.hpp"
+
+// Built with SSSE3 code generation, nothing in here may run before
+// texture.cpp has checked the cpu supports it.
+#if defined(ENABLE_SSSE3)
+#include <cstddef>
+#include <tmmintrin.h>
+
+namespace ORCore
+{
+    // Expands as many whole steps of 1, 2 or 3 channel pixels to RGBA as fit, returns
+    // how many pixels were done so the caller can finish the rest.
+    size_t expand_to_rgba_ssse3(const unsigned char *src, unsigned char *dst, size_t pixels, int comp)
+    {
+        size_t i = 0;
+        const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000));
+        if (comp == 3) {
+            // 4 pixels per step, each load reads 16 bytes but only uses 12 of them
+            // so stop while the load still fits inside the source.
+            const __m128i spread = _mm_setr_epi8(0,1,2,-1, 3,4,5,-1, 6,7,8,-1, 9,10,11,-1);
+            for (; i + 6 <= pixels; i += 4)
+            {
+                __m128i rgb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i*3));
+                __m128i rgba = _mm_or_si128(_mm_shuffle_epi8(rgb, spread), alpha);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i*4), rgba);
+            }
+        } else if (comp == 2) {
+            const __m128i spreadLow = _mm_setr_epi8(0,0,0,1, 2,2,2,3, 4,4,4,5, 6,6,6,7);
+            const __m128i spreadHigh = _mm_setr_epi8(8,8,8,9, 10,10,10,11, 12,12,12,13, 14,14,14,15);
+            for (; i + 8 <= pixels; i += 8)
+            {
+                __m128i grayAlpha = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i*2));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i*4), _mm_shuffle_epi8(grayAlpha, spreadLow));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i*4 + 16), _mm_shuffle_epi8(grayAlpha, spreadHigh));
+            }
+        } else if (comp == 1) {
+            const __m128i spread[4] = {
+                _mm_setr_epi8(0,0,0,-1, 1,1,1,-1, 2,2,2,-1, 3,3,3,-1),
+                _mm_setr_epi8(4,4,4,-1, 5,5,5,-1, 6,6,6,-1, 7,7,7,-1),
+                _mm_setr_epi8(8,8,8,-1, 9,9,9,-1, 10,10,10,-1, 11,11,11,-1),
+                _mm_setr_epi8(12,12,12,-1, 13,13,13,-1, 14,14,14,-1, 15,15,15,-1),
+            };
+            for (; i + 16 <= pixels; i += 16)
+            {
+                __m128i gray = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+                for (int j = 0; j < 4; j++)
+                {
+                    __m128i rgba = _mm_or_si128(_mm_shuffle_epi8(gray, spread[j]), alpha);
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + (i + j*4)*4), rgba);
+                }
+            }
+        }
+        return i;
+    }
+} // namespace ORCore
+#endif
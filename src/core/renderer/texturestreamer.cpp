@@ -0,0 +1,421 @@
+#include "config.hpp"
+#include "texturestreamer.hpp"
+#include "profiler.hpp"
+#include "stringutils.hpp"
+#include "vfs.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+
+namespace ORCore
+{
+    TextureStreamer::TextureStreamer(int threads)
+    : m_decoding(0), m_stopping(false), m_useBaked(true), m_bakedCount(0),
+      m_compressionSupported(false), m_pbo(0), m_pboSize(0)
+    {
+        if (threads <= 0) {
+            // Leave a core for the main thread.
+            int cores = std::thread::hardware_concurrency();
+            threads = std::max(1, std::min(cores - 1, 4));
+        }
+        for (int i = 0; i < threads; i++)
+        {
+            m_workers.emplace_back(&TextureStreamer::worker, this);
+        }
+    }
+
+    TextureStreamer::~TextureStreamer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_jobReady.notify_all();
+        for (auto &thread : m_workers)
+        {
+            thread.join();
+        }
+        if (m_pbo != 0) {
+            glDeleteBuffers(1, &m_pbo);
+        }
+    }
+
+    void TextureStreamer::init_gl()
+    {
+        glGenBuffers(1, &m_pbo);
+        m_compressionSupported = has_texture_compression();
+    }
+
+    void TextureStreamer::request(Texture *texture, std::string path, int components, int maxSize)
+    {
+        // Only whole textures are shared, an evicted one is already known to be unique.
+        queue({texture, std::move(path), components, maxSize, maxSize == 0});
+    }
+
+    void TextureStreamer::queue(DecodeJob job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_jobs.push_back(std::move(job));
+        }
+        m_jobReady.notify_one();
+    }
+
+    void TextureStreamer::cancel(Texture *texture)
+    {
+        auto matches = [texture](const auto& item) { return item.texture == texture; };
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_decodeDone.wait(lock, [this, texture] {
+                return std::find(m_inFlight.begin(), m_inFlight.end(), texture) == m_inFlight.end();
+            });
+            m_jobs.erase(std::remove_if(m_jobs.begin(), m_jobs.end(), matches), m_jobs.end());
+            m_decoded.erase(std::remove_if(m_decoded.begin(), m_decoded.end(), matches), m_decoded.end());
+
+            // Copies waiting to draw texture have to be loaded themselves after all.
+            for (auto upload = m_decoded.begin(); upload != m_decoded.end();)
+            {
+                if (upload->copyOf == texture) {
+                    m_jobs.push_back({upload->texture, std::move(upload->path), upload->components, 0, true});
+                    upload = m_decoded.erase(upload);
+                } else {
+                    upload++;
+                }
+            }
+            for (auto content = m_contents.begin(); content != m_contents.end();)
+            {
+                if (content->second == texture) {
+                    content = m_contents.erase(content);
+                } else {
+                    content++;
+                }
+            }
+        }
+        m_jobReady.notify_all();
+        m_uploads.erase(std::remove_if(m_uploads.begin(), m_uploads.end(), matches), m_uploads.end());
+        m_failed.erase(std::remove(m_failed.begin(), m_failed.end(), texture), m_failed.end());
+    }
+
+    void TextureStreamer::take_failed(std::vector<Texture*>& failed)
+    {
+        failed.clear();
+        std::swap(failed, m_failed);
+    }
+
+    void TextureStreamer::set_use_baked(bool useBaked)
+    {
+        m_useBaked = useBaked;
+    }
+
+    void TextureStreamer::set_content_check(std::function<bool(Texture *texture, Texture *original, uint64_t hash)> check)
+    {
+        m_contentCheck = std::move(check);
+    }
+
+    void TextureStreamer::worker()
+    {
+        while (true)
+        {
+            DecodeJob job;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_jobReady.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+                if (m_stopping) {
+                    return;
+                }
+                job = std::move(m_jobs.front());
+                m_jobs.pop_front();
+                m_decoding++;
+                m_inFlight.push_back(job.texture);
+            }
+
+            std::unique_ptr<TextureFile> baked;
+            if (m_useBaked) {
+                baked = std::make_unique<TextureFile>(baked_texture_path(job.path));
+                // Baked files keep the image's channels, fall back when those need expanding.
+                // Compressed ones the driver can't sample expand to RGBA so never need swizzles.
+                bool usable = baked->is_valid() && (job.components != 4 || baked->get_header().components >= 3 ||
+                                                    (baked->is_compressed() && !m_compressionSupported));
+                if (usable && !baked->matches_source(job.path)) {
+                    std::cout << "Baked texture is out of date, loading " << job.path << " instead" << std::endl;
+                    usable = false;
+                }
+                if (!usable) {
+                    baked.reset();
+                }
+            }
+
+            // Hashed before anything is decoded, so copies of a texture that's already loading
+            // or loaded skip decoding entirely. Bakes record the hash of the file they came from.
+            Upload result {};
+            result.texture = job.texture;
+            std::unique_ptr<MappedFile> source;
+            if (baked != nullptr) {
+                result.hash = baked->get_header().sourceHash;
+            }
+            if (baked == nullptr || result.hash == 0) {
+                source = std::make_unique<MappedFile>(job.path);
+                if (source->is_open()) {
+                    result.hash = stringHash(reinterpret_cast<const char*>(source->data()), source->size());
+                }
+            }
+            if (job.checkContent && result.hash != 0) {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                auto claimed = m_contents.emplace(result.hash, job.texture);
+                if (!claimed.second && claimed.first->second != job.texture) {
+                    // Queued under the same lock as the check, so cancel() can't miss it.
+                    result.copyOf = claimed.first->second;
+                    result.path = std::move(job.path);
+                    result.components = job.components;
+                    finish_job(std::move(result));
+                    lock.unlock();
+                    m_decodeDone.notify_all();
+                    continue;
+                }
+            }
+
+            if (baked != nullptr && baked->is_compressed() && !m_compressionSupported) {
+                result.image = baked->decompress();
+                m_bakedCount++;
+            } else if (baked != nullptr) {
+                result.baked = std::move(baked);
+                m_bakedCount++;
+            } else if (source->is_open()) {
+                result.image = loadSTB(source->data(), source->size(), job.path, job.components);
+            } else {
+                std::cout << "Failed to get image data" << std::endl;
+            }
+            source.reset();
+
+            // Evicted textures only get their low mips back, baked files already have them.
+            if (job.maxSize > 0 && result.baked != nullptr) {
+                auto &file = *result.baked;
+                while (result.first + 1 < file.get_level_count() &&
+                       std::max(file.get_level(result.first).width, file.get_level(result.first).height) >
+                       static_cast<uint32_t>(job.maxSize))
+                {
+                    result.first++;
+                }
+                result.next = result.first;
+            } else if (job.maxSize > 0 && std::max(result.image.width, result.image.height) > job.maxSize) {
+                std::vector<MipLevel> mips = build_mip_chain(result.image, true);
+                size_t first = 0;
+                while (first + 1 < mips.size() && std::max(mips[first].width, mips[first].height) > job.maxSize)
+                {
+                    first++;
+                }
+                result.mips.assign(std::make_move_iterator(mips.begin() + first), std::make_move_iterator(mips.end()));
+                result.image.pixelData.reset();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                // Nothing to share if it couldn't be loaded, a later copy loads it itself.
+                auto claimed = m_contents.find(result.hash);
+                if (result.baked == nullptr && result.image.pixelData == nullptr &&
+                    claimed != m_contents.end() && claimed->second == job.texture) {
+                    m_contents.erase(claimed);
+                }
+                finish_job(std::move(result));
+            }
+            m_decodeDone.notify_all();
+        }
+    }
+
+    void TextureStreamer::finish_job(Upload&& result)
+    {
+        Texture *texture = result.texture;
+        m_decoded.push_back(std::move(result));
+        m_decoding--;
+        m_inFlight.erase(std::find(m_inFlight.begin(), m_inFlight.end(), texture));
+    }
+
+    size_t TextureStreamer::update(size_t budget)
+    {
+        size_t checked = m_uploads.size();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            while (!m_decoded.empty())
+            {
+                m_uploads.push_back(std::move(m_decoded.front()));
+                m_decoded.pop_front();
+            }
+        }
+
+        // Copies of another texture draw that one instead and never upload anything.
+        for (size_t i = checked; i < m_uploads.size();)
+        {
+            auto &upload = m_uploads[i];
+            if (upload.copyOf == nullptr) {
+                i++;
+                continue;
+            }
+            if (m_contentCheck && m_contentCheck(upload.texture, upload.copyOf, upload.hash)) {
+                upload.texture->set_placeholder(upload.copyOf);
+            } else {
+                // It can't share after all, load it like any other texture.
+                queue({upload.texture, std::move(upload.path), upload.components, 0, false});
+            }
+            m_uploads.erase(m_uploads.begin() + i);
+        }
+
+        if (m_uploads.empty()) {
+            return 0;
+        }
+
+        PROFILE_ZONE("TextureStreamer::update");
+        size_t uploaded = 0;
+        while (!m_uploads.empty() && uploaded < budget)
+        {
+            auto &current = m_uploads.front();
+            if (current.baked != nullptr) {
+                uploaded += upload_baked(current, budget - uploaded);
+            } else if (!current.mips.empty()) {
+                uploaded += upload_mips(current, budget - uploaded);
+            } else {
+                uploaded += upload(current, budget - uploaded);
+            }
+            if (current.done) {
+                m_uploads.pop_front();
+            }
+        }
+        return uploaded;
+    }
+
+    size_t TextureStreamer::upload(Upload& upload, size_t budget)
+    {
+        Image &image = upload.image;
+        if (image.pixelData == nullptr || image.height == 0) {
+            // Failed to decode, the texture keeps using its placeholder.
+            m_failed.push_back(upload.texture);
+            upload.done = true;
+            return 0;
+        }
+
+        if (upload.next == 0) {
+            upload.texture->allocate(image.width, image.height, image.components);
+        }
+
+        // Always move at least one row so a budget smaller than a row can't stall.
+        size_t rowSize = static_cast<size_t>(image.width) * image.components;
+        size_t remaining = image.height - upload.next;
+        int rows = static_cast<int>(std::min(std::max<size_t>(1, budget / rowSize), remaining));
+        size_t size = rowSize * rows;
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo);
+        if (size > m_pboSize) {
+            m_pboSize = size;
+        }
+        // Orphan the buffer so we never wait on the previous copy out of it.
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, m_pboSize, nullptr, GL_STREAM_DRAW);
+        void *mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (mapped != nullptr) {
+            std::memcpy(mapped, image.pixelData.get() + rowSize * upload.next, size);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            upload.texture->upload_rows(upload.next, rows, nullptr);
+        } else {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            upload.texture->upload_rows(upload.next, rows, image.pixelData.get() + rowSize * upload.next);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        upload.next += rows;
+        if (upload.next >= image.height) {
+            upload.texture->finish_upload();
+            upload.done = true;
+        }
+        return size;
+    }
+
+    size_t TextureStreamer::upload_baked(Upload& upload, size_t budget)
+    {
+        // Levels go to gl straight from the mapping, a whole level at a time.
+        TextureFile &file = *upload.baked;
+        if (upload.next == upload.first) {
+            auto &base = file.get_level(upload.first);
+            if (file.is_compressed()) {
+                upload.texture->allocate_compressed(base.width, base.height, file.get_block_format());
+            } else {
+                upload.texture->allocate(base.width, base.height, file.get_header().components);
+            }
+        }
+
+        size_t uploaded = 0;
+        while (upload.next < file.get_level_count())
+        {
+            auto &level = file.get_level(upload.next);
+            if (uploaded > 0 && uploaded + level.size > budget) {
+                break;
+            }
+            int target = upload.next - upload.first;
+            if (file.is_compressed()) {
+                upload.texture->upload_compressed_level(target, level.width, level.height,
+                                                        file.get_level_data(upload.next), level.size);
+            } else {
+                upload.texture->upload_level(target, level.width, level.height, file.get_level_data(upload.next));
+            }
+            uploaded += level.size;
+            upload.next++;
+        }
+
+        if (upload.next >= file.get_level_count()) {
+            upload.texture->finish_upload();
+            upload.done = true;
+            upload.baked.reset();
+        }
+        return uploaded;
+    }
+
+    size_t TextureStreamer::upload_mips(Upload& upload, size_t budget)
+    {
+        if (upload.next == 0) {
+            upload.texture->allocate(upload.mips[0].width, upload.mips[0].height, upload.image.components);
+        }
+
+        size_t uploaded = 0;
+        while (upload.next < static_cast<int>(upload.mips.size()))
+        {
+            auto &level = upload.mips[upload.next];
+            if (uploaded > 0 && uploaded + level.pixels.size() > budget) {
+                break;
+            }
+            upload.texture->upload_level(upload.next, level.width, level.height, level.pixels.data());
+            uploaded += level.pixels.size();
+            upload.next++;
+        }
+
+        if (upload.next >= static_cast<int>(upload.mips.size())) {
+            upload.texture->finish_upload();
+            upload.done = true;
+            upload.mips.clear();
+        }
+        return uploaded;
+    }
+
+    size_t TextureStreamer::finish()
+    {
+        size_t uploaded = 0;
+        while (true)
+        {
+            uploaded += update(static_cast<size_t>(-1));
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_jobs.empty() && m_decoding == 0 && m_decoded.empty()) {
+                break;
+            }
+            m_decodeDone.wait(lock, [this] { return !m_decoded.empty(); });
+        }
+        // Anything decoded between the last update and the check above.
+        uploaded += update(static_cast<size_t>(-1));
+        return uploaded;
+    }
+
+    bool TextureStreamer::is_idle()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_jobs.empty() && m_decoding == 0 && m_decoded.empty() && m_uploads.empty();
+    }
+} // namespace ORCore
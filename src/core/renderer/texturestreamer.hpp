@@ -0,0 +1,116 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <glad/glad.h>
+
+#include "texture.hpp"
+#include "texturefile.hpp"
+#include "stats.hpp"
+
+namespace ORCore
+{
+    // Loads textures in the background. Images are decoded on a pool of worker
+    // threads, then uploaded on the gl thread through a pixel buffer object a
+    // few rows at a time so no single frame pays for a whole texture.
+    class TextureStreamer
+    {
+    public:
+        TextureStreamer(int threads = 0); // 0 picks a count from the number of cores.
+        ~TextureStreamer();
+
+        void init_gl();
+
+        // Starts decoding path into texture, components is passed on to loadSTB. A maxSize
+        // above 0 only loads the mips no larger than that, for textures that have been evicted.
+        void request(Texture *texture, std::string path, int components, int maxSize = 0);
+
+        // Drops everything queued for texture so it can be deleted. Waits if a worker is
+        // decoding it right now.
+        void cancel(Texture *texture);
+
+        // When on, a baked .ortex next to the requested image is used in its place,
+        // see baked_texture_path(). On by default.
+        void set_use_baked(bool useBaked);
+        int get_baked_count() { return m_bakedCount; } // Requests served from baked files.
+
+        // Workers hash each requested file before decoding it. When another texture has already
+        // been requested with the same bytes nothing is decoded, instead this is called on the gl
+        // thread with both and the hash. Returning true binds original in the texture's place,
+        // false loads the texture as normal.
+        void set_content_check(std::function<bool(Texture *texture, Texture *original, uint64_t hash)> check);
+
+        // Moves the textures whose file couldn't be loaded since the last call into failed,
+        // they keep drawing their placeholder.
+        void take_failed(std::vector<Texture*>& failed);
+
+        // Uploads decoded images until budget bytes have been copied this call.
+        // Returns the number of bytes uploaded.
+        size_t update(size_t budget);
+
+        // Blocks until everything requested so far has been decoded and uploaded.
+        size_t finish();
+
+        bool is_idle();
+
+    private:
+        struct DecodeJob
+        {
+            Texture *texture;
+            std::string path;
+            int components;
+            int maxSize;
+            bool checkContent; // Look for another texture with the same content first.
+        };
+
+        struct Upload
+        {
+            Texture *texture;
+            Image image;
+            std::unique_ptr<TextureFile> baked; // Set instead of image for baked textures.
+            std::vector<MipLevel> mips; // Set instead of image's pixels when only the low mips are wanted.
+            int first; // Mip level of baked that becomes the base level.
+            int next; // Row of image, or mip level of baked or mips to upload next.
+            bool done;
+
+            // Set instead of anything to upload when the file is a copy of another texture's.
+            Texture *copyOf;
+            uint64_t hash;
+            std::string path; // Requested again if the copy can't share after all.
+            int components;
+        };
+
+        void queue(DecodeJob job);
+        void worker();
+        void finish_job(Upload&& result); // m_mutex has to be held.
+        size_t upload(Upload& upload, size_t budget);
+        size_t upload_baked(Upload& upload, size_t budget);
+        size_t upload_mips(Upload& upload, size_t budget);
+
+        std::vector<std::thread> m_workers;
+        std::mutex m_mutex;
+        std::condition_variable m_jobReady;
+        std::condition_variable m_decodeDone;
+        std::deque<DecodeJob> m_jobs;
+        std::deque<Upload> m_decoded;
+        int m_decoding; // Jobs taken by a worker but not finished.
+        std::vector<Texture*> m_inFlight; // Textures those jobs are for.
+        bool m_stopping;
+        std::atomic<bool> m_useBaked;
+        std::atomic<int> m_bakedCount;
+        bool m_compressionSupported; // Set by init_gl before any requests.
+        std::unordered_map<uint64_t, Texture*> m_contents; // Content hash -> the first texture requested with it.
+        std::function<bool(Texture*, Texture*, uint64_t)> m_contentCheck;
+
+        std::deque<Upload> m_uploads; // Only touched on the gl thread.
+        std::vector<Texture*> m_failed; // Also gl thread only.
+        GLuint m_pbo;
+        size_t m_pboSize;
+    };
+} // namespace ORCore
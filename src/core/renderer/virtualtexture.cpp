@@ -0,0 +1,335 @@
+#include "config.hpp"
+#include "virtualtexture.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+
+namespace ORCore
+{
+    VirtualTexture::VirtualTexture(std::string path, Texture *cache, int cacheTiles)
+    : m_file(path), m_cache(cache), m_cacheTiles(std::min(cacheTiles, virtualTextureMaxTiles)), m_feedbackID(0),
+      m_indirectionWidth(1), m_indirectionHeight(1), m_indirectionDirty(false), m_stopping(false)
+    {
+        if (m_file.is_valid()) {
+            m_worker = std::thread(&VirtualTexture::worker, this);
+        }
+    }
+
+    VirtualTexture::~VirtualTexture()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_loadReady.notify_all();
+        if (m_worker.joinable()) {
+            m_worker.join();
+        }
+    }
+
+    void VirtualTexture::init_gl()
+    {
+        int stride = m_file.get_tile_stride();
+        int cacheSize = m_cacheTiles * stride;
+
+        // Tiles are only ever sampled at full size, the levels come from the file. The cache
+        // isn't sRGB, like every other texture, the file's flag only says how mips were filtered.
+        m_cache->set_mipmaps(false);
+        m_cache->allocate(cacheSize, cacheSize, 4);
+        m_cache->finish_upload();
+        m_slots.assign(m_cacheTiles * m_cacheTiles, {noTile, 0});
+
+        // The last level is a single tile, it stays in slot 0 for good.
+        int top = m_file.get_level_count() - 1;
+        m_cache->upload_region(0, 0, 0, stride, stride, stride, m_file.get_tile(top, 0, 0));
+        m_slots[0].key = tile_key(top, 0, 0);
+        m_tileSlots[m_slots[0].key] = 0;
+
+        // Tile counts don't always halve the way gl's level sizes do, padding the base to a
+        // power of two keeps every level complete.
+        auto &base = m_file.get_level(0);
+        while (m_indirectionWidth < static_cast<int>(base.tilesX))
+        {
+            m_indirectionWidth *= 2;
+        }
+        while (m_indirectionHeight < static_cast<int>(base.tilesY))
+        {
+            m_indirectionHeight *= 2;
+        }
+        m_levels.resize(m_file.get_level_count());
+        for (int level = 0; level < m_file.get_level_count(); level++)
+        {
+            m_levels[level].assign(static_cast<size_t>(indirection_width(level)) * indirection_height(level) * 4, 0);
+        }
+
+        // Entries are slot indices, filtering would blend them into nonsense.
+        m_indirection = std::make_unique<Texture>(GL_TEXTURE_2D);
+        m_indirection->set_mipmaps(false);
+        m_indirection->set_filtered(false);
+        m_indirection->allocate(m_indirectionWidth, m_indirectionHeight, 4);
+        m_indirectionDirty = true;
+        upload_indirection();
+        m_indirection->finish_upload();
+    }
+
+    void VirtualTexture::set_uniforms(ShaderProgram *program, float lodBias)
+    {
+        auto &header = m_file.get_header();
+        float cacheSize = static_cast<float>(m_cacheTiles * m_file.get_tile_stride());
+        glUniform4f(program->uniform_attribute("virtualSize"), header.width, header.height, header.tileSize, header.border);
+        glUniform4f(program->uniform_attribute("virtualCache"), cacheSize, cacheSize, m_file.get_level_count() - 1, lodBias);
+        glUniform1f(program->uniform_attribute("virtualID"), m_feedbackID);
+    }
+
+    void VirtualTexture::request_tile(int level, int x, int y)
+    {
+        if (level >= m_file.get_level_count()) {
+            return;
+        }
+        auto &info = m_file.get_level(level);
+        if (x < static_cast<int>(info.tilesX) && y < static_cast<int>(info.tilesY)) {
+            m_requested.insert(tile_key(level, x, y));
+        }
+    }
+
+    int VirtualTexture::get_pending_tiles()
+    {
+        return m_loading.size();
+    }
+
+    size_t VirtualTexture::get_memory_size()
+    {
+        return m_cache->get_memory_size() + m_indirection->get_memory_size();
+    }
+
+    void VirtualTexture::worker()
+    {
+        size_t tileBytes = m_file.get_tile_bytes();
+        while (true)
+        {
+            uint32_t key;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_loadReady.wait(lock, [this] { return m_stopping || !m_loads.empty(); });
+                if (m_stopping) {
+                    return;
+                }
+                key = m_loads.front();
+                m_loads.pop_front();
+            }
+
+            const unsigned char *tile = m_file.get_tile(key >> 16, key & 0xFF, (key >> 8) & 0xFF);
+            LoadedTile loaded {key, std::vector<unsigned char>(tile, tile + tileBytes)};
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_loaded.push_back(std::move(loaded));
+        }
+    }
+
+    int VirtualTexture::update(int maxTiles, uint64_t frame)
+    {
+        PROFILE_ZONE("VirtualTexture::update");
+        int levelCount = m_file.get_level_count();
+
+        // A visible tile keeps its coarser tiles in the cache too, so there is always a close
+        // fallback. Anything missing is loaded.
+        m_newRequests.clear();
+        for (uint32_t key : m_requested)
+        {
+            int level = key >> 16;
+            int x = key & 0xFF;
+            int y = (key >> 8) & 0xFF;
+            while (level < levelCount)
+            {
+                key = tile_key(level, x, y);
+                auto slot = m_tileSlots.find(key);
+                if (slot != m_tileSlots.end()) {
+                    if (m_slots[slot->second].lastUsed == frame) {
+                        break; // Another request already went up from here.
+                    }
+                    m_slots[slot->second].lastUsed = frame;
+                } else if (m_loading.insert(key).second) {
+                    m_newRequests.push_back(key);
+                }
+                level++;
+                x >>= 1;
+                y >>= 1;
+            }
+        }
+        m_requested.clear();
+
+        if (!m_newRequests.empty()) {
+            // Coarse tiles first, each one improves a larger area of the screen.
+            std::sort(m_newRequests.begin(), m_newRequests.end(), std::greater<uint32_t>());
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_loads.insert(m_loads.end(), m_newRequests.begin(), m_newRequests.end());
+        }
+        m_loadReady.notify_one();
+
+        std::vector<LoadedTile> loaded;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            while (!m_loaded.empty() && static_cast<int>(loaded.size()) < maxTiles)
+            {
+                loaded.push_back(std::move(m_loaded.front()));
+                m_loaded.pop_front();
+            }
+        }
+
+        int stride = m_file.get_tile_stride();
+        int uploaded = 0;
+        for (auto &tile : loaded)
+        {
+            m_loading.erase(tile.key);
+            int slot = find_slot(frame);
+            if (slot == -1) {
+                // Everything in the cache is on screen, the tile is asked for again if it's still needed.
+                continue;
+            }
+            if (m_slots[slot].key != noTile) {
+                m_tileSlots.erase(m_slots[slot].key);
+            }
+            m_slots[slot] = {tile.key, frame};
+            m_tileSlots[tile.key] = slot;
+
+            int x = (slot % m_cacheTiles) * stride;
+            int y = (slot / m_cacheTiles) * stride;
+            m_cache->upload_region(0, x, y, stride, stride, stride, tile.pixels.data());
+            uploaded++;
+            m_indirectionDirty = true;
+        }
+
+        if (m_indirectionDirty) {
+            upload_indirection();
+        }
+        return uploaded;
+    }
+
+    int VirtualTexture::find_slot(uint64_t frame)
+    {
+        // Slot 0 holds the last level.
+        int oldest = -1;
+        for (size_t i = 1; i < m_slots.size(); i++)
+        {
+            auto &slot = m_slots[i];
+            if (slot.key == noTile) {
+                return i;
+            }
+            if (slot.lastUsed < frame && (oldest == -1 || slot.lastUsed < m_slots[oldest].lastUsed)) {
+                oldest = i;
+            }
+        }
+        return oldest;
+    }
+
+    void VirtualTexture::upload_indirection()
+    {
+        PROFILE_ZONE("VirtualTexture::upload_indirection");
+        // From the coarsest level down so missing tiles can copy their parent's entry.
+        for (int level = m_file.get_level_count() - 1; level >= 0; level--)
+        {
+            auto &info = m_file.get_level(level);
+            auto &texels = m_levels[level];
+            int width = indirection_width(level);
+            int height = indirection_height(level);
+            for (uint32_t y = 0; y < info.tilesY; y++)
+            {
+                for (uint32_t x = 0; x < info.tilesX; x++)
+                {
+                    unsigned char *texel = &texels[(static_cast<size_t>(y) * width + x) * 4];
+                    auto slot = m_tileSlots.find(tile_key(level, x, y));
+                    if (slot != m_tileSlots.end()) {
+                        texel[0] = slot->second % m_cacheTiles;
+                        texel[1] = slot->second / m_cacheTiles;
+                        texel[2] = level;
+                        texel[3] = 255;
+                    } else {
+                        auto &parent = m_levels[level + 1];
+                        size_t index = (static_cast<size_t>(y >> 1) * indirection_width(level + 1) + (x >> 1)) * 4;
+                        std::copy(&parent[index], &parent[index] + 4, texel);
+                    }
+                }
+            }
+            if (m_indirection->is_loaded()) {
+                m_indirection->upload_region(level, 0, 0, info.tilesX, info.tilesY, width, texels.data());
+            } else {
+                m_indirection->upload_level(level, width, height, texels.data());
+            }
+        }
+        m_indirectionDirty = false;
+    }
+
+    VirtualTextureFeedback::VirtualTextureFeedback()
+    : m_target(nullptr), m_pbo{0, 0}, m_width{0, 0}, m_height{0, 0}, m_next(0)
+    {
+    }
+
+    VirtualTextureFeedback::~VirtualTextureFeedback()
+    {
+        if (m_pbo[0] != 0) {
+            glDeleteBuffers(bufferCount, m_pbo);
+        }
+    }
+
+    void VirtualTextureFeedback::init_gl()
+    {
+        glGenBuffers(bufferCount, m_pbo);
+    }
+
+    void VirtualTextureFeedback::begin(RenderTarget *target)
+    {
+        m_target = target;
+        m_target->bind_target();
+        // Alpha holds the feedback id, 0 is nothing drawn.
+        GLfloat clear[] = {0.0f, 0.0f, 0.0f, 0.0f};
+        glClearBufferfv(GL_COLOR, 0, clear);
+        if (m_target->has_depth()) {
+            GLfloat depth = 1.0f;
+            glClearBufferfv(GL_DEPTH, 0, &depth);
+        }
+    }
+
+    void VirtualTextureFeedback::end()
+    {
+        int width = m_target->get_width();
+        int height = m_target->get_height();
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbo[m_next]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<size_t>(width) * height * 4, nullptr, GL_STREAM_READ);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        m_width[m_next] = width;
+        m_height[m_next] = height;
+        m_next = (m_next + 1) % bufferCount;
+        m_target = nullptr;
+    }
+
+    void VirtualTextureFeedback::read(const std::function<void(int, int, int, int)>& request)
+    {
+        // The buffer the next pass goes into is the oldest, by now the copy into it is done.
+        int index = m_next;
+        if (m_width[index] == 0) {
+            return;
+        }
+        PROFILE_ZONE("VirtualTextureFeedback::read");
+        size_t size = static_cast<size_t>(m_width[index]) * m_height[index] * 4;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbo[index]);
+        auto texels = static_cast<const unsigned char*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT));
+        if (texels != nullptr) {
+            // Neighbouring texels mostly want the same tile, only pass on changes.
+            const unsigned char *previous = nullptr;
+            for (size_t i = 0; i < size; i += 4)
+            {
+                const unsigned char *texel = texels + i;
+                if (texel[3] == 0 || (previous != nullptr && std::equal(texel, texel + 4, previous))) {
+                    continue;
+                }
+                request(texel[3], texel[2], texel[0], texel[1]);
+                previous = texel;
+            }
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        m_width[index] = 0;
+    }
+} // namespace ORCore
@@ -0,0 +1,139 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <glad/glad.h>
+
+#include "texture.hpp"
+#include "rendertarget.hpp"
+#include "virtualtexturefile.hpp"
+
+namespace ORCore
+{
+    // A texture too large to keep on the gpu, drawn from tiles of a .orvt file kept in a
+    // fixed size cache texture. A feedback pass renders which tiles are on screen, those
+    // are loaded on a worker thread and uploaded into the least recently seen cache slots.
+    // The indirection texture has a texel per tile at every level, pointing at the cache
+    // slot holding it or at the nearest coarser tile that is. The single tile of the last
+    // level never leaves the cache so there is always something to draw.
+    // See data/shaders/virtualtexture.glsl for the lookup.
+    class VirtualTexture
+    {
+    public:
+        // cache is the texture tiles go into, the cache holds cacheTiles x cacheTiles of them.
+        VirtualTexture(std::string path, Texture *cache, int cacheTiles = 16);
+        ~VirtualTexture();
+
+        void init_gl();
+        bool is_valid() { return m_file.is_valid(); }
+
+        Texture* get_indirection_texture() { return m_indirection.get(); }
+
+        // Feedback ids tell apart the virtual textures drawn in one feedback pass, 1 to 255.
+        void set_feedback_id(int id) { m_feedbackID = id; }
+        int get_feedback_id() { return m_feedbackID; }
+
+        // Sets the lookup uniforms for program, which has to be in use. lodBias makes up for
+        // the feedback pass being drawn at a lower resolution.
+        void set_uniforms(ShaderProgram *program, float lodBias);
+
+        // Marks a tile as seen this frame, called with what the feedback pass found.
+        void request_tile(int level, int x, int y);
+
+        // Call once per frame. Queues loads for the tiles requested since the last call, then
+        // uploads at most maxTiles loaded ones and updates the indirection. Returns tiles uploaded.
+        int update(int maxTiles, uint64_t frame);
+
+        int get_resident_tiles() { return m_tileSlots.size(); }
+        size_t get_tile_bytes() { return m_file.get_tile_bytes(); }
+        int get_pending_tiles(); // Requested and still loading.
+        size_t get_memory_size(); // Cache plus indirection.
+
+    private:
+        struct Slot
+        {
+            uint32_t key; // Tile in this slot, noTile when empty.
+            uint64_t lastUsed; // Frame it was last requested.
+        };
+
+        struct LoadedTile
+        {
+            uint32_t key;
+            std::vector<unsigned char> pixels;
+        };
+
+        static const uint32_t noTile = 0xFFFFFFFF;
+        static uint32_t tile_key(int level, int x, int y) { return (level << 16) | (y << 8) | x; }
+
+        void worker();
+        int find_slot(uint64_t frame);
+        void upload_indirection();
+        // Levels are the size gl expects from the padded base, tiles past the file's are unused.
+        int indirection_width(int level) { return std::max(1, m_indirectionWidth >> level); }
+        int indirection_height(int level) { return std::max(1, m_indirectionHeight >> level); }
+
+        VirtualTextureFile m_file;
+        Texture *m_cache;
+        std::unique_ptr<Texture> m_indirection;
+        int m_cacheTiles;
+        int m_feedbackID;
+
+        std::vector<Slot> m_slots;
+        std::unordered_map<uint32_t, int> m_tileSlots; // tile key -> slot
+        std::unordered_set<uint32_t> m_requested; // Since the last update.
+        std::unordered_set<uint32_t> m_loading;
+        std::vector<uint32_t> m_newRequests; // Reused every update.
+        std::vector<std::vector<unsigned char>> m_levels; // Indirection texels for every level.
+        // Level 0's tile counts rounded up to powers of two, so every level halves to at
+        // least as many tiles as the file has there.
+        int m_indirectionWidth;
+        int m_indirectionHeight;
+        bool m_indirectionDirty;
+
+        // Tiles are copied out of the mapping on a worker so page faults don't stall the frame.
+        std::thread m_worker;
+        std::mutex m_mutex;
+        std::condition_variable m_loadReady;
+        std::deque<uint32_t> m_loads;
+        std::deque<LoadedTile> m_loaded;
+        bool m_stopping;
+    };
+
+    // Renders the tiles virtual textures need into a small target and reads them back
+    // without waiting on the gpu, so requests arrive a couple of frames late.
+    class VirtualTextureFeedback
+    {
+    public:
+        VirtualTextureFeedback();
+        ~VirtualTextureFeedback();
+
+        void init_gl();
+
+        // Binds target for drawing the feedback pass and clears it.
+        void begin(RenderTarget *target);
+        // Starts copying the target back, it's read by the read() after next.
+        void end();
+
+        // Calls request(feedbackID, level, x, y) for every texel written in the oldest
+        // pass that hasn't been read yet.
+        void read(const std::function<void(int, int, int, int)>& request);
+
+    private:
+        static const int bufferCount = 2;
+
+        RenderTarget *m_target;
+        GLuint m_pbo[bufferCount];
+        int m_width[bufferCount];
+        int m_height[bufferCount];
+        int m_next; // Buffer the next pass is copied into.
+    };
+} // namespace ORCore
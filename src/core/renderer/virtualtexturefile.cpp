@@ -0,0 +1,155 @@
+#include "config.hpp"
+#include "virtualtexturefile.hpp"
+#include "texturefile.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace ORCore
+{
+    std::string virtual_texture_path(const std::string& imagePath)
+    {
+        size_t dot = imagePath.find_last_of('.');
+        size_t slash = imagePath.find_last_of("/\\");
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+            return imagePath + ".orvt";
+        }
+        return imagePath.substr(0, dot) + ".orvt";
+    }
+
+    static int tile_count(int size, int tileSize)
+    {
+        return (size + tileSize - 1) / tileSize;
+    }
+
+    bool bake_virtual_texture(const Image& img, const std::string& filename, int tileSize, bool srgb)
+    {
+        if (img.pixelData == nullptr || img.components != 4 || tileSize <= 0 ||
+            tile_count(img.width, tileSize) > virtualTextureMaxTiles ||
+            tile_count(img.height, tileSize) > virtualTextureMaxTiles) {
+            return false;
+        }
+
+        // One texel of border is enough for bilinear filtering.
+        const int border = 1;
+        const int stride = tileSize + border * 2;
+
+        std::vector<MipLevel> mips = build_mip_chain(img, srgb);
+        size_t levelCount = 1;
+        while (levelCount < mips.size() &&
+               (mips[levelCount - 1].width > tileSize || mips[levelCount - 1].height > tileSize))
+        {
+            levelCount++;
+        }
+
+        VirtualTextureHeader header {};
+        std::memcpy(header.magic, "ORVT", 4);
+        header.version = virtualTextureFileVersion;
+        header.width = img.width;
+        header.height = img.height;
+        header.tileSize = tileSize;
+        header.border = border;
+        header.levelCount = levelCount;
+        header.flags = srgb ? virtual_texture_srgb : 0;
+
+        size_t tileBytes = static_cast<size_t>(stride) * stride * 4;
+        std::vector<VirtualTextureLevel> levels(levelCount);
+        size_t offset = sizeof(VirtualTextureHeader) + sizeof(VirtualTextureLevel) * levelCount;
+        for (size_t i = 0; i < levelCount; i++)
+        {
+            offset = (offset + textureFileAlignment - 1) / textureFileAlignment * textureFileAlignment;
+            levels[i].width = mips[i].width;
+            levels[i].height = mips[i].height;
+            levels[i].tilesX = tile_count(mips[i].width, tileSize);
+            levels[i].tilesY = tile_count(mips[i].height, tileSize);
+            levels[i].offset = offset;
+            offset += tileBytes * levels[i].tilesX * levels[i].tilesY;
+        }
+
+        // Written a tile at a time as the whole file can be much larger than the image.
+        std::ofstream file(filename, std::ios::binary);
+        if (!file) {
+            return false;
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(levels.data()), sizeof(VirtualTextureLevel) * levelCount);
+
+        std::vector<char> tile(tileBytes);
+        for (size_t i = 0; i < levelCount; i++)
+        {
+            auto &mip = mips[i];
+            std::vector<char> padding(levels[i].offset - static_cast<size_t>(file.tellp()), 0);
+            file.write(padding.data(), padding.size());
+
+            for (uint32_t ty = 0; ty < levels[i].tilesY; ty++)
+            {
+                for (uint32_t tx = 0; tx < levels[i].tilesX; tx++)
+                {
+                    // Texels past the edge of the image repeat the edge, the same as clamping.
+                    for (int y = 0; y < stride; y++)
+                    {
+                        int sy = std::max(0, std::min(static_cast<int>(ty) * tileSize + y - border, mip.height - 1));
+                        for (int x = 0; x < stride; x++)
+                        {
+                            int sx = std::max(0, std::min(static_cast<int>(tx) * tileSize + x - border, mip.width - 1));
+                            std::memcpy(&tile[(static_cast<size_t>(y) * stride + x) * 4],
+                                        &mip.pixels[(static_cast<size_t>(sy) * mip.width + sx) * 4], 4);
+                        }
+                    }
+                    file.write(tile.data(), tile.size());
+                }
+            }
+            mip.pixels.clear();
+            mip.pixels.shrink_to_fit();
+        }
+        return static_cast<bool>(file);
+    }
+
+    VirtualTextureFile::VirtualTextureFile(std::string filename)
+    : m_header(nullptr), m_levels(nullptr)
+    {
+        m_file = std::make_unique<MappedFile>(filename);
+        if (!m_file->is_open() || m_file->size() < sizeof(VirtualTextureHeader)) {
+            std::cout << "Failed to open virtual texture: " << filename << std::endl;
+            return;
+        }
+
+        auto header = reinterpret_cast<const VirtualTextureHeader*>(m_file->data());
+        size_t tableEnd = sizeof(VirtualTextureHeader) + sizeof(VirtualTextureLevel) * static_cast<size_t>(header->levelCount);
+        if (std::memcmp(header->magic, "ORVT", 4) != 0 || header->version != virtualTextureFileVersion ||
+            header->tileSize == 0 || header->levelCount == 0 || tableEnd > m_file->size()) {
+            std::cout << "Invalid virtual texture: " << filename << std::endl;
+            return;
+        }
+
+        auto levels = reinterpret_cast<const VirtualTextureLevel*>(m_file->data() + sizeof(VirtualTextureHeader));
+        size_t stride = header->tileSize + header->border * 2;
+        for (uint32_t i = 0; i < header->levelCount; i++)
+        {
+            uint64_t size = stride * stride * 4 * static_cast<uint64_t>(levels[i].tilesX) * levels[i].tilesY;
+            if (levels[i].tilesX > virtualTextureMaxTiles || levels[i].tilesY > virtualTextureMaxTiles ||
+                levels[i].offset + size > m_file->size()) {
+                std::cout << "Invalid virtual texture: " << filename << std::endl;
+                return;
+            }
+        }
+        // The last level has to be a single tile so there's always something to fall back on.
+        auto &last = levels[header->levelCount - 1];
+        if (last.tilesX != 1 || last.tilesY != 1) {
+            std::cout << "Invalid virtual texture: " << filename << std::endl;
+            return;
+        }
+
+        m_header = header;
+        m_levels = levels;
+    }
+
+    const unsigned char* VirtualTextureFile::get_tile(int level, int x, int y)
+    {
+        auto &info = m_levels[level];
+        return m_file->data() + info.offset + (static_cast<size_t>(y) * info.tilesX + x) * get_tile_bytes();
+    }
+} // namespace ORCore
@@ -0,0 +1,75 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "texture.hpp"
+#include "vfs.hpp"
+
+namespace ORCore
+{
+    // Tiled textures for virtual texturing, written by texbake --virtual. The file is a
+    // header, a table of mip levels, then each level's tiles in rows. Tiles are RGBA8
+    // squares of tileSize texels with a border copied from their neighbours on every side
+    // so they can be filtered in the cache. Levels stop once the whole image fits in one tile.
+    const uint32_t virtualTextureFileVersion = 1;
+
+    // Indirection entries store tile positions in a byte, see VirtualTexture.
+    const int virtualTextureMaxTiles = 256;
+
+    enum VirtualTextureFlags
+    {
+        virtual_texture_srgb = 1 << 0, // Mips were filtered in linear light.
+    };
+
+    struct VirtualTextureHeader
+    {
+        char magic[4]; // "ORVT"
+        uint32_t version;
+        uint32_t width;
+        uint32_t height;
+        uint32_t tileSize; // Without the border.
+        uint32_t border;
+        uint32_t levelCount;
+        uint32_t flags;
+    };
+
+    struct VirtualTextureLevel
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t tilesX;
+        uint32_t tilesY;
+        uint64_t offset; // Of the first tile, from the start of the file.
+    };
+
+    // The image path with its extension swapped for .orvt.
+    std::string virtual_texture_path(const std::string& imagePath);
+
+    // Splits an RGBA image and its mips into tiles and writes them out. The image can be
+    // larger than GL_MAX_TEXTURE_SIZE, but no more than virtualTextureMaxTiles tiles across.
+    // Returns false if the image doesn't fit or the file couldn't be written.
+    bool bake_virtual_texture(const Image& img, const std::string& filename, int tileSize = 128, bool srgb = true);
+
+    // Read only view of a virtual texture through a memory mapping.
+    class VirtualTextureFile
+    {
+    public:
+        VirtualTextureFile(std::string filename);
+
+        bool is_valid() { return m_header != nullptr; }
+        const VirtualTextureHeader& get_header() { return *m_header; }
+        int get_level_count() { return m_header->levelCount; }
+        const VirtualTextureLevel& get_level(int level) { return m_levels[level]; }
+
+        // Width of a tile in texels including the border on both sides.
+        int get_tile_stride() { return m_header->tileSize + m_header->border * 2; }
+        size_t get_tile_bytes() { return static_cast<size_t>(get_tile_stride()) * get_tile_stride() * 4; }
+        const unsigned char* get_tile(int level, int x, int y);
+
+    private:
+        std::unique_ptr<MappedFile> m_file;
+        const VirtualTextureHeader *m_header;
+        const VirtualTextureLevel *m_levels;
+    };
+} // namespace ORCore
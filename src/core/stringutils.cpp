@@ -61,4 +61,21 @@ namespace ORCore
 
         return split;
     }
+
+    uint64_t stringHash(const char* data, size_t size, uint64_t seed)
+    {
+        const uint64_t prime = 1099511628211ULL;
+        uint64_t hash = seed;
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= prime;
+        }
+        return hash;
+    }
+
+    uint64_t stringHash(const std::string& str, uint64_t seed)
+    {
+        return stringHash(str.data(), str.size(), seed);
+    }
 } // namespace ORCore
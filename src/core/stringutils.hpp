@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -8,4 +9,9 @@ namespace ORCore {
     std::string stringJoin(const std::vector<std::string>& strElements, const std::string& delimiter);
 
     std::vector<std::string> stringSplit(const std::string& str, const std::string& delimiter);
+
+    // 64 bit FNV-1a, pass a previous result as the seed to hash several strings together.
+    const uint64_t stringHashSeed = 14695981039346656037ULL;
+    uint64_t stringHash(const char* data, size_t size, uint64_t seed = stringHashSeed);
+    uint64_t stringHash(const std::string& str, uint64_t seed = stringHashSeed);
 } // namespace ORCore
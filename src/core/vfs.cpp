@@ -12,11 +12,13 @@
 #   include <shlobj.h>
 #else
 #   include <dirent.h>
+#   include <fcntl.h>
+#   include <sys/mman.h>
 #   include <sys/stat.h>
+#   include <unistd.h>
 #   if defined(PLATFORM_OSX)
 #       include <mach-o/dyld.h>
 #   else
-#       include <unistd.h>
 #       include <linux/limits.h>
 #   endif
 #endif
@@ -182,6 +184,122 @@ namespace ORCore
     }
 
 
+    bool write_file(std::string filename, const std::string& data, FileMode mode)
+    {
+        auto fileMode = std::ios::out | std::ios_base::trunc;
+        if (mode == FileMode::Binary) {
+             fileMode |= std::ios_base::binary;
+        }
+        std::ofstream out(filename, fileMode);
+        if (out) {
+            out.write(data.data(), data.size());
+            return static_cast<bool>(out);
+        } else {
+            std::cout << "Failed to write: " << filename << std::endl;
+            return false;
+        }
+    }
+
+    MappedFile::MappedFile(std::string filename)
+    : m_data(nullptr), m_size(0)
+    {
+        #if defined(PLATFORM_WINDOWS)
+        m_mapping = nullptr;
+        m_file = CreateFile(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE) {
+            m_file = nullptr;
+            std::cout << "Failed to load: " << filename << std::endl;
+            return;
+        }
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(m_file, &fileSize) || fileSize.QuadPart == 0) {
+            return;
+        }
+        m_mapping = CreateFileMapping(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (m_mapping == nullptr) {
+            return;
+        }
+        m_data = static_cast<const unsigned char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+        if (m_data != nullptr) {
+            m_size = static_cast<size_t>(fileSize.QuadPart);
+        }
+        #else
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd == -1) {
+            std::cout << "Failed to load: " << filename << std::endl;
+            return;
+        }
+        struct stat sb;
+        if (fstat(fd, &sb) == 0 && sb.st_size > 0) {
+            void *mapped = mmap(nullptr, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                // Loaders read front to back so let the kernel read ahead.
+                madvise(mapped, sb.st_size, MADV_SEQUENTIAL);
+                m_data = static_cast<const unsigned char*>(mapped);
+                m_size = sb.st_size;
+            }
+        }
+        // The mapping keeps the file referenced on its own.
+        close(fd);
+        #endif
+    }
+
+    MappedFile::~MappedFile()
+    {
+        #if defined(PLATFORM_WINDOWS)
+        if (m_data != nullptr) {
+            UnmapViewOfFile(m_data);
+        }
+        if (m_mapping != nullptr) {
+            CloseHandle(m_mapping);
+        }
+        if (m_file != nullptr) {
+            CloseHandle(m_file);
+        }
+        #else
+        if (m_data != nullptr) {
+            munmap(const_cast<unsigned char*>(m_data), m_size);
+        }
+        #endif
+    }
+
+    // Creates a single directory, returns true if it exists afterwards.
+    bool sysMakeDirectory(std::string sysPath)
+    {
+        #if defined(PLATFORM_WINDOWS)
+        return CreateDirectory(sysPath.c_str(), nullptr) || GetLastError() == ERROR_ALREADY_EXISTS;
+        #else
+        struct stat sb;
+        if (mkdir(sysPath.c_str(), 0755) == 0) {
+            return true;
+        }
+        return stat(sysPath.c_str(), &sb) == 0 && S_ISDIR(sb.st_mode);
+        #endif
+    }
+
+    bool sysGetFileStamp(std::string sysPath, FileStamp& stamp)
+    {
+        #if defined(PLATFORM_WINDOWS)
+        WIN32_FILE_ATTRIBUTE_DATA data;
+        if (!GetFileAttributesEx(sysPath.c_str(), GetFileExInfoStandard, &data)) {
+            return false;
+        }
+        stamp.size = (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+        uint64_t ticks = (static_cast<uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+        stamp.modified = static_cast<int64_t>(ticks / 10000000); // 100ns ticks
+        return true;
+        #else
+        struct stat sb;
+        if (stat(sysPath.c_str(), &sb) != 0 || !S_ISREG(sb.st_mode)) {
+            return false;
+        }
+        stamp.size = sb.st_size;
+        stamp.modified = sb.st_mtime;
+        return true;
+        #endif
+    }
+
     std::vector<FileInfo> sysGetPathContents(std::string sysPath)
     {
         std::vector<FileInfo> contents;
@@ -196,7 +314,7 @@ namespace ORCore
             // return early with empty vector
             return contents;
         }
-        do
+        while ((dp = readdir(dir)) != nullptr)
         {
             std::string filePath = sysPath;
             filePath += sys_path_delimiter;
@@ -206,19 +324,21 @@ namespace ORCore
             file.filePath = std::move(filePath);
             file.fileName = dp->d_name;
 
-            stat(file.fileName.c_str(), &sb);
-
-            dp = readdir(dir); // This is for next loop iteration
+            if (stat(file.filePath.c_str(), &sb) != 0) {
+                continue;
+            }
 
             if (S_ISDIR(sb.st_mode)) {
                 file.fileType = FileType::Folder;
+                file.fileSize = 0;
             } else if (S_ISREG(sb.st_mode)) {
                 file.fileType = FileType::File;
+                file.fileSize = sb.st_size;
             } else {
                 continue;
             }
             contents.push_back(std::move(file));
-        } while(dp);
+        }
         closedir(dir);
         #endif
 
@@ -1,4 +1,8 @@
 #pragma once
+#include "config.hpp"
+
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <memory>
@@ -39,6 +43,7 @@ namespace ORCore
         std::string fileName;
         std::string filePath;
         FileType fileType;
+        uint64_t fileSize; // Bytes, 0 for folders.
     };
 
 
@@ -48,9 +53,42 @@ namespace ORCore
         Normal,
     };
 
+    // Read-only memory mapping of a whole file, so loaders can parse it in place
+    // without copying it into a buffer first.
+    class MappedFile
+    {
+    public:
+        MappedFile(std::string filename);
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool is_open() { return m_data != nullptr; }
+        const unsigned char* data() { return m_data; }
+        size_t size() { return m_size; }
+
+    private:
+        const unsigned char *m_data;
+        size_t m_size;
+#if defined(PLATFORM_WINDOWS)
+        void *m_file;
+        void *m_mapping;
+#endif
+    };
+
+    // Size and last modification time of a file, for telling when something derived from it is stale.
+    struct FileStamp
+    {
+        uint64_t size;
+        int64_t modified; // Seconds, only comparable with other stamps.
+    };
+
     // TODO - Merge these functions to be more integrated with the VFS
     std::vector<FileInfo> sysGetPathContents(std::string sysPath);
     std::string read_file(std::string filename, FileMode mode = FileMode::Normal);
+    bool write_file(std::string filename, const std::string& data, FileMode mode = FileMode::Normal);
+    bool sysMakeDirectory(std::string sysPath);
+    bool sysGetFileStamp(std::string sysPath, FileStamp& stamp); // False if the file doesn't exist.
     void SetBasePath( std::string newPath ); // set basePath
     std::string GetBasePath(); // executable path
 
@@ -0,0 +1,105 @@
+#include "config.hpp"
+#include "workerpool.hpp"
+
+#include <algorithm>
+
+namespace ORCore
+{
+    WorkerPool::WorkerPool(int threads)
+    : m_context(nullptr), m_func(nullptr), m_count(0), m_generation(0), m_active(0), m_next(0), m_stopping(false)
+    {
+        if (threads <= 0) {
+            int cores = std::thread::hardware_concurrency();
+            threads = std::max(1, std::min(cores, 8));
+        }
+        for (int i = 1; i < threads; i++)
+        {
+            m_workers.emplace_back(&WorkerPool::worker, this);
+        }
+    }
+
+    WorkerPool::~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_workReady.notify_all();
+        for (auto &thread : m_workers)
+        {
+            thread.join();
+        }
+    }
+
+    void WorkerPool::run(int count, void *context, TaskFunc func)
+    {
+        if (m_workers.empty() || count <= 1) {
+            for (int i = 0; i < count; i++)
+            {
+                func(context, i);
+            }
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_context = context;
+            m_func = func;
+            m_count = count;
+            m_next = 0;
+            m_generation++;
+        }
+        m_workReady.notify_all();
+        work(context, func, count);
+
+        // A worker can still be inside its last task after the indices run out.
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_workDone.wait(lock, [this] { return m_active == 0; });
+        m_context = nullptr;
+        m_func = nullptr;
+        m_count = 0;
+    }
+
+    void WorkerPool::work(void *context, TaskFunc func, int count)
+    {
+        for (int i = m_next++; i < count; i = m_next++)
+        {
+            func(context, i);
+        }
+    }
+
+    void WorkerPool::worker()
+    {
+        uint64_t seen = 0;
+        while (true)
+        {
+            void *context;
+            TaskFunc func;
+            int count;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_workReady.wait(lock, [&] { return m_stopping || m_generation != seen; });
+                if (m_stopping) {
+                    return;
+                }
+                // Waking up after a run finished sees a count of 0, taking an index
+                // then could steal one from the next run.
+                seen = m_generation;
+                context = m_context;
+                func = m_func;
+                count = m_count;
+                m_active++;
+            }
+
+            if (count > 0) {
+                work(context, func, count);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_active--;
+            }
+            m_workDone.notify_all();
+        }
+    }
+} // namespace ORCore
@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace ORCore
+{
+    // A fixed set of threads for splitting per frame work, they sleep between runs
+    // rather than being started every frame.
+    class WorkerPool
+    {
+    public:
+        // threads counts the thread calling run() too, 0 picks a count from the number of cores.
+        WorkerPool(int threads = 0);
+        ~WorkerPool();
+
+        int get_thread_count() { return m_workers.size() + 1; }
+
+        // Calls task(i) for every i from 0 to count - 1 across the pool and the calling
+        // thread, returns once they're all done. Indices are handed out one at a time.
+        // The task is only referenced, never copied, so running a lambda doesn't allocate.
+        template <typename Task>
+        void run(int count, Task&& task)
+        {
+            using TaskType = typename std::remove_reference<Task>::type;
+            run(count, const_cast<void*>(static_cast<const void*>(&task)), [](void *context, int index) {
+                (*static_cast<TaskType*>(context))(index);
+            });
+        }
+
+    private:
+        using TaskFunc = void (*)(void *context, int index);
+
+        void run(int count, void *context, TaskFunc func);
+        void worker();
+        void work(void *context, TaskFunc func, int count);
+
+        std::vector<std::thread> m_workers;
+        std::mutex m_mutex;
+        std::condition_variable m_workReady;
+        std::condition_variable m_workDone;
+        void *m_context;
+        TaskFunc m_func;
+        int m_count;
+        uint64_t m_generation; // Bumped by every run() so workers know there's new work.
+        int m_active; // Workers that took the current run and haven't finished.
+        std::atomic<int> m_next;
+        bool m_stopping;
+    };
+} // namespace ORCore
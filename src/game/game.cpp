@@ -2,30 +2,55 @@
 #include "game.hpp"
 
 #include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
 #include <stdexcept>
+#include <random>
 
 #include "vfs.hpp"
+#include "profiler.hpp"
+#include "renderer/glinfo.hpp"
+
 namespace PlanetGame
 {
-    GameManager::GameManager()
-    :m_width(800),
+    GameManager::GameManager(const GameOptions& options)
+    :m_options(options),
+    m_width(800),
     m_height(600),
     m_fullscreen(false),
     m_title("Ludum Dare"),
-    m_window(m_width, m_height, m_fullscreen, m_title),
-    m_context(3, 2, 0),
+    m_simTime(0.0),
     m_eventManager(),
     m_eventPump(&m_eventManager),
-    m_particles(&m_renderer)
+    m_particles(&m_renderer),
+    m_gpuParticles(&m_renderer),
+    m_particleProgram(-1),
+    m_spriteProgram(-1),
+    m_spriteBatch(-1),
+    m_overdrawTotal(0.0),
+    m_textureUploadTotal(0),
+    m_terrainTexture(-1),
+    m_terrainID(-1),
+    m_virtualTexture(-1),
+    m_virtualID(-1)
     {
+        m_launchTime = ORCore::Profiler::now();
         m_running = true;
 
         m_logger = spdlog::get("default");
 
 
-        m_window.make_current(&m_context);
+        if (m_options.headless) {
+            m_offscreenContext = std::make_unique<ORCore::OffscreenContext>(3, 2);
+            m_offscreenContext->make_current();
+        } else {
+            m_window = std::make_unique<ORCore::Window>(m_width, m_height, m_fullscreen, m_title);
+            m_context = std::make_unique<ORCore::Context>(3, 2, 0);
+            m_window->make_current(m_context.get());
 
-        m_window.disable_sync(); // only works on osx currently
+            m_window->disable_sync(); // only works on osx currently
+        }
 
         // todo fix this.
         //VFS.AddLoader(new ttvfs::DiskLoader);
@@ -50,10 +75,30 @@ namespace PlanetGame
         //ORCore::mount( "./data", "data" );
 
 
-        if(!gladLoadGL())
+        int gladLoaded;
+        if (m_options.headless) {
+            gladLoaded = gladLoadGLLoader(reinterpret_cast<GLADloadproc>(ORCore::OffscreenContext::get_proc_address));
+        } else {
+            gladLoaded = gladLoadGL();
+        }
+
+        if(!gladLoaded)
         {
             throw std::runtime_error("Error: GLAD failed to load.");
         }
+        ORCore::load_gl_extensions(m_options.headless ?
+            reinterpret_cast<GLADloadproc>(ORCore::OffscreenContext::get_proc_address) :
+            reinterpret_cast<GLADloadproc>(SDL_GL_GetProcAddress));
+
+        if (m_options.headless) {
+            // Everything renders into this instead of the default framebuffer.
+            m_offscreenTarget = std::make_unique<ORCore::OffscreenTarget>(m_width, m_height);
+            m_offscreenTarget->init_gl();
+            m_offscreenTarget->bind();
+
+            // Keep particle spawning identical between runs.
+            m_emitter.set_seed(0);
+        }
 
         m_lis.handler = std::bind(&GameManager::event_handler, this, std::placeholders::_1);
         m_lis.mask = ORCore::EventType::EventAll;
@@ -66,22 +111,82 @@ namespace PlanetGame
         m_ss = std::cout.precision();
 
         m_renderer.init_gl();
+        m_renderer.set_gpu_timing(m_options.gpuTiming);
+        m_renderer.set_overdraw_debug(m_options.overdraw);
+        m_renderer.set_pass_split(m_options.passSplit);
+
+        if (m_options.hitchThreshold > 0.0) {
+            ORCore::Profiler::set_hitch_trigger(m_options.hitchThreshold, "hitch_frame");
+        }
+
+        if (!m_options.statsPath.empty()) {
+            m_statsWriter = std::make_unique<ORCore::StatsWriter>(
+                m_options.statsPath, ORCore::StatsWriter::format_from_path(m_options.statsPath));
+            if (!m_statsWriter->is_open()) {
+                m_logger->error("Failed to open stats file {}", m_options.statsPath);
+            }
+        }
 
         ORCore::ShaderInfo vertInfo {GL_VERTEX_SHADER, "./data/shaders/main.vs"};
         ORCore::ShaderInfo fragInfo {GL_FRAGMENT_SHADER, "./data/shaders/main.fs"};
 
-        m_program = m_renderer.add_program(ORCore::Shader(vertInfo), ORCore::Shader(fragInfo));
-        m_texture = m_renderer.add_texture(ORCore::loadSTB("data/blank.png"));
-        m_texture2 = m_renderer.add_texture(ORCore::loadSTB("data/planet1.png"));
+        // Get the driver compiling shaders before loading textures so the two overlap.
+        // The planet is textured, alpha tested and positioned by its model matrix.
+        m_program = m_renderer.add_program_variants(vertInfo, fragInfo);
+        m_renderer.prepare_variant(m_program, ORCore::feature_textured | ORCore::feature_model_transform | ORCore::feature_alpha_test);
 
-        m_particles.set_program(m_program);
-        m_particles.init_gl();
+        ORCore::ShaderInfo particleVertInfo {GL_VERTEX_SHADER, "./data/shaders/particle.vs"};
+        ORCore::ShaderInfo particleFragInfo {GL_FRAGMENT_SHADER, "./data/shaders/particle.fs"};
+        m_particleProgram = m_renderer.request_program(particleVertInfo, particleFragInfo);
+
+        if (m_options.spriteCount > 0) {
+            ORCore::ShaderInfo spriteVertInfo {GL_VERTEX_SHADER, "./data/shaders/sprite.vs"};
+            ORCore::ShaderInfo spriteFragInfo {GL_FRAGMENT_SHADER, "./data/shaders/main.fs", {"TEXTURED", "VERTEX_COLOR"}};
+            m_spriteProgram = m_renderer.request_program(spriteVertInfo, spriteFragInfo);
+        }
+        m_renderer.submit_programs();
+
+        m_renderer.set_baked_textures(m_options.bakedTextures);
+        m_renderer.set_texture_budget(static_cast<size_t>(m_options.textureBudget) * 1024 * 1024);
+        // Textures decode in parallel on the streamer's workers while we set up everything else.
+        m_texture = m_renderer.load_texture("data/blank.png");
+        m_texture2 = m_renderer.load_texture("data/planet1.png");
+
+        m_renderer.set_layer_scale(1, m_options.particleScale);
+        if (m_options.gpuParticles > 0) {
+            m_gpuParticles.set_program(m_particleProgram);
+            m_gpuParticles.set_layer(1);
+            m_gpuParticles.set_spawn(m_options.gpuParticles, 7.0f);
+            m_gpuParticles.init_gl();
+        } else {
+            m_particles.set_program(m_particleProgram);
+            m_particles.set_layer(1);
+            m_particles.set_threads(m_options.particleThreads);
+            m_logger->info("Particles: {} kernel on {} threads", ORCore::particle_kernel_name(m_particles.get_kernel()),
+                m_particles.get_threads());
+            m_particles.init_gl();
+        }
+        m_renderer.finish_textures();
+        m_renderer.log_texture_memory();
+        m_renderer.log_resource_cache();
 
         resize(m_width, m_height);
 
-        m_particles.register_emitter(&m_emitter);
+        if (m_options.gpuParticles <= 0) {
+            m_particles.register_emitter(&m_emitter);
+        }
 
+        // Drawn first so everything else on its layer covers it.
+        if (!m_options.virtualTexture.empty()) {
+            prep_virtual_texture();
+        }
         prep_render_obj();
+        if (m_options.spriteCount > 0) {
+            prep_sprites();
+        }
+        if (m_options.terrainSize > 0) {
+            prep_terrain();
+        }
         m_renderer.commit();
 
         glClearColor(0.0, 0.0, 0.0, 1.0);
@@ -89,7 +194,12 @@ namespace PlanetGame
 
     GameManager::~GameManager()
     {
-        m_window.make_current(nullptr);
+        if (!m_options.tracePath.empty()) {
+            ORCore::Profiler::export_chrome_trace(m_options.tracePath);
+        }
+        if (m_window) {
+            m_window->make_current(nullptr);
+        }
     }
 
     void GameManager::prep_render_obj()
@@ -97,8 +207,9 @@ namespace PlanetGame
 
         // reuse the same container when creating multiple as add_obj wont modify the original.
         ORCore::RenderObject obj;
-        obj.set_texture(m_texture2);
+        obj.set_texture(m_texture2.get());
         obj.set_program(m_program);
+        obj.set_blend_mode(ORCore::blend_opaque); // The planet's transparent edges are alpha tested.
 
         obj.set_scale(glm::vec3{100.0f, 100.0f, 0.0f});
         obj.set_translation(glm::vec3{(m_width/2.0f), 100.0f, 0.0f}); // center the line on the screen
@@ -108,13 +219,138 @@ namespace PlanetGame
         m_boxID = m_renderer.add_object(obj);
     }
 
+    void GameManager::prep_sprites()
+    {
+        m_spriteBatch = m_renderer.add_sprite_batch(m_spriteProgram, m_texture2.get(), m_options.spriteCount);
+        auto &sprites = m_renderer.get_sprite_batch(m_spriteBatch)->edit_sprites();
+
+        // Fixed seed so headless runs draw the same thing every time.
+        std::mt19937 rng(0);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        for (int i = 0; i < m_options.spriteCount; i++)
+        {
+            ORCore::Sprite sprite;
+            sprite.position = glm::vec2{unit(rng) * m_width, unit(rng) * m_height};
+            sprite.size = glm::vec2{4.0f + unit(rng) * 12.0f};
+            sprite.rotation = unit(rng) * 6.2831853f;
+            sprite.depth = ORCore::layer_depth(2);
+            sprite.uvRect = 0;
+            sprite.color = ORCore::pack_color(glm::vec4{unit(rng), unit(rng), unit(rng), 1.0f});
+            sprites.push_back(sprite);
+        }
+    }
+
+    void GameManager::update_sprites(double dt)
+    {
+        PROFILE_ZONE("GameManager::update_sprites");
+        auto &sprites = m_renderer.get_sprite_batch(m_spriteBatch)->edit_sprites();
+        float step = static_cast<float>(dt);
+        for (auto &sprite : sprites)
+        {
+            sprite.rotation += step;
+            sprite.position.x += 20.0f * step;
+            if (sprite.position.x > m_width) {
+                sprite.position.x -= m_width;
+            }
+        }
+    }
+
+    void GameManager::prep_terrain()
+    {
+        // Layered rock with a little noise so the brush's edits and the mips are visible.
+        int size = m_options.terrainSize;
+        ORCore::Image img;
+        img.path = "terrain";
+        img.width = size;
+        img.height = size;
+        img.components = 4;
+        img.length = size * size * 4;
+        img.pixelData = ORCore::allocate_pixels(img.length);
+        for (int y = 0; y < size; y++)
+        {
+            int band = (y * 8 / size) % 2;
+            for (int x = 0; x < size; x++)
+            {
+                unsigned int hash = (x * 73856093U) ^ (y * 19349663U);
+                int noise = (hash >> 8) % 24;
+                unsigned char *texel = &img.pixelData[(static_cast<size_t>(y) * size + x) * 4];
+                texel[0] = band ? 120 + noise : 90 + noise;
+                texel[1] = band ? 80 + noise : 60 + noise;
+                texel[2] = band ? 40 + noise : 30 + noise;
+                texel[3] = 255;
+            }
+        }
+        m_terrainTexture = m_renderer.add_editable_texture(std::move(img));
+
+        ORCore::RenderObject obj;
+        obj.set_texture(m_terrainTexture);
+        obj.set_program(m_program);
+        obj.set_blend_mode(ORCore::blend_opaque); // Carved out texels are alpha tested away.
+        obj.set_scale(glm::vec3{static_cast<float>(m_width), m_height / 2.0f, 0.0f});
+        obj.set_translation(glm::vec3{0.0f, m_height / 2.0f, 0.0f});
+        obj.set_primitive_type(ORCore::Primitive::triangle);
+        obj.set_geometry(ORCore::create_rect_mesh(glm::vec4{1.0,1.0,1.0,1.0}));
+        m_terrainID = m_renderer.add_object(obj);
+    }
+
+    void GameManager::update_terrain()
+    {
+        PROFILE_ZONE("GameManager::update_terrain");
+        // The brush sweeps the texture along a fixed path so runs are repeatable.
+        auto *terrain = m_renderer.get_editable_image(m_terrainTexture);
+        float size = static_cast<float>(terrain->get_width());
+        int x = static_cast<int>((0.5f + 0.45f * std::sin(m_simTime * 1.3)) * size);
+        int y = static_cast<int>((0.5f + 0.45f * std::sin(m_simTime * 0.7)) * size);
+        const unsigned char hole[4] = {0, 0, 0, 0};
+        terrain->stamp_circle(x, y, std::max(4, terrain->get_width() / 128), hole);
+    }
+
+    void GameManager::prep_virtual_texture()
+    {
+        m_virtualTexture = m_renderer.add_virtual_texture(m_options.virtualTexture);
+        if (m_virtualTexture == -1) {
+            m_logger->error("Failed to load virtual texture {}", m_options.virtualTexture);
+            return;
+        }
+
+        ORCore::RenderObject obj;
+        obj.set_texture(m_virtualTexture);
+        obj.set_program(m_program);
+        obj.set_blend_mode(ORCore::blend_opaque);
+        obj.set_primitive_type(ORCore::Primitive::triangle);
+        obj.set_geometry(ORCore::create_rect_mesh(glm::vec4{1.0,1.0,1.0,1.0}));
+        m_virtualID = m_renderer.add_object(obj);
+        update_virtual_texture();
+    }
+
+    void GameManager::update_virtual_texture()
+    {
+        // Zooms from the whole texture on screen to 16x that while panning, so tiles from every
+        // level stream in and out. Driven by sim time so headless runs are repeatable.
+        auto obj = m_renderer.get_object(m_virtualID);
+        float zoom = 1.0f + 15.0f * (0.5f - 0.5f * static_cast<float>(std::cos(m_simTime * 0.2)));
+        float size = std::max(m_width, m_height) * zoom;
+        float x = (0.5f + 0.5f * static_cast<float>(std::sin(m_simTime * 0.13))) * (m_width - size);
+        float y = (0.5f + 0.5f * static_cast<float>(std::sin(m_simTime * 0.17))) * (m_height - size);
+        obj->set_scale(glm::vec3{size, size, 0.0f});
+        obj->set_translation(glm::vec3{x, y, 0.0f});
+        m_renderer.update_object(m_virtualID);
+    }
+
     void GameManager::start()
     {
+        if (m_options.headless) {
+            run_headless();
+            return;
+        }
+
         GLenum error;
+        int frame = 0;
         while (m_running)
         {
             double dt = m_clock.tick();
             m_fpsTime += dt;
+            m_renderer.begin_frame();
             m_eventPump.process();
 
             update(dt*0.001);
@@ -129,7 +365,8 @@ namespace PlanetGame
                 }
             } while(error != GL_NO_ERROR);
 
-            m_window.flip();
+            m_window->flip();
+            end_frame(frame++, dt);
             if (m_fpsTime >= 2000.0) {
                 std::cout.precision (5);
                 std::cout << "FPS: " << m_clock.get_fps() << std::endl;
@@ -139,11 +376,124 @@ namespace PlanetGame
         }
     }
 
+    // Renders a fixed number of frames at a fixed timestep into the offscreen target.
+    // Each frame is finished before timing stops so the numbers include the gpu work.
+    void GameManager::run_headless()
+    {
+        const double frameStep = 1000.0 / 60.0;
+        std::vector<double> frameTimes;
+        frameTimes.reserve(m_options.frames);
+
+        ORCore::Timer frameTimer;
+        GLenum error;
+
+        for (int frame = 0; frame < m_options.frames && m_running; frame++)
+        {
+            frameTimer.tick();
+            m_renderer.begin_frame();
+
+            update(frameStep*0.001);
+            render();
+            glFinish();
+
+            frameTimes.push_back(frameTimer.tick());
+            end_frame(frame, frameTimes.back());
+
+            while ((error = glGetError()) != GL_NO_ERROR)
+            {
+                m_logger->error("GL error {} on frame {}", error, frame);
+            }
+
+            if (!m_options.captureDir.empty()) {
+                std::string filename = m_options.captureDir + "/frame" + std::to_string(frame) + ".ppm";
+                if (!m_offscreenTarget->save_ppm(filename)) {
+                    m_logger->error("Failed to write frame capture {}", filename);
+                }
+            }
+        }
+
+        if (frameTimes.empty()) {
+            return;
+        }
+
+        std::ofstream timings(m_options.timingsPath);
+        if (timings) {
+            timings << "frame,ms\n";
+            for (size_t i = 0; i < frameTimes.size(); i++) {
+                timings << i << "," << frameTimes[i] << "\n";
+            }
+        } else {
+            m_logger->error("Failed to write frame timings to {}", m_options.timingsPath);
+        }
+
+        double total = 0.0;
+        for (double time : frameTimes) {
+            total += time;
+        }
+        std::vector<double> sorted = frameTimes;
+        std::sort(sorted.begin(), sorted.end());
+
+        m_logger->info("Headless run: {} frames, avg {:.3f} ms, min {:.3f} ms, median {:.3f} ms, p99 {:.3f} ms, max {:.3f} ms",
+            sorted.size(), total / sorted.size(), sorted.front(), sorted[sorted.size() / 2],
+            sorted[(sorted.size() * 99) / 100], sorted.back());
+
+        if (m_options.overdraw) {
+            m_logger->info("Average overdraw: {:.3f} samples per pixel (pass split {})",
+                m_overdrawTotal / frameTimes.size(), m_options.passSplit ? "on" : "off");
+        }
+
+        if (m_options.textureBudget > 0) {
+            auto &residency = m_renderer.get_texture_residency();
+            m_logger->info("Texture budget {} MB: {:.2f} MB resident, {} evicted, {} evictions and {} reloads in total",
+                m_options.textureBudget, residency.get_resident_bytes() / (1024.0 * 1024.0),
+                residency.get_evicted_count(), residency.get_total_evictions(), residency.get_total_reloads());
+        }
+
+        if (m_options.gpuParticles > 0) {
+            m_gpuParticles.request_alive_count();
+            m_logger->info("Gpu particles: {} alive of {}", m_gpuParticles.count_alive(true), m_gpuParticles.get_capacity());
+        }
+
+        if (m_virtualTexture != -1) {
+            auto *virtualTexture = m_renderer.get_virtual_texture(m_virtualTexture);
+            m_logger->info("Virtual texture: {} tiles resident, {} loading, {:.2f} MB on the gpu",
+                virtualTexture->get_resident_tiles(), virtualTexture->get_pending_tiles(),
+                virtualTexture->get_memory_size() / (1024.0 * 1024.0));
+        }
+
+        if (m_terrainTexture != -1) {
+            const double budget144 = 1000.0 / 144.0;
+            m_logger->info("Terrain {0}x{0}: {1:.1f} KB of texture uploaded per frame, p99 {2:.3f} ms against {3:.3f} ms for 144 Hz",
+                m_options.terrainSize, m_textureUploadTotal / 1024.0 / frameTimes.size(),
+                sorted[(sorted.size() * 99) / 100], budget144);
+        }
+    }
+
+    void GameManager::end_frame(int frame, double frameTime)
+    {
+        if (frame == 0) {
+            auto &cache = m_renderer.get_program_cache();
+            m_logger->info("Time to first frame: {:.2f} ms (program cache {}, hits {}, misses {}, baked textures {})",
+                (ORCore::Profiler::now() - m_launchTime) * 0.000001,
+                cache.is_supported() ? "enabled" : "unsupported", cache.get_hits(), cache.get_misses(),
+                m_renderer.get_baked_texture_count());
+        }
+
+        m_renderer.end_frame();
+        m_overdrawTotal += m_renderer.get_stats().overdraw;
+        m_textureUploadTotal += m_renderer.get_stats().textureUploadBytes;
+        ORCore::Profiler::end_frame(frame, frameTime);
+        if (m_statsWriter) {
+            m_statsWriter->write(frame, frameTime, m_renderer.get_stats());
+        }
+    }
+
     void GameManager::resize(int width, int height)
     {
         m_width = width;
         m_height = height;
         glViewport(0, 0, m_width, m_height);
+        m_renderer.set_viewport(0, 0, m_width, m_height);
         m_ortho = glm::ortho(0.0f, static_cast<float>(m_width), static_cast<float>(m_height), 0.0f, -1.0f, 1.0f);
     }
 
@@ -172,6 +522,11 @@ namespace PlanetGame
                     case ORCore::KeyCode::KEY_F:
                         std::cout << "Key F" << std::endl;
                         break;
+                    case ORCore::KeyCode::KEY_F12:
+                        if (ORCore::Profiler::export_chrome_trace("trace.json")) {
+                            m_logger->info("Wrote trace to trace.json");
+                        }
+                        break;
                     default:
                         std::cout << "Other Key" << std::endl;
                         break;
@@ -185,17 +540,36 @@ namespace PlanetGame
 
     void GameManager::update(double dt)
     {
+        PROFILE_ZONE("GameManager::update");
         auto obj = m_renderer.get_object(m_boxID);
 
-        obj->set_translation(glm::vec3{(m_width/2.0f)-256, 100.0f+(0.05*m_clock.get_current_time()), 0.0f});
+        m_simTime += dt;
+        m_renderer.set_frame_time(m_simTime, dt);
+
+        obj->set_translation(glm::vec3{(m_width/2.0f)-256, 100.0f+(50.0*m_simTime), 0.0f});
 
+        int emitterX = m_options.headless ? m_width/2 : m_mouseX;
+        int emitterY = m_options.headless ? m_height/2 : m_mouseY;
+        if (m_options.gpuParticles > 0) {
+            m_gpuParticles.set_emitter(glm::vec2{emitterX, emitterY}, glm::vec2{0.0001, 0.0001});
+            m_gpuParticles.simulate_particles(dt);
+        } else {
+            m_emitter.set_location(emitterX, emitterY);
+            m_emitter.set_velocity(glm::vec2{0.0001, 0.0001});
+            m_particles.simulate_particles(dt);
+        }
 
-        m_emitter.set_location(m_mouseX, m_mouseY);
-        m_emitter.set_velocity(glm::vec2{0.0001, 0.0001});
+        if (m_spriteBatch != -1) {
+            update_sprites(dt);
+        }
 
-        m_particles.simulate_particles(dt);
+        if (m_terrainTexture != -1) {
+            update_terrain();
+        }
 
-        m_particles.render_update();
+        if (m_virtualID != -1) {
+            update_virtual_texture();
+        }
 
         m_renderer.update_object(m_boxID);
         m_renderer.commit();
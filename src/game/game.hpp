@@ -4,6 +4,7 @@
 
 #include "window.hpp"
 #include "context.hpp"
+#include "offscreen.hpp"
 #include "events.hpp"
 #include "timing.hpp"
 #include "renderer/shader.hpp"
@@ -15,19 +16,50 @@
 
 namespace PlanetGame
 {
+    struct GameOptions
+    {
+        bool headless = false;
+        int frames = 600; // Number of frames to run in headless mode.
+        std::string captureDir; // Frame images are written here when set.
+        std::string timingsPath = "frametimes.csv";
+        bool gpuTiming = false;
+        std::string statsPath; // Per-frame renderer stats are written here when set, .json for json otherwise csv.
+        std::string tracePath; // A chrome trace is written here on exit when set.
+        bool overdraw = false; // Count samples per pixel, logged at the end of headless runs.
+        bool passSplit = true; // Off draws everything blended in creation order, for comparing overdraw.
+        float particleScale = 0.5f; // Resolution the particle layer is drawn at.
+        int particleThreads = 0; // Threads particles are simulated on, 0 picks from the number of cores.
+        int gpuParticles = 0; // Particles spawned per second on the gpu in place of the cpu particles, 0 disables.
+        bool bakedTextures = true; // Load .ortex files made by texbake in place of pngs when present.
+        int spriteCount = 0; // Number of sprites for the sprite batch stress test, 0 disables it.
+        int textureBudget = 0; // Texture memory budget in MB, 0 never evicts.
+        int terrainSize = 0; // Size of the editable terrain texture a moving brush carves into, 0 disables it.
+        std::string virtualTexture; // A .orvt drawn as a panning and zooming background when set.
+        double hitchThreshold = 0.0; // Frames slower than this (ms) dump a trace, 0 disables.
+    };
+
     class GameManager
     {
     public:
-        GameManager();
+        GameManager(const GameOptions& options = GameOptions());
         ~GameManager();
         void start();
+        void run_headless();
+        void end_frame(int frame, double frameTime);
         bool event_handler(const ORCore::Event &event);
         void handle_song();
         void update(double dt);
         void prep_render_obj();
+        void prep_sprites();
+        void update_sprites(double dt);
+        void prep_terrain();
+        void update_terrain();
+        void prep_virtual_texture();
+        void update_virtual_texture();
         void render();
         void resize(int width, int height);
     private:
+        GameOptions m_options;
         bool m_running;
         double m_fpsTime;
         int m_width;
@@ -39,19 +71,34 @@ namespace PlanetGame
         int m_mouseY = 0;
 
         ORCore::FpsTimer m_clock;
+        double m_simTime; // Accumulated update time, used instead of wall time so headless runs are repeatable.
+        uint64_t m_launchTime; // Profiler::now() at startup, for measuring time to first frame.
 
-        ORCore::Window m_window;
-        ORCore::Context m_context;
+        std::unique_ptr<ORCore::Window> m_window;
+        std::unique_ptr<ORCore::Context> m_context;
+        std::unique_ptr<ORCore::OffscreenContext> m_offscreenContext;
+        std::unique_ptr<ORCore::OffscreenTarget> m_offscreenTarget;
+        std::unique_ptr<ORCore::StatsWriter> m_statsWriter;
         ORCore::EventManager m_eventManager;
         ORCore::EventPumpSDL2 m_eventPump;
         ORCore::Renderer m_renderer;
         ORCore::Listener m_lis;
         ORCore::ParticleManager m_particles;
         ORCore::PointEmitter m_emitter;
+        ORCore::GpuParticleManager m_gpuParticles;
 
-        int m_texture;
-        int m_texture2;
+        ORCore::TextureHandle m_texture;
+        ORCore::TextureHandle m_texture2;
         int m_program;
+        int m_particleProgram;
+        int m_spriteProgram;
+        int m_spriteBatch;
+        double m_overdrawTotal;
+        uint64_t m_textureUploadTotal;
+        int m_terrainTexture;
+        int m_terrainID;
+        int m_virtualTexture;
+        int m_virtualID;
 
         int m_boxID;
 
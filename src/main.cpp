@@ -4,10 +4,99 @@
 #include <vector>
 #include <memory>
 #include <iterator>
+#include <string>
+#include <algorithm>
 #include <SDL.h>
 #include <spdlog/spdlog.h>
 
 #include "game.hpp"
+#include "vfs.hpp"
+#include "profiler.hpp"
+#include "renderer/texture.hpp"
+#include "particlestore.hpp"
+
+// Decodes every png in a directory a number of times and logs the throughput.
+// Nothing here touches gl so it runs without a window or context.
+static int run_image_benchmark(const std::string& directory, int passes, std::shared_ptr<spdlog::logger>& logger)
+{
+    std::vector<std::string> paths;
+    uint64_t fileBytes = 0;
+    for (auto &file : ORCore::sysGetPathContents(directory))
+    {
+        const std::string ext = ".png";
+        if (file.fileType == ORCore::FileType::File && file.fileName.size() > ext.size() &&
+            file.fileName.compare(file.fileName.size() - ext.size(), ext.size(), ext) == 0) {
+            fileBytes += file.fileSize;
+            paths.push_back(file.filePath);
+        }
+    }
+
+    if (paths.empty()) {
+        logger->error("No png images found in {}", directory);
+        return 1;
+    }
+
+    uint64_t pixelBytes = 0;
+    uint64_t start = ORCore::Profiler::now();
+    for (int pass = 0; pass < passes; pass++)
+    {
+        for (auto &path : paths)
+        {
+            ORCore::Image img = ORCore::loadSTB(path);
+            pixelBytes += img.length;
+        }
+    }
+    double seconds = (ORCore::Profiler::now() - start) * 0.000000001;
+    double megabyte = 1024.0 * 1024.0;
+
+    logger->info("Image load: {} images x {} passes in {:.3f} s, {:.1f} MB/s compressed, {:.1f} MB/s decoded, {:.3f} ms per image",
+        paths.size(), passes, seconds,
+        (fileBytes * passes) / megabyte / seconds, pixelBytes / megabyte / seconds,
+        seconds * 1000.0 / (paths.size() * passes));
+    return 0;
+}
+
+// Times the particle integration with every kernel the cpu supports, from a store that
+// fits in cache up to one that doesn't fit anywhere near it.
+static int run_particle_benchmark(std::shared_ptr<spdlog::logger>& logger)
+{
+    const float dt = 1.0f / 60.0f;
+    std::vector<ORCore::ParticleKernel> kernels;
+    for (auto kernel : {ORCore::ParticleKernel::Scalar, ORCore::ParticleKernel::SSE,
+                        ORCore::ParticleKernel::AVX2, ORCore::ParticleKernel::NEON})
+    {
+        if (ORCore::particle_kernel_supported(kernel)) {
+            kernels.push_back(kernel);
+        }
+    }
+
+    for (size_t count : {10000, 100000, 1000000, 10000000})
+    {
+        ORCore::ParticleStore store;
+        store.reserve(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            float spread = static_cast<float>(i % 1000) * 0.01f - 5.0f;
+            store.add({7.0f, 7.0f, glm::vec2{spread, -spread}, glm::vec2{640.0f, 360.0f}});
+        }
+
+        // Roughly the same amount of work at every size.
+        int passes = std::max<int>(5, static_cast<int>(50000000 / count));
+        for (auto kernel : kernels)
+        {
+            ORCore::integrate_particles(kernel, store, dt, 9.81f); // Warm up.
+            uint64_t start = ORCore::Profiler::now();
+            for (int pass = 0; pass < passes; pass++)
+            {
+                ORCore::integrate_particles(kernel, store, dt, 9.81f);
+            }
+            double nanoseconds = static_cast<double>(ORCore::Profiler::now() - start);
+            logger->info("Particles: {:>8} x {:>4} passes, {:<6} {:.3f} ns per particle",
+                count, passes, ORCore::particle_kernel_name(kernel), nanoseconds / (static_cast<double>(count) * passes));
+        }
+    }
+    return 0;
+}
 
 // Eventually we will want to load configuration files somewhere in here.
 // This also means the VFS needs to be setup here as well
@@ -39,8 +128,68 @@ int main(int argc, char** argv)
         return 1;
     }
 
+    PlanetGame::GameOptions options;
+    std::string benchImageDir;
+    int benchPasses = 10;
+    bool benchParticles = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--headless") {
+            options.headless = true;
+        } else if (arg == "--frames" && i+1 < argc) {
+            options.frames = std::stoi(argv[++i]);
+        } else if (arg == "--capture" && i+1 < argc) {
+            options.captureDir = argv[++i];
+        } else if (arg == "--timings" && i+1 < argc) {
+            options.timingsPath = argv[++i];
+        } else if (arg == "--gpu-timing") {
+            options.gpuTiming = true;
+        } else if (arg == "--trace" && i+1 < argc) {
+            options.tracePath = argv[++i];
+        } else if (arg == "--hitch-ms" && i+1 < argc) {
+            options.hitchThreshold = std::stod(argv[++i]);
+        } else if (arg == "--overdraw") {
+            options.overdraw = true;
+        } else if (arg == "--no-pass-split") {
+            options.passSplit = false;
+        } else if (arg == "--particle-scale" && i+1 < argc) {
+            options.particleScale = std::stof(argv[++i]);
+        } else if (arg == "--gpu-particles" && i+1 < argc) {
+            options.gpuParticles = std::stoi(argv[++i]);
+        } else if (arg == "--particle-threads" && i+1 < argc) {
+            options.particleThreads = std::stoi(argv[++i]);
+        } else if (arg == "--no-baked-textures") {
+            options.bakedTextures = false;
+        } else if (arg == "--sprites" && i+1 < argc) {
+            options.spriteCount = std::stoi(argv[++i]);
+        } else if (arg == "--texture-budget" && i+1 < argc) {
+            options.textureBudget = std::stoi(argv[++i]);
+        } else if (arg == "--terrain" && i+1 < argc) {
+            options.terrainSize = std::stoi(argv[++i]);
+        } else if (arg == "--virtual-texture" && i+1 < argc) {
+            options.virtualTexture = argv[++i];
+        } else if (arg == "--bench-images" && i+1 < argc) {
+            benchImageDir = argv[++i];
+        } else if (arg == "--bench-particles") {
+            benchParticles = true;
+        } else if (arg == "--bench-passes" && i+1 < argc) {
+            benchPasses = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--stats" && i+1 < argc) {
+            options.statsPath = argv[++i];
+        } else {
+            logger->warn("Unknown argument: {}", arg);
+        }
+    }
+
+    if (!benchImageDir.empty()) {
+        return run_image_benchmark(benchImageDir, benchPasses, logger);
+    }
+    if (benchParticles) {
+        return run_particle_benchmark(logger);
+    }
+
     try {
-        PlanetGame::GameManager game;
+        PlanetGame::GameManager game(options);
         game.start();
     } catch (std::runtime_error &err) {
         logger->critical("Runtime Error:\n{}", err.what());
@@ -0,0 +1,118 @@
+#include "config.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "vfs.hpp"
+#include "workerpool.hpp"
+#include "renderer/texture.hpp"
+#include "renderer/texturefile.hpp"
+#include "renderer/virtualtexturefile.hpp"
+
+// Converts images into baked .ortex textures that the game maps and uploads without
+// decoding anything. Each file is written next to its source, directories are searched
+// for pngs (not recursively).
+//
+// usage: texbake [--linear] [--compress] [--virtual] [--tile-size N] <image or directory>...
+//   --linear     Filter color channels as plain data rather than sRGB.
+//   --compress   Store BC1, or BC3 for images with alpha. Decompressed on load
+//                when the driver doesn't support s3tc.
+//   --virtual    Write a tiled .orvt for Renderer::add_virtual_texture instead, for
+//                images too large to load whole.
+//   --tile-size  Tile size for --virtual, 128 by default.
+
+static bool is_png(const std::string& name)
+{
+    const std::string ext = ".png";
+    return name.size() > ext.size() && name.compare(name.size() - ext.size(), ext.size(), ext) == 0;
+}
+
+static bool bake_virtual(const std::string& path, bool srgb, int tileSize)
+{
+    ORCore::Image img = ORCore::loadSTB(path, 4);
+    if (img.pixelData == nullptr) {
+        std::cerr << "Failed to load " << path << std::endl;
+        return false;
+    }
+
+    std::string output = ORCore::virtual_texture_path(path);
+    if (!ORCore::bake_virtual_texture(img, output, tileSize, srgb)) {
+        std::cerr << "Failed to bake " << path << ", it can be at most "
+                  << tileSize * ORCore::virtualTextureMaxTiles << " texels across" << std::endl;
+        return false;
+    }
+    std::cout << path << " -> " << output << " (" << img.width << "x" << img.height
+              << ", " << tileSize << " texel tiles)" << std::endl;
+    return true;
+}
+
+static bool bake(const std::string& path, bool srgb, bool compress, ORCore::WorkerPool& pool)
+{
+    ORCore::Image img = ORCore::loadSTB(path);
+    if (img.pixelData == nullptr) {
+        std::cerr << "Failed to load " << path << std::endl;
+        return false;
+    }
+
+    std::string output = ORCore::baked_texture_path(path);
+    if (!ORCore::bake_texture(img, output, srgb, compress, &pool)) {
+        std::cerr << "Failed to bake " << path << std::endl;
+        return false;
+    }
+    std::cout << path << " -> " << output << " (" << img.width << "x" << img.height
+              << ", " << img.components << " channels" << (compress ? ", compressed" : "") << ")" << std::endl;
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    bool srgb = true;
+    bool compress = false;
+    bool virtualTexture = false;
+    int tileSize = 128;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--linear") {
+            srgb = false;
+        } else if (arg == "--compress") {
+            compress = true;
+        } else if (arg == "--virtual") {
+            virtualTexture = true;
+        } else if (arg == "--tile-size" && i + 1 < argc) {
+            tileSize = std::max(1, std::atoi(argv[++i]));
+        } else {
+            paths.push_back(arg);
+        }
+    }
+
+    if (paths.empty()) {
+        std::cerr << "usage: texbake [--linear] [--compress] [--virtual] [--tile-size N] <image or directory>..." << std::endl;
+        return 1;
+    }
+
+    // Compression is split across every core, one pool for the whole run.
+    ORCore::WorkerPool pool;
+    auto bakeOne = [&](const std::string& path) {
+        return virtualTexture ? bake_virtual(path, srgb, tileSize) : bake(path, srgb, compress, pool);
+    };
+
+    int failed = 0;
+    for (auto &path : paths)
+    {
+        if (is_png(path)) {
+            failed += !bakeOne(path);
+            continue;
+        }
+        for (auto &file : ORCore::sysGetPathContents(path))
+        {
+            if (file.fileType == ORCore::FileType::File && is_png(file.fileName)) {
+                failed += !bakeOne(file.filePath);
+            }
+        }
+    }
+    return failed == 0 ? 0 : 1;
+}